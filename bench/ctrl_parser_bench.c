@@ -0,0 +1,100 @@
+#include "ctrl_parser.h"
+#include "cJSON.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// 控制消息解析微基准：对比快速扫描 ctrl_parse 与原先的 cJSON_Parse + cJSON_GetObjectItem 路径
+// 用法：ctrl_parser_bench [迭代次数]
+
+static const char *g_messages[] = {
+    "{\"type\":\"heartbeat\"}",
+    "{\"userid\":\"10001\",\"action\":202,\"params\":{\"songhash\":\"8D3C1A6E2F0B4C5D9E7A6B5C4D3E2F1A\"}}",
+    "{\"userid\":\"10001\",\"action\":205,\"params\":{\"songname\":\"\\u6674\\u5929\",\"songhash\":"
+    "\"8D3C1A6E2F0B4C5D9E7A6B5C4D3E2F1A\",\"singername\":\"周杰伦\",\"albumname\":\"叶惠美\","
+    "\"duration\":\"269\",\"coverurl\":\"http://imge.kugou.com/stdmusic/480/20150718/20150718.jpg\"}}",
+    "{\"userid\":\"10001\",\"action\":217,\"params\":{\"offset\":20,\"limit\":20}}",
+    "{\"type\":\"time_sync\",\"t0\":1760000000123.5}",
+};
+#define MESSAGE_COUNT (sizeof(g_messages) / sizeof(g_messages[0]))
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 原先的路径：解析成 DOM，再按字段名逐个查找（ADD_SONG 每个字段查两次）
+static int parse_cjson(const char *in, unsigned long *sink)
+{
+    cJSON *root = cJSON_Parse(in);
+    if (!root)
+        return -1;
+    cJSON *type = cJSON_GetObjectItem(root, "type");
+    if (cJSON_IsString(type))
+        *sink += type->valuestring[0];
+    cJSON *userid = cJSON_GetObjectItem(root, "userid");
+    cJSON *action = cJSON_GetObjectItem(root, "action");
+    cJSON *params = cJSON_GetObjectItem(root, "params");
+    if (cJSON_IsString(userid))
+        *sink += userid->valuestring[0];
+    if (cJSON_IsNumber(action))
+        *sink += action->valueint;
+    if (cJSON_IsObject(params))
+    {
+        static const char *names[] = {"songname", "songhash", "singername", "albumname", "duration", "coverurl", "offset", "limit"};
+        for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        {
+            if (cJSON_GetObjectItem(params, names[i]))
+                *sink += cJSON_GetObjectItem(params, names[i])->type;
+        }
+    }
+    cJSON_Delete(root);
+    return 0;
+}
+
+static int parse_fast(const char *in, size_t len, unsigned long *sink)
+{
+    ctrl_msg_t msg;
+    if (ctrl_parse(in, len, &msg) < 0)
+        return -1;
+    *sink += msg.action + msg.flags + msg.used;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 200000;
+    size_t lens[MESSAGE_COUNT];
+    unsigned long sink = 0;
+    for (size_t i = 0; i < MESSAGE_COUNT; i++)
+    {
+        lens[i] = strlen(g_messages[i]);
+        if (parse_fast(g_messages[i], lens[i], &sink) < 0)
+        {
+            fprintf(stderr, "快速解析失败: %s\n", g_messages[i]);
+            return 1;
+        }
+    }
+
+    printf("%-12s %14s %14s %8s\n", "消息", "cJSON ns/条", "扫描 ns/条", "加速比");
+    for (size_t i = 0; i < MESSAGE_COUNT; i++)
+    {
+        double start = now_sec();
+        for (long n = 0; n < iterations; n++)
+            parse_cjson(g_messages[i], &sink);
+        double cjson_ns = (now_sec() - start) * 1e9 / iterations;
+
+        start = now_sec();
+        for (long n = 0; n < iterations; n++)
+            parse_fast(g_messages[i], lens[i], &sink);
+        double fast_ns = (now_sec() - start) * 1e9 / iterations;
+
+        printf("#%-11zu %14.1f %14.1f %7.1fx\n", i, cjson_ns, fast_ns, cjson_ns / fast_ns);
+    }
+    // 防止编译器优化掉解析结果
+    fprintf(stderr, "sink=%lu\n", sink);
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include "ws_deflate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+// permessage-deflate 带宽 / CPU 取舍基准：对典型下行消息统计各压缩等级的压缩率和耗时，
+// 并对比房间广播按连接逐个压缩（每个成员一个带上下文的压缩流，与 lws 的 permessage-deflate 相同）
+// 与压缩一次共用帧的实测 CPU 开销和下行字节数
+// 用法：deflate_bench [房间人数]
+
+// 房间广播对比的轮数
+#define BROADCAST_ROUNDS 20
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 构造与 get_playlist_json 相同结构的歌单快照
+static char *build_playlist(int songs, size_t *len)
+{
+    static const char *names[] = {"晴天", "稻香", "七里香", "夜曲", "青花瓷", "告白气球", "简单爱", "搁浅"};
+    static const char *singers[] = {"周杰伦", "林俊杰", "陈奕迅", "邓紫棋", "薛之谦"};
+    size_t cap = (size_t)songs * 512 + 256;
+    char *out = (char *)malloc(cap);
+    if (!out)
+        return NULL;
+    size_t n = (size_t)snprintf(out, cap, "{\"type\":\"playlist\",\"version\":%d,\"current\":0,\"songs\":[", songs);
+    for (int i = 0; i < songs; i++)
+    {
+        unsigned int h = 2166136261u ^ (unsigned int)i * 16777619u;
+        n += (size_t)snprintf(out + n, cap - n,
+                              "%s{\"songname\":\"%s\",\"singername\":\"%s\",\"albumname\":\"%s 第%d辑\","
+                              "\"songhash\":\"%08X%08X%08X%08X\",\"duration\":\"%d\","
+                              "\"coverurl\":\"http://imge.kugou.com/stdmusic/480/2015%04d/%08x.jpg\",\"userid\":\"%d\"}",
+                              i ? "," : "", names[i % 8], singers[i % 5], singers[(i + 2) % 5], i % 12, h, h * 31u, h * 131u,
+                              h * 1313u, 180 + i % 120, 700 + i % 300, h, 10000 + i % 40);
+    }
+    n += (size_t)snprintf(out + n, cap - n, "]}");
+    *len = n;
+    return out;
+}
+
+static const char *g_song_info =
+    "{\"type\":\"song_info\",\"songname\":\"晴天\",\"singername\":\"周杰伦\",\"albumname\":\"叶惠美\","
+    "\"songhash\":\"8D3C1A6E2F0B4C5D9E7A6B5C4D3E2F1A\",\"duration\":\"269\","
+    "\"coverurl\":\"http://imge.kugou.com/stdmusic/480/20150718/20150718.jpg\","
+    "\"url\":\"http://fs.youthandroid2.kugou.com/202510171200/8d3c1a6e2f0b4c5d9e7a6b5c4d3e2f1a/v2/"
+    "8d3c1a6e2f0b4c5d9e7a6b5c4d3e2f1a/G123/M00/AB/CD/abcdEFGH.mp3\",\"progress\":0}";
+
+static const char *g_progress = "{\"type\":\"progress\",\"percent\":0.4213,\"position\":113.3}";
+
+// 编码 iterations 次，返回平均耗时（微秒）与帧长度
+static double encode_us(const char *msg, size_t len, int level, int iterations, size_t *frame_len)
+{
+    unsigned char *out = (unsigned char *)malloc(ws_frame_bound(len));
+    if (!out)
+        return 0;
+    double start = now_sec();
+    for (int i = 0; i < iterations; i++)
+        *frame_len = ws_frame_encode(out, ws_frame_bound(len), (const unsigned char *)msg, len, level, 0);
+    double us = (now_sec() - start) * 1e6 / iterations;
+    free(out);
+    return us;
+}
+
+// 模拟 lws 的逐连接压缩：members 个独立压缩流（保留上下文），每轮广播把 msg 依次压进每个流，
+// 返回每轮广播的平均耗时（微秒），*wire_len 为每轮所有成员的下行帧字节数
+static double per_connection_us(const char *msg, size_t len, int level, int members, int rounds, size_t *wire_len)
+{
+    z_stream *streams = (z_stream *)calloc((size_t)members, sizeof(z_stream));
+    size_t cap = deflateBound(NULL, (uLong)len) + 64;
+    unsigned char *out = (unsigned char *)malloc(cap);
+    int ready = 0;
+    double us = 0;
+    *wire_len = 0;
+    if (!streams || !out)
+        goto done;
+    for (; ready < members; ready++)
+    {
+        if (deflateInit2(&streams[ready], level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            goto done;
+    }
+
+    size_t total = 0;
+    double start = now_sec();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int m = 0; m < members; m++)
+        {
+            z_stream *zs = &streams[m];
+            size_t produced = 0;
+            zs->next_in = (unsigned char *)msg;
+            zs->avail_in = (unsigned int)len;
+            do
+            {
+                zs->next_out = out;
+                zs->avail_out = (unsigned int)cap;
+                deflate(zs, Z_SYNC_FLUSH);
+                produced += cap - zs->avail_out;
+            } while (zs->avail_out == 0);
+            // 与 ws_deflate.c 相同：去掉结尾的 00 00 ff ff，再按压缩后长度加帧头
+            size_t clen = produced - 4;
+            total += ws_frame_header_len(clen) + clen;
+        }
+    }
+    us = (now_sec() - start) * 1e6 / rounds;
+    *wire_len = total / (size_t)rounds;
+
+done:
+    for (int m = 0; m < ready; m++)
+        deflateEnd(&streams[m]);
+    free(streams);
+    free(out);
+    return us;
+}
+
+int main(int argc, char **argv)
+{
+    int members = argc > 1 ? atoi(argv[1]) : 200;
+    if (members <= 0)
+        members = 200;
+
+    size_t playlist_len = 0;
+    char *playlist = build_playlist(500, &playlist_len);
+    if (!playlist)
+        return 1;
+    struct
+    {
+        const char *name;
+        const char *msg;
+        size_t len;
+        int iterations;
+    } cases[] = {
+        {"歌单快照", playlist, playlist_len, 200},
+        {"歌曲信息", g_song_info, strlen(g_song_info), 20000},
+        {"播放进度", g_progress, strlen(g_progress), 20000},
+    };
+    static const int levels[] = {0, 1, 6, 9};
+
+    printf("%-10s %5s %10s %10s %8s %10s\n", "消息", "等级", "原文字节", "帧字节", "压缩率", "us/条");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++)
+        {
+            size_t frame_len = 0;
+            double us = encode_us(cases[c].msg, cases[c].len, levels[l], cases[c].iterations, &frame_len);
+            printf("%-10s %5d %10zu %10zu %7.1f%% %10.2f\n", cases[c].name, levels[l], cases[c].len, frame_len,
+                   100.0 * frame_len / cases[c].len, us);
+        }
+    }
+
+    // 房间广播：按连接逐个压缩需要 members 次压缩，压缩一次则与人数无关
+    printf("\n房间 %d 人广播歌单快照（等级 1，%d 轮平均）：\n", members, BROADCAST_ROUNDS);
+    size_t per_conn_len = 0;
+    double per_conn_us = per_connection_us(playlist, playlist_len, 1, members, BROADCAST_ROUNDS, &per_conn_len);
+    size_t frame_len = 0;
+    double once_us = encode_us(playlist, playlist_len, 1, BROADCAST_ROUNDS, &frame_len);
+    printf("  逐连接压缩 %10.1f us  下行 %zu 字节\n", per_conn_us, per_conn_len);
+    printf("  压缩一次   %10.1f us  下行 %zu 字节\n", once_us, frame_len * (size_t)members);
+    printf("  不压缩     %10.1f us  下行 %zu 字节\n", 0.0,
+           (ws_frame_header_len(playlist_len) + playlist_len) * (size_t)members);
+
+    free(playlist);
+    return 0;
+}
@@ -0,0 +1,631 @@
+#include <libwebsockets.h>
+#include <getopt.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 本地模拟上游音乐 API：实现服务用到的 /song/url、/search/lyric、/lyric 三个接口，
+// 返回与真实上游相同结构的 JSON，可配置注入延迟的分布、错误率、响应体大小和连接数上限，
+// 配合服务的 --upstream-url 和 ws_loadgen 做可复现的压测。随机数由 --seed 决定，同样的参数得到同样的序列。
+// 退出（Ctrl+C）时以 JSON 输出各接口的请求数、错误数和连接统计。
+// 用法：mock_upstream [选项]，--help 查看
+
+enum mock_endpoint
+{
+    MOCK_SONG_URL,     // /song/url?hash=      -> {"url":["..."]}
+    MOCK_SEARCH_LYRIC, // /search/lyric?hash=  -> {"candidates":[{"id":"..","accesskey":".."}]}
+    MOCK_LYRIC,        // /lyric?id=&accesskey= -> {"decodeContent":"..."}
+    MOCK_ENDPOINT_MAX
+};
+
+static const char *g_paths[MOCK_ENDPOINT_MAX] = {"/song/url", "/search/lyric", "/lyric"};
+
+// 延迟分布，参数单位毫秒
+enum mock_dist
+{
+    MOCK_DIST_FIXED,     // fixed:<毫秒>
+    MOCK_DIST_UNIFORM,   // uniform:<最小>:<最大>
+    MOCK_DIST_EXP,       // exp:<均值>
+    MOCK_DIST_LOGNORMAL, // lognormal:<中位数>:<sigma>，长尾
+};
+
+typedef struct mock_latency
+{
+    int dist; // enum mock_dist
+    double a;
+    double b;
+} mock_latency_t;
+
+// 每个接口的行为
+typedef struct mock_behavior
+{
+    mock_latency_t latency;
+    double error_rate;    // 返回 500
+    double reset_rate;    // 不回复直接断开连接
+    double hang_rate;     // 不回复也不断开，直到客户端超时
+    size_t payload_bytes; // 响应体填充到至少该长度，0 表示不填充
+} mock_behavior_t;
+
+typedef struct mock_endpoint_stats
+{
+    unsigned long requests;
+    unsigned long ok;
+    unsigned long errors;
+    unsigned long resets;
+    unsigned long hangs;
+    unsigned long bytes;
+    double delay_ms_sum; // 注入的延迟
+    double delay_ms_max;
+} mock_endpoint_stats_t;
+
+enum mock_state
+{
+    MOCK_IDLE,
+    MOCK_DELAYED, // 等待注入的延迟到期
+    MOCK_HEADERS, // 可写时发送响应头
+    MOCK_BODY,    // 可写时发送响应体
+    MOCK_HUNG,    // 不再回复
+};
+
+// 每个连接的会话数据（lws 按 per_session_data_size 分配）
+typedef struct mock_session
+{
+    lws_sorted_usec_list_t sul; // 注入的延迟
+    struct lws *wsi;
+    char *body; // 前面预留 LWS_PRE 字节
+    size_t len;
+    unsigned int status;
+    int endpoint; // enum mock_endpoint
+    char state;   // enum mock_state
+    char counted; // 计入了活跃连接数
+} mock_session_t;
+
+static struct
+{
+    int port;
+    int max_connections; // 0 表示不限
+    int keepalive;       // 响应后保持连接
+    unsigned long seed;
+    mock_behavior_t behavior[MOCK_ENDPOINT_MAX];
+} g_opt = {3000, 0, 1, 1}; // 各接口默认无延迟、无错误、不填充
+
+static struct
+{
+    unsigned long accepted;
+    unsigned long rejected;
+    int active;
+    int peak;
+    mock_endpoint_stats_t endpoints[MOCK_ENDPOINT_MAX];
+} g_stats;
+
+static uint64_t g_rng;
+static lws_usec_t g_start_us;
+static volatile int g_interrupted;
+
+// xorshift64*，[0, 1)
+static double rng_uniform(void)
+{
+    g_rng ^= g_rng >> 12;
+    g_rng ^= g_rng << 25;
+    g_rng ^= g_rng >> 27;
+    return (double)((g_rng * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// 标准正态分布（Box-Muller）
+static double rng_normal(void)
+{
+    double u = rng_uniform();
+    double v = rng_uniform();
+    return sqrt(-2.0 * log(1.0 - u)) * cos(2.0 * M_PI * v);
+}
+
+// 按分布抽取一次延迟（毫秒）
+static double sample_latency_ms(const mock_latency_t *latency)
+{
+    double ms = 0;
+    switch (latency->dist)
+    {
+    case MOCK_DIST_FIXED:
+        ms = latency->a;
+        break;
+    case MOCK_DIST_UNIFORM:
+        ms = latency->a + (latency->b - latency->a) * rng_uniform();
+        break;
+    case MOCK_DIST_EXP:
+        ms = -latency->a * log(1.0 - rng_uniform());
+        break;
+    case MOCK_DIST_LOGNORMAL:
+        ms = latency->a * exp(latency->b * rng_normal());
+        break;
+    }
+    return ms > 0 ? ms : 0;
+}
+
+// 只保留字母数字，参数会原样写进 JSON
+static void sanitize(char *s)
+{
+    char *out = s;
+    for (; *s; s++)
+    {
+        if ((*s >= '0' && *s <= '9') || (*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z'))
+            *out++ = *s;
+    }
+    *out = '\0';
+}
+
+static unsigned int fnv1a(const char *s)
+{
+    unsigned int h = 2166136261u;
+    for (; *s; s++)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+// 生成响应体：core 是没有结尾 } 的 JSON 对象，需要时追加 "padding" 字段填充到 payload_bytes
+static int build_body(mock_session_t *session, const char *core, size_t payload_bytes)
+{
+    size_t core_len = strlen(core);
+    size_t pad = 0;
+    if (payload_bytes > core_len + 16)
+        pad = payload_bytes - core_len - 14; // ,"padding":"" 和 } 共 14 字节
+    session->body = (char *)malloc(LWS_PRE + core_len + pad + 16);
+    if (!session->body)
+        return -1;
+    char *p = session->body + LWS_PRE;
+    memcpy(p, core, core_len);
+    p += core_len;
+    if (pad)
+    {
+        memcpy(p, ",\"padding\":\"", 12);
+        p += 12;
+        memset(p, 'x', pad);
+        p += pad;
+        *p++ = '"';
+    }
+    *p++ = '}';
+    session->len = (size_t)(p - (session->body + LWS_PRE));
+    return 0;
+}
+
+// 按接口生成正常响应
+static int build_response(mock_session_t *session, struct lws *wsi)
+{
+    char core[512];
+    char hash[128] = {0};
+    char id[64] = {0};
+    switch (session->endpoint)
+    {
+    case MOCK_SONG_URL:
+        lws_get_urlarg_by_name(wsi, "hash", hash, sizeof(hash));
+        sanitize(hash);
+        snprintf(core, sizeof(core),
+                 "{\"status\":1,\"hash\":\"%s\",\"url\":[\"http://mock.invalid/audio/%s.mp3\"],"
+                 "\"backupUrl\":[\"http://mock.invalid/backup/%s.mp3\"],\"fileSize\":4194304,\"timeLength\":240",
+                 hash, hash, hash);
+        break;
+    case MOCK_SEARCH_LYRIC:
+        lws_get_urlarg_by_name(wsi, "hash", hash, sizeof(hash));
+        sanitize(hash);
+        snprintf(core, sizeof(core),
+                 "{\"status\":200,\"errcode\":200,\"candidates\":[{\"id\":\"%u\",\"accesskey\":\"%s\","
+                 "\"song\":\"mock\",\"duration\":240000}]",
+                 fnv1a(hash), hash);
+        break;
+    default:
+        lws_get_urlarg_by_name(wsi, "id", id, sizeof(id));
+        sanitize(id);
+        snprintf(core, sizeof(core),
+                 "{\"status\":200,\"fmt\":\"lrc\",\"decodeContent\":\"[00:00.00]mock lyric %s\\n[00:05.00]la la la\\n\"",
+                 id);
+        break;
+    }
+    return build_body(session, core, g_opt.behavior[session->endpoint].payload_bytes);
+}
+
+// 注入的延迟到期，开始回复
+static void delay_done(lws_sorted_usec_list_t *sul)
+{
+    mock_session_t *session = lws_container_of(sul, mock_session_t, sul);
+    session->state = MOCK_HEADERS;
+    lws_callback_on_writable(session->wsi);
+}
+
+static void session_reset(mock_session_t *session)
+{
+    lws_sul_cancel(&session->sul);
+    free(session->body);
+    session->body = NULL;
+    session->state = MOCK_IDLE;
+}
+
+// 收到请求：按配置的比例断开、挂起、返回错误或正常响应，正常和错误响应都先等待注入的延迟
+static int handle_request(struct lws *wsi, mock_session_t *session, const char *uri)
+{
+    int endpoint = 0;
+    while (endpoint < MOCK_ENDPOINT_MAX && strcmp(uri, g_paths[endpoint]))
+        endpoint++;
+    if (endpoint == MOCK_ENDPOINT_MAX)
+    {
+        if (lws_return_http_status(wsi, HTTP_STATUS_NOT_FOUND, NULL))
+            return -1;
+        return lws_http_transaction_completed(wsi) ? -1 : 0;
+    }
+    const mock_behavior_t *behavior = &g_opt.behavior[endpoint];
+    mock_endpoint_stats_t *stats = &g_stats.endpoints[endpoint];
+    session_reset(session);
+    session->wsi = wsi;
+    session->endpoint = endpoint;
+    stats->requests++;
+
+    double roll = rng_uniform();
+    if (roll < behavior->reset_rate)
+    {
+        stats->resets++;
+        return -1;
+    }
+    roll -= behavior->reset_rate;
+    if (roll < behavior->hang_rate)
+    {
+        stats->hangs++;
+        session->state = MOCK_HUNG;
+        return 0;
+    }
+    roll -= behavior->hang_rate;
+    if (roll < behavior->error_rate)
+    {
+        stats->errors++;
+        session->status = HTTP_STATUS_INTERNAL_SERVER_ERROR;
+        if (build_body(session, "{\"status\":0,\"error\":\"mock upstream error\"", 0) < 0)
+            return -1;
+    }
+    else
+    {
+        session->status = HTTP_STATUS_OK;
+        if (build_response(session, wsi) < 0)
+            return -1;
+    }
+
+    double delay_ms = sample_latency_ms(&behavior->latency);
+    stats->delay_ms_sum += delay_ms;
+    if (delay_ms > stats->delay_ms_max)
+        stats->delay_ms_max = delay_ms;
+    lws_usec_t delay_us = (lws_usec_t)(delay_ms * LWS_US_PER_MS);
+    if (delay_us > 0)
+    {
+        session->state = MOCK_DELAYED;
+        lws_sul_schedule(lws_get_context(wsi), 0, &session->sul, delay_done, delay_us);
+    }
+    else
+    {
+        session->state = MOCK_HEADERS;
+        lws_callback_on_writable(wsi);
+    }
+    return 0;
+}
+
+static int callback_mock(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len)
+{
+    mock_session_t *session = (mock_session_t *)user;
+    switch (reason)
+    {
+    case LWS_CALLBACK_FILTER_NETWORK_CONNECTION:
+        // 达到连接数上限时直接挂断，模拟上游拒绝连接
+        if (g_opt.max_connections && g_stats.active >= g_opt.max_connections)
+        {
+            g_stats.rejected++;
+            return 1;
+        }
+        g_stats.accepted++;
+        break;
+    case LWS_CALLBACK_HTTP_BIND_PROTOCOL:
+        if (session && !session->counted)
+        {
+            session->counted = 1;
+            if (++g_stats.active > g_stats.peak)
+                g_stats.peak = g_stats.active;
+        }
+        break;
+    case LWS_CALLBACK_HTTP:
+        return handle_request(wsi, session, (const char *)in);
+    case LWS_CALLBACK_HTTP_WRITEABLE:
+    {
+        if (session->state == MOCK_HEADERS)
+        {
+            unsigned char headers[LWS_PRE + 256];
+            unsigned char *start = headers + LWS_PRE, *p = start, *end = headers + sizeof(headers) - 1;
+            if (lws_add_http_common_headers(wsi, session->status, "application/json", session->len, &p, end) ||
+                lws_finalize_write_http_header(wsi, start, &p, end))
+                return -1;
+            session->state = MOCK_BODY;
+            lws_callback_on_writable(wsi);
+            return 0;
+        }
+        if (session->state != MOCK_BODY)
+            return 0;
+        int ret = lws_write(wsi, (unsigned char *)session->body + LWS_PRE, session->len, LWS_WRITE_HTTP_FINAL);
+        mock_endpoint_stats_t *stats = &g_stats.endpoints[session->endpoint];
+        stats->bytes += session->len;
+        if (session->status == HTTP_STATUS_OK)
+            stats->ok++;
+        session_reset(session);
+        if (ret < 0 || !g_opt.keepalive || lws_http_transaction_completed(wsi))
+            return -1;
+        return 0;
+    }
+    case LWS_CALLBACK_HTTP_DROP_PROTOCOL:
+    case LWS_CALLBACK_CLOSED_HTTP:
+        if (!session)
+            break;
+        session_reset(session);
+        if (session->counted)
+        {
+            session->counted = 0;
+            g_stats.active--;
+        }
+        break;
+    default:
+        break;
+    }
+    return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static const struct lws_protocols g_protocols[] = {
+    {"mock-upstream", callback_mock, sizeof(mock_session_t), 0, 0, NULL, 0},
+    LWS_PROTOCOL_LIST_TERM,
+};
+
+static void sigint_handler(int sig)
+{
+    g_interrupted = 1;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "用法: %s [选项]\n"
+            "  -p, --port <端口>                 监听端口 (默认 %d)\n"
+            "      --latency [接口=]<分布>       注入延迟，分布为 fixed:<毫秒> | uniform:<最小>:<最大> |\n"
+            "                                    exp:<均值> | lognormal:<中位数>:<sigma> (默认 fixed:0)\n"
+            "      --error-rate [接口=]<0~1>     返回 500 的比例 (默认 0)\n"
+            "      --reset-rate [接口=]<0~1>     收到请求后直接断开的比例 (默认 0)\n"
+            "      --hang-rate [接口=]<0~1>      收到请求后不回复的比例 (默认 0)\n"
+            "      --payload-bytes [接口=]<字节> 响应体填充到至少该长度 (默认 0 不填充)\n"
+            "      --max-connections <数量>      同时保持的连接数上限，超出的新连接直接挂断 (默认 0 不限)\n"
+            "      --no-keepalive                每个响应后关闭连接\n"
+            "      --seed <整数>                 随机数种子 (默认 %lu)\n"
+            "  -h, --help                        显示帮助\n"
+            "接口为 /song/url、/search/lyric 或 /lyric，省略时对所有接口生效；可重复指定\n",
+            prog, g_opt.port, g_opt.seed);
+}
+
+// 拆出可选的 "接口=" 前缀，返回接口序号，-1 表示所有接口，-2 表示接口不存在
+static int split_endpoint(char **arg)
+{
+    if ((*arg)[0] != '/')
+        return -1;
+    char *eq = strchr(*arg, '=');
+    if (!eq)
+        return -2;
+    *eq = '\0';
+    for (int i = 0; i < MOCK_ENDPOINT_MAX; i++)
+    {
+        if (!strcmp(*arg, g_paths[i]))
+        {
+            *arg = eq + 1;
+            return i;
+        }
+    }
+    return -2;
+}
+
+static int parse_latency(const char *spec, mock_latency_t *latency)
+{
+    static const char *names[] = {"fixed", "uniform", "exp", "lognormal"};
+    char name[16] = {0};
+    double a = 0, b = 0;
+    int n = sscanf(spec, "%15[a-z]:%lf:%lf", name, &a, &b);
+    if (n < 1)
+    {
+        // 只给数字时视为固定延迟
+        if (sscanf(spec, "%lf", &a) != 1 || a < 0)
+            return -1;
+        *latency = (mock_latency_t){MOCK_DIST_FIXED, a, 0};
+        return 0;
+    }
+    int dist = 0;
+    while (dist < 4 && strcmp(name, names[dist]))
+        dist++;
+    if (dist == 4 || a < 0 || b < 0 || n != (dist == MOCK_DIST_UNIFORM || dist == MOCK_DIST_LOGNORMAL ? 3 : 2) ||
+        (dist == MOCK_DIST_UNIFORM && b < a))
+        return -1;
+    *latency = (mock_latency_t){dist, a, b};
+    return 0;
+}
+
+// 解析按接口生效的选项
+static int parse_behavior(int opt, char *arg)
+{
+    int endpoint = split_endpoint(&arg);
+    if (endpoint == -2)
+        return -1;
+    mock_behavior_t value = endpoint < 0 ? g_opt.behavior[0] : g_opt.behavior[endpoint];
+    switch (opt)
+    {
+    case 0:
+        if (parse_latency(arg, &value.latency) < 0)
+            return -1;
+        break;
+    case 1:
+    case 2:
+    case 3:
+    {
+        double rate = atof(arg);
+        if (rate < 0 || rate > 1)
+            return -1;
+        *(opt == 1 ? &value.error_rate : opt == 2 ? &value.reset_rate : &value.hang_rate) = rate;
+        break;
+    }
+    default:
+        if (atol(arg) < 0)
+            return -1;
+        value.payload_bytes = (size_t)atol(arg);
+        break;
+    }
+    for (int i = 0; i < MOCK_ENDPOINT_MAX; i++)
+    {
+        if (endpoint >= 0 && i != endpoint)
+            continue;
+        mock_behavior_t *behavior = &g_opt.behavior[i];
+        switch (opt)
+        {
+        case 0:
+            behavior->latency = value.latency;
+            break;
+        case 1:
+            behavior->error_rate = value.error_rate;
+            break;
+        case 2:
+            behavior->reset_rate = value.reset_rate;
+            break;
+        case 3:
+            behavior->hang_rate = value.hang_rate;
+            break;
+        default:
+            behavior->payload_bytes = value.payload_bytes;
+            break;
+        }
+    }
+    return 0;
+}
+
+static int parse_args(int argc, char **argv)
+{
+    enum
+    {
+        OPT_LATENCY = 256,
+        OPT_ERROR_RATE,
+        OPT_RESET_RATE,
+        OPT_HANG_RATE,
+        OPT_PAYLOAD_BYTES,
+        OPT_MAX_CONNECTIONS,
+        OPT_NO_KEEPALIVE,
+        OPT_SEED,
+    };
+    static const struct option long_options[] = {
+        {"port", required_argument, NULL, 'p'},
+        {"latency", required_argument, NULL, OPT_LATENCY},
+        {"error-rate", required_argument, NULL, OPT_ERROR_RATE},
+        {"reset-rate", required_argument, NULL, OPT_RESET_RATE},
+        {"hang-rate", required_argument, NULL, OPT_HANG_RATE},
+        {"payload-bytes", required_argument, NULL, OPT_PAYLOAD_BYTES},
+        {"max-connections", required_argument, NULL, OPT_MAX_CONNECTIONS},
+        {"no-keepalive", no_argument, NULL, OPT_NO_KEEPALIVE},
+        {"seed", required_argument, NULL, OPT_SEED},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            g_opt.port = atoi(optarg);
+            break;
+        case OPT_LATENCY:
+        case OPT_ERROR_RATE:
+        case OPT_RESET_RATE:
+        case OPT_HANG_RATE:
+        case OPT_PAYLOAD_BYTES:
+            if (parse_behavior(opt - OPT_LATENCY, optarg) < 0)
+            {
+                print_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case OPT_MAX_CONNECTIONS:
+            g_opt.max_connections = atoi(optarg);
+            break;
+        case OPT_NO_KEEPALIVE:
+            g_opt.keepalive = 0;
+            break;
+        case OPT_SEED:
+            g_opt.seed = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    for (int i = 0; i < MOCK_ENDPOINT_MAX; i++)
+    {
+        const mock_behavior_t *behavior = &g_opt.behavior[i];
+        if (behavior->error_rate + behavior->reset_rate + behavior->hang_rate > 1)
+        {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    if (g_opt.port <= 0 || g_opt.max_connections < 0)
+    {
+        print_usage(argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+static void print_report(void)
+{
+    double elapsed = (lws_now_usecs() - g_start_us) / (double)LWS_US_PER_SEC;
+    printf("{\n");
+    printf("  \"config\": {\"port\": %d, \"max_connections\": %d, \"keepalive\": %s, \"seed\": %lu},\n",
+           g_opt.port, g_opt.max_connections, g_opt.keepalive ? "true" : "false", g_opt.seed);
+    printf("  \"uptime_s\": %.3f,\n", elapsed);
+    printf("  \"connections\": {\"accepted\": %lu, \"rejected\": %lu, \"peak\": %d},\n",
+           g_stats.accepted, g_stats.rejected, g_stats.peak);
+    printf("  \"endpoints\": {\n");
+    for (int i = 0; i < MOCK_ENDPOINT_MAX; i++)
+    {
+        const mock_endpoint_stats_t *stats = &g_stats.endpoints[i];
+        printf("    \"%s\": {\"requests\": %lu, \"ok\": %lu, \"errors\": %lu, \"resets\": %lu, \"hangs\": %lu, "
+               "\"bytes\": %lu, \"delay_ms_avg\": %.3f, \"delay_ms_max\": %.3f}%s\n",
+               g_paths[i], stats->requests, stats->ok, stats->errors, stats->resets, stats->hangs, stats->bytes,
+               stats->requests ? stats->delay_ms_sum / stats->requests : 0, stats->delay_ms_max,
+               i + 1 < MOCK_ENDPOINT_MAX ? "," : "");
+    }
+    printf("  }\n}\n");
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    if (parse_args(argc, argv) < 0)
+        return 1;
+    g_rng = g_opt.seed ? g_opt.seed : 1;
+
+    lws_set_log_level(LLL_ERR, NULL);
+    struct lws_context_creation_info info;
+    memset(&info, 0, sizeof(info));
+    info.port = g_opt.port;
+    info.protocols = g_protocols;
+    g_start_us = lws_now_usecs();
+    struct lws_context *context = lws_create_context(&info);
+    if (!context)
+    {
+        fprintf(stderr, "创建上下文失败\n");
+        return 1;
+    }
+    signal(SIGINT, sigint_handler);
+    signal(SIGTERM, sigint_handler);
+    fprintf(stderr, "mock upstream 监听 http://127.0.0.1:%d\n", g_opt.port);
+
+    while (!g_interrupted)
+        lws_service(context, 0);
+
+    print_report();
+    lws_context_destroy(context);
+    return 0;
+}
@@ -0,0 +1,579 @@
+#include <libwebsockets.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+
+// WebSocket 负载生成器：开 rooms × clients 个连接（roomid / userid 查询参数与真实客户端相同），
+// 每个连接按配置的比例发送心跳、GET_PLAYLIST、ADD/REMOVE_SONG、PLAY_NEXT_SONG 和暂停/继续，
+// 结束时以 JSON 输出建连速率、消息速率、字节速率和房间广播的端到端延迟分位数。
+// 广播延迟：添加/删除的歌曲 songhash 中编码了房间号和序号，发送时记下时间，
+// 每个成员收到对应的播放列表增量消息时记一个样本（同一进程同一单调时钟）。
+// 用法：ws_loadgen [选项]，--help 查看
+
+#define LG_PENDING 256 // 每个房间记录发送时间的歌曲数（按序号取模）
+#define LG_TICK_US (10 * LWS_US_PER_MS)
+
+enum lg_op
+{
+    LG_OP_HEARTBEAT,
+    LG_OP_PLAYLIST,
+    LG_OP_ADD_SONG, // 房间内歌曲数达到上限时改为删除最早添加的一首
+    LG_OP_PLAY_NEXT,
+    LG_OP_PAUSE, // 暂停和继续交替
+    LG_OP_MAX
+};
+
+static const char *g_op_names[LG_OP_MAX] = {"heartbeat", "playlist", "add", "next", "pause"};
+
+enum lg_state
+{
+    LG_IDLE,
+    LG_CONNECTING,
+    LG_OPEN,
+    LG_CLOSED
+};
+
+typedef struct lg_client
+{
+    struct lws *wsi;
+    int room;
+    char userid[32];
+    char state;            // enum lg_state
+    char paused;           // 下一次暂停操作发送继续
+    lws_usec_t connect_us; // 发起连接的时间
+    lws_usec_t next_op_us; // 下一次操作的时间
+    size_t out_len;        // 待发送的消息长度，0 表示没有
+    unsigned char out[LWS_PRE + 512];
+} lg_client_t;
+
+typedef struct lg_room
+{
+    unsigned int added;   // 已添加的歌曲数（下一首的序号）
+    unsigned int removed; // 已删除的歌曲数（最早一首还在列表中的序号）
+    unsigned int insert_seq[LG_PENDING];
+    unsigned int remove_seq[LG_PENDING];
+    lws_usec_t insert_us[LG_PENDING];
+    lws_usec_t remove_us[LG_PENDING];
+} lg_room_t;
+
+// 延迟样本（微秒）
+typedef struct lg_samples
+{
+    unsigned int *values;
+    size_t len;
+    size_t cap;
+} lg_samples_t;
+
+static struct
+{
+    const char *host;
+    int port;
+    int rooms;
+    int clients;        // 每个房间的连接数
+    int duration_s;     // 全部连接建立后的压测时长
+    double rate;        // 每个连接每秒的操作数
+    int ramp;           // 每秒最多发起的连接数
+    int playlist_cap;   // 每个房间最多保留的压测歌曲数
+    int deflate;        // 协商 permessage-deflate
+    int mix[LG_OP_MAX]; // 各操作的权重
+} g_opt = {"127.0.0.1", 3375, 10, 20, 30, 1.0, 500, 50, 0, {50, 20, 15, 5, 10}};
+
+static struct
+{
+    unsigned long attempted;
+    unsigned long established;
+    unsigned long failed;
+    unsigned long closed;
+    unsigned long sent;
+    unsigned long received;
+    unsigned long bytes_sent;
+    unsigned long bytes_received;
+    unsigned long ops[LG_OP_MAX];
+    unsigned long deferred; // 上一条还没写出，推迟的操作数
+} g_stats;
+
+static struct lws_context *g_context;
+static lg_client_t *g_clients;
+static lg_room_t *g_rooms;
+static int g_total;
+static int g_next_connect;
+static int g_mix_total;
+static lws_usec_t g_start_us;    // 开始发起连接
+static lws_usec_t g_ready_us;    // 全部连接建立（或失败）
+static lws_usec_t g_end_us;      // 压测结束
+static lg_samples_t g_broadcast; // 广播延迟
+static lg_samples_t g_connect;   // 建连耗时
+static lws_sorted_usec_list_t g_tick;
+static volatile int g_interrupted;
+
+static void samples_add(lg_samples_t *samples, lws_usec_t us)
+{
+    if (samples->len == samples->cap)
+    {
+        size_t cap = samples->cap ? samples->cap * 2 : 4096;
+        unsigned int *values = (unsigned int *)realloc(samples->values, cap * sizeof(unsigned int));
+        if (!values)
+            return;
+        samples->values = values;
+        samples->cap = cap;
+    }
+    samples->values[samples->len++] = us > 0 ? (unsigned int)us : 0;
+}
+
+static int cmp_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 已排序样本的分位数（毫秒）
+static double samples_ms(const lg_samples_t *samples, double q)
+{
+    if (!samples->len)
+        return 0;
+    size_t i = (size_t)(q * (samples->len - 1) + 0.5);
+    return samples->values[i] / 1000.0;
+}
+
+// 按权重随机选一个操作
+static enum lg_op pick_op(void)
+{
+    int r = rand() % g_mix_total;
+    for (int i = 0; i < LG_OP_MAX; i++)
+    {
+        if (r < g_opt.mix[i])
+            return (enum lg_op)i;
+        r -= g_opt.mix[i];
+    }
+    return LG_OP_HEARTBEAT;
+}
+
+// 下一次操作的时间：按平均速率均匀抖动，避免所有连接同时发送
+static lws_usec_t next_op_after(lws_usec_t now)
+{
+    if (g_opt.rate <= 0)
+        return now + 3600 * LWS_US_PER_SEC;
+    lws_usec_t mean = (lws_usec_t)(LWS_US_PER_SEC / g_opt.rate);
+    return now + mean / 2 + rand() % (mean + 1);
+}
+
+// 压测歌曲的 songhash：LG + 房间号 + 序号
+static void song_hash(char *out, size_t size, int room, unsigned int seq)
+{
+    snprintf(out, size, "LG%04X%08X", (unsigned int)room, seq);
+}
+
+// 生成一次操作的消息，返回长度
+static int build_op(lg_client_t *client, enum lg_op op, lws_usec_t now)
+{
+    char *out = (char *)client->out + LWS_PRE;
+    size_t size = sizeof(client->out) - LWS_PRE;
+    lg_room_t *room = &g_rooms[client->room];
+    char hash[32];
+    switch (op)
+    {
+    case LG_OP_HEARTBEAT:
+        return snprintf(out, size, "{\"type\":\"heartbeat\"}");
+    case LG_OP_PLAYLIST:
+        return snprintf(out, size, "{\"userid\":\"%s\",\"action\":%d}", client->userid, GET_PLAYLIST);
+    case LG_OP_ADD_SONG:
+        if (room->added - room->removed >= (unsigned int)g_opt.playlist_cap)
+        {
+            unsigned int seq = room->removed++;
+            song_hash(hash, sizeof(hash), client->room, seq);
+            room->remove_seq[seq % LG_PENDING] = seq;
+            room->remove_us[seq % LG_PENDING] = now;
+            return snprintf(out, size, "{\"userid\":\"%s\",\"action\":%d,\"params\":{\"songhash\":\"%s\"}}",
+                            client->userid, REMOVE_SONG_FROM_PLAYLIST, hash);
+        }
+        else
+        {
+            unsigned int seq = room->added++;
+            song_hash(hash, sizeof(hash), client->room, seq);
+            room->insert_seq[seq % LG_PENDING] = seq;
+            room->insert_us[seq % LG_PENDING] = now;
+            return snprintf(out, size,
+                            "{\"userid\":\"%s\",\"action\":%d,\"params\":{\"songname\":\"压测 %u\",\"songhash\":\"%s\","
+                            "\"singername\":\"ws_loadgen\",\"albumname\":\"bench\",\"duration\":\"240\","
+                            "\"coverurl\":\"http://127.0.0.1/cover.jpg\"}}",
+                            client->userid, ADD_SONG_TO_PLAYLIST, seq, hash);
+        }
+    case LG_OP_PLAY_NEXT:
+        return snprintf(out, size, "{\"userid\":\"%s\",\"action\":%d}", client->userid, PLAY_NEXT_SONG);
+    case LG_OP_PAUSE:
+        client->paused = !client->paused;
+        return snprintf(out, size, "{\"userid\":\"%s\",\"action\":%d}", client->userid,
+                        client->paused ? PAUSE_SONG : RESUME_SONG);
+    default:
+        return 0;
+    }
+}
+
+// 播放列表增量消息：找到压测歌曲的 songhash，记一个广播延迟样本
+static void on_playlist_delta(const char *msg, lws_usec_t now)
+{
+    int insert = strstr(msg, "\"op\":\"insert\"") != NULL;
+    if (!insert && !strstr(msg, "\"op\":\"remove\""))
+        return;
+    const char *p = strstr(msg, "\"songhash\":\"LG");
+    unsigned int room = 0, seq = 0;
+    if (!p || sscanf(p + 14, "%4X%8X", &room, &seq) != 2 || room >= (unsigned int)g_opt.rooms)
+        return;
+    lg_room_t *r = &g_rooms[room];
+    unsigned int slot = seq % LG_PENDING;
+    if (insert && r->insert_seq[slot] == seq && r->insert_us[slot])
+        samples_add(&g_broadcast, now - r->insert_us[slot]);
+    else if (!insert && r->remove_seq[slot] == seq && r->remove_us[slot])
+        samples_add(&g_broadcast, now - r->remove_us[slot]);
+}
+
+static void start_connect(lg_client_t *client, lws_usec_t now)
+{
+    char path[128];
+    struct lws_client_connect_info info;
+    snprintf(path, sizeof(path), "/?roomid=lg%d&userid=%s", client->room, client->userid);
+    memset(&info, 0, sizeof(info));
+    info.context = g_context;
+    info.address = g_opt.host;
+    info.port = g_opt.port;
+    info.path = path;
+    info.host = g_opt.host;
+    info.origin = g_opt.host;
+    info.protocol = "ctrl-protocol";
+    info.ietf_version_or_minus_one = -1;
+    info.opaque_user_data = client;
+    info.pwsi = &client->wsi;
+    client->state = LG_CONNECTING;
+    client->connect_us = now;
+    g_stats.attempted++;
+    if (!lws_client_connect_via_info(&info))
+    {
+        client->state = LG_CLOSED;
+        g_stats.failed++;
+    }
+}
+
+// 每 10ms：按速率发起新连接，给到期的连接安排下一次操作，压测时间到后结束
+static void tick(lws_sorted_usec_list_t *sul)
+{
+    lws_usec_t now = lws_now_usecs();
+    int allowed = g_opt.ramp > 0 ? (int)((now - g_start_us) * g_opt.ramp / LWS_US_PER_SEC) + 1 : g_total;
+    while (g_next_connect < g_total && g_next_connect < allowed)
+        start_connect(&g_clients[g_next_connect++], now);
+
+    if (!g_ready_us && g_next_connect == g_total && g_stats.established + g_stats.failed >= (unsigned long)g_total)
+    {
+        g_ready_us = now;
+        g_end_us = now + (lws_usec_t)g_opt.duration_s * LWS_US_PER_SEC;
+        fprintf(stderr, "%lu 个连接已建立（失败 %lu），开始压测 %d 秒\n", g_stats.established, g_stats.failed,
+                g_opt.duration_s);
+    }
+    if (g_ready_us && now >= g_end_us)
+    {
+        g_interrupted = 1;
+        lws_cancel_service(g_context);
+        return;
+    }
+
+    for (int i = 0; g_ready_us && i < g_total; i++)
+    {
+        lg_client_t *client = &g_clients[i];
+        if (client->state != LG_OPEN || now < client->next_op_us)
+            continue;
+        client->next_op_us = next_op_after(now);
+        if (client->out_len)
+        {
+            g_stats.deferred++;
+            continue;
+        }
+        enum lg_op op = pick_op();
+        int len = build_op(client, op, now);
+        if (len <= 0 || (size_t)len >= sizeof(client->out) - LWS_PRE)
+            continue;
+        client->out_len = (size_t)len;
+        g_stats.ops[op]++;
+        lws_callback_on_writable(client->wsi);
+    }
+    lws_sul_schedule(g_context, 0, sul, tick, LG_TICK_US);
+}
+
+static int callback_loadgen(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len)
+{
+    lg_client_t *client = (lg_client_t *)lws_get_opaque_user_data(wsi);
+    lws_usec_t now = lws_now_usecs();
+    switch (reason)
+    {
+    case LWS_CALLBACK_CLIENT_ESTABLISHED:
+        if (!client)
+            break;
+        client->state = LG_OPEN;
+        client->next_op_us = next_op_after(now);
+        g_stats.established++;
+        samples_add(&g_connect, now - client->connect_us);
+        break;
+    case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+        fprintf(stderr, "连接失败: %s\n", in ? (const char *)in : "");
+        if (client)
+        {
+            client->state = LG_CLOSED;
+            client->wsi = NULL;
+            g_stats.failed++;
+        }
+        break;
+    case LWS_CALLBACK_CLIENT_CLOSED:
+        if (client)
+        {
+            client->state = LG_CLOSED;
+            client->wsi = NULL;
+            g_stats.closed++;
+        }
+        break;
+    case LWS_CALLBACK_CLIENT_RECEIVE:
+        g_stats.bytes_received += len;
+        if (!lws_is_final_fragment(wsi))
+            break;
+        g_stats.received++;
+        // 增量消息都很短，只在单个分片的消息里找
+        if (lws_is_first_fragment(wsi) && len < 1024 && in)
+        {
+            char msg[1024];
+            memcpy(msg, in, len);
+            msg[len] = '\0';
+            if (strstr(msg, "\"op\":"))
+                on_playlist_delta(msg, now);
+        }
+        break;
+    case LWS_CALLBACK_CLIENT_WRITEABLE:
+        if (!client || !client->out_len)
+            break;
+        if (lws_write(wsi, client->out + LWS_PRE, client->out_len, LWS_WRITE_TEXT) < 0)
+            return -1;
+        g_stats.sent++;
+        g_stats.bytes_sent += client->out_len;
+        client->out_len = 0;
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+static const struct lws_protocols g_protocols[] = {
+    {"ctrl-protocol", callback_loadgen, 0, 4096},
+    {NULL, NULL, 0, 0},
+};
+
+static const struct lws_extension g_extensions[] = {
+    {"permessage-deflate", lws_extension_callback_pm_deflate, "permessage-deflate; client_max_window_bits"},
+    {NULL, NULL, NULL},
+};
+
+static void sigint_handler(int sig)
+{
+    g_interrupted = 1;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "用法: %s [选项]\n"
+            "  -H, --host <地址>         服务器地址 (默认 %s)\n"
+            "  -p, --port <端口>         服务器端口 (默认 %d)\n"
+            "  -r, --rooms <数量>        房间数 (默认 %d)\n"
+            "  -c, --clients <数量>      每个房间的连接数 (默认 %d)\n"
+            "  -d, --duration <秒>       全部连接建立后的压测时长 (默认 %d)\n"
+            "      --rate <次/秒>        每个连接每秒的操作数 (默认 %.1f)\n"
+            "      --ramp <个/秒>        每秒最多发起的连接数 (默认 %d, 0 不限)\n"
+            "      --playlist-cap <首>   每个房间最多保留的压测歌曲数 (默认 %d)\n"
+            "      --mix <操作=权重,...> 操作比例，操作为 heartbeat/playlist/add/next/pause\n"
+            "                            (默认 heartbeat=%d,playlist=%d,add=%d,next=%d,pause=%d)\n"
+            "      --deflate             协商 permessage-deflate\n"
+            "  -h, --help                显示帮助\n",
+            prog, g_opt.host, g_opt.port, g_opt.rooms, g_opt.clients, g_opt.duration_s, g_opt.rate, g_opt.ramp,
+            g_opt.playlist_cap, g_opt.mix[0], g_opt.mix[1], g_opt.mix[2], g_opt.mix[3], g_opt.mix[4]);
+}
+
+// 解析 --mix，未列出的操作权重为 0
+static int parse_mix(char *arg)
+{
+    memset(g_opt.mix, 0, sizeof(g_opt.mix));
+    for (char *save = NULL, *item = strtok_r(arg, ",", &save); item; item = strtok_r(NULL, ",", &save))
+    {
+        char *eq = strchr(item, '=');
+        if (!eq)
+            return -1;
+        *eq = '\0';
+        int i = 0;
+        while (i < LG_OP_MAX && strcmp(item, g_op_names[i]))
+            i++;
+        if (i == LG_OP_MAX || atoi(eq + 1) < 0)
+            return -1;
+        g_opt.mix[i] = atoi(eq + 1);
+    }
+    return 0;
+}
+
+static int parse_args(int argc, char **argv)
+{
+    enum
+    {
+        OPT_RATE = 256,
+        OPT_RAMP,
+        OPT_PLAYLIST_CAP,
+        OPT_MIX,
+        OPT_DEFLATE,
+    };
+    static const struct option long_options[] = {
+        {"host", required_argument, NULL, 'H'},
+        {"port", required_argument, NULL, 'p'},
+        {"rooms", required_argument, NULL, 'r'},
+        {"clients", required_argument, NULL, 'c'},
+        {"duration", required_argument, NULL, 'd'},
+        {"rate", required_argument, NULL, OPT_RATE},
+        {"ramp", required_argument, NULL, OPT_RAMP},
+        {"playlist-cap", required_argument, NULL, OPT_PLAYLIST_CAP},
+        {"mix", required_argument, NULL, OPT_MIX},
+        {"deflate", no_argument, NULL, OPT_DEFLATE},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "H:p:r:c:d:h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'H':
+            g_opt.host = optarg;
+            break;
+        case 'p':
+            g_opt.port = atoi(optarg);
+            break;
+        case 'r':
+            g_opt.rooms = atoi(optarg);
+            break;
+        case 'c':
+            g_opt.clients = atoi(optarg);
+            break;
+        case 'd':
+            g_opt.duration_s = atoi(optarg);
+            break;
+        case OPT_RATE:
+            g_opt.rate = atof(optarg);
+            break;
+        case OPT_RAMP:
+            g_opt.ramp = atoi(optarg);
+            break;
+        case OPT_PLAYLIST_CAP:
+            g_opt.playlist_cap = atoi(optarg);
+            break;
+        case OPT_MIX:
+            if (parse_mix(optarg) < 0)
+            {
+                print_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case OPT_DEFLATE:
+            g_opt.deflate = 1;
+            break;
+        default:
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    g_mix_total = 0;
+    for (int i = 0; i < LG_OP_MAX; i++)
+        g_mix_total += g_opt.mix[i];
+    if (g_opt.port <= 0 || g_opt.rooms <= 0 || g_opt.clients <= 0 || g_opt.duration_s <= 0 || g_opt.rate < 0 ||
+        g_opt.ramp < 0 || g_opt.playlist_cap <= 0 || g_mix_total <= 0 || g_opt.rooms > 0xFFFF)
+    {
+        print_usage(argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+static void print_report(void)
+{
+    lws_usec_t end = lws_now_usecs();
+    double connect_s = ((g_ready_us ? g_ready_us : end) - g_start_us) / 1e6;
+    double run_s = g_ready_us ? (end - g_ready_us) / 1e6 : 0;
+    qsort(g_broadcast.values, g_broadcast.len, sizeof(unsigned int), cmp_uint);
+    qsort(g_connect.values, g_connect.len, sizeof(unsigned int), cmp_uint);
+
+    printf("{\n  \"config\": {\"host\": \"%s\", \"port\": %d, \"rooms\": %d, \"clients_per_room\": %d, "
+           "\"duration_s\": %d, \"rate_per_client\": %.3f, \"deflate\": %s, \"mix\": {",
+           g_opt.host, g_opt.port, g_opt.rooms, g_opt.clients, g_opt.duration_s, g_opt.rate,
+           g_opt.deflate ? "true" : "false");
+    for (int i = 0; i < LG_OP_MAX; i++)
+        printf("%s\"%s\": %d", i ? ", " : "", g_op_names[i], g_opt.mix[i]);
+    printf("}},\n");
+    printf("  \"connections\": {\"attempted\": %lu, \"established\": %lu, \"failed\": %lu, \"closed\": %lu, "
+           "\"per_sec\": %.1f, \"connect_ms_p50\": %.3f, \"connect_ms_p99\": %.3f},\n",
+           g_stats.attempted, g_stats.established, g_stats.failed, g_stats.closed,
+           connect_s > 0 ? g_stats.established / connect_s : 0, samples_ms(&g_connect, 0.5), samples_ms(&g_connect, 0.99));
+    printf("  \"messages\": {\"run_s\": %.3f, \"sent\": %lu, \"received\": %lu, \"sent_per_sec\": %.1f, "
+           "\"received_per_sec\": %.1f, \"bytes_sent\": %lu, \"bytes_received\": %lu, \"bytes_sent_per_sec\": %.1f, "
+           "\"bytes_received_per_sec\": %.1f, \"deferred\": %lu, \"ops\": {",
+           run_s, g_stats.sent, g_stats.received, run_s > 0 ? g_stats.sent / run_s : 0,
+           run_s > 0 ? g_stats.received / run_s : 0, g_stats.bytes_sent, g_stats.bytes_received,
+           run_s > 0 ? g_stats.bytes_sent / run_s : 0, run_s > 0 ? g_stats.bytes_received / run_s : 0, g_stats.deferred);
+    for (int i = 0; i < LG_OP_MAX; i++)
+        printf("%s\"%s\": %lu", i ? ", " : "", g_op_names[i], g_stats.ops[i]);
+    printf("}},\n");
+    printf("  \"broadcast_latency_ms\": {\"samples\": %zu, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"p999\": %.3f, "
+           "\"max\": %.3f}\n}\n",
+           g_broadcast.len, samples_ms(&g_broadcast, 0.5), samples_ms(&g_broadcast, 0.9), samples_ms(&g_broadcast, 0.99),
+           samples_ms(&g_broadcast, 0.999), samples_ms(&g_broadcast, 1.0));
+}
+
+int main(int argc, char **argv)
+{
+    if (parse_args(argc, argv) < 0)
+        return 1;
+    g_total = g_opt.rooms * g_opt.clients;
+    g_clients = (lg_client_t *)calloc((size_t)g_total, sizeof(lg_client_t));
+    g_rooms = (lg_room_t *)calloc((size_t)g_opt.rooms, sizeof(lg_room_t));
+    if (!g_clients || !g_rooms)
+    {
+        fprintf(stderr, "内存不足\n");
+        return 1;
+    }
+    for (int i = 0; i < g_total; i++)
+    {
+        g_clients[i].room = i / g_opt.clients;
+        snprintf(g_clients[i].userid, sizeof(g_clients[i].userid), "lg%d-%d", i / g_opt.clients, i % g_opt.clients);
+    }
+
+    lws_set_log_level(LLL_ERR, NULL);
+    struct lws_context_creation_info info;
+    memset(&info, 0, sizeof(info));
+    info.port = CONTEXT_PORT_NO_LISTEN;
+    info.protocols = g_protocols;
+    info.fd_limit_per_thread = (unsigned int)g_total + 64;
+    if (g_opt.deflate)
+        info.extensions = g_extensions;
+    g_context = lws_create_context(&info);
+    if (!g_context)
+    {
+        fprintf(stderr, "创建上下文失败\n");
+        return 1;
+    }
+    signal(SIGINT, sigint_handler);
+
+    g_start_us = lws_now_usecs();
+    lws_sul_schedule(g_context, 0, &g_tick, tick, 1);
+    while (!g_interrupted)
+        lws_service(g_context, 0);
+
+    print_report();
+    lws_context_destroy(g_context);
+    free(g_clients);
+    free(g_rooms);
+    free(g_broadcast.values);
+    free(g_connect.values);
+    return 0;
+}
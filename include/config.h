@@ -0,0 +1,39 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+#include <stddef.h>
+#include <libwebsockets.h>
+
+// 服务运行参数（命令行可覆盖）
+typedef struct server_config
+{
+    int port;                         // 监听端口
+    int threads;                      // lws 服务线程数，房间按 room_id 哈希分布到各线程
+    int workers;                      // 工作进程数，>1 时由路由进程按 room_id 哈希分配连接
+    double prefetch_threshold;        // 播放进度超过该值时预取下一首，>=1 表示关闭
+    int progress_interval_ms;         // 播放进度广播间隔
+    int progress_default;             // 新连接默认订阅周期性进度广播
+    size_t song_cache_max_bytes;      // 歌曲/歌词 url 缓存内存上限
+    lws_usec_t song_url_ttl_us;       // 歌曲 url 缓存有效期（带签名，会过期）
+    lws_usec_t lyrics_url_ttl_us;     // 歌词 url 缓存有效期
+    lws_usec_t stale_grace_us;        // 上游失败时仍可应答的过期缓存的最大过期时长
+    unsigned int action_log_capacity; // 每个房间保留的操作记录条数
+    int presence_window_ms;           // 成员加入/离开的合并广播窗口，0 表示立即广播
+    size_t max_message_bytes;         // 单条入站消息（拼接分片后）的长度上限
+    int deflate_level;                // permessage-deflate 压缩级别 1~9，0 表示不协商压缩
+    const char *latency_dump_path;    // 周期性写出命令延迟统计的文件，NULL 表示不写
+    int latency_dump_interval_s;      // 写出间隔，0 表示只在退出时写
+    const char *upstream_url;         // 上游音乐 API 地址（scheme://host:port，不带结尾的 /）
+    int upstream_max_connections;     // 到上游的并发连接数上限（也是空闲连接缓存大小），0 表示不限
+    int upstream_http2;               // 与上游协商 HTTP/2，多个请求复用同一连接
+    int song_url_timeout_ms;          // 歌曲 url 查询的截止时间
+    int lyrics_url_timeout_ms;        // 歌词查询的截止时间
+    int breaker_failures;             // 连续失败多少次后熔断该接口，0 表示不熔断
+    int breaker_cooldown_ms;          // 熔断后多久放行一个探测请求
+    int upstream_hedge;               // 请求超过近期 p95 耗时仍未完成时再发一个对冲请求
+} server_config_t;
+
+extern server_config_t g_config;
+
+int parse_config(int argc, char **argv);
+
+#endif // CONFIG_H
@@ -0,0 +1,59 @@
+#ifndef CTRL_PARSER_H
+#define CTRL_PARSER_H
+#include <stddef.h>
+#include "cJSON.h"
+
+// 控制消息中的字符串字段
+enum ctrl_field
+{
+    CTRL_FIELD_USERID,
+    CTRL_FIELD_TYPE,
+    CTRL_FIELD_SONGNAME, // 以下为 params 中的字段
+    CTRL_FIELD_SONGHASH,
+    CTRL_FIELD_SINGERNAME,
+    CTRL_FIELD_ALBUMNAME,
+    CTRL_FIELD_DURATION,
+    CTRL_FIELD_COVERURL,
+    CTRL_FIELD_BEFOREHASH,
+    CTRL_FIELD_MAX
+};
+
+// 控制消息中出现的非字符串字段
+#define CTRL_HAS_ACTION (1u << 0)
+#define CTRL_HAS_T0 (1u << 1)
+#define CTRL_HAS_PARAMS (1u << 2) // params 是对象
+#define CTRL_HAS_ENABLE (1u << 3)
+#define CTRL_HAS_OFFSET (1u << 4)
+#define CTRL_HAS_LIMIT (1u << 5)
+
+#define CTRL_MSG_STRINGS 2048 // 字符串字段解码后的总容量
+
+// 解析后的控制消息：只保留固定命令格式中用到的字段，字符串解码后存放在 strings 中
+typedef struct ctrl_msg
+{
+    unsigned int flags;             // CTRL_HAS_*
+    int action;                     // 与 cJSON valueint 相同的取整规则
+    double t0;                      // 时钟同步的客户端发送时间
+    int enable;                     // params.enable（true/false 或数字）
+    int offset;                     // params.offset
+    int limit;                      // params.limit
+    short str_off[CTRL_FIELD_MAX];  // 字符串在 strings 中的偏移，-1 表示不存在
+    size_t used;                    // strings 已用字节数（须为最后一个定长成员）
+    char strings[CTRL_MSG_STRINGS]; // 字符串存储区，拷贝消息时只需拷贝到 used 为止
+} ctrl_msg_t;
+
+// ctrl_msg_t 中实际使用的字节数
+#define CTRL_MSG_SIZE(msg) (offsetof(ctrl_msg_t, strings) + (msg)->used)
+
+void ctrl_msg_reset(ctrl_msg_t *msg);
+int ctrl_msg_put_string(ctrl_msg_t *msg, enum ctrl_field field, const char *str, size_t len);
+int ctrl_parse(const char *in, size_t len, ctrl_msg_t *msg);
+int ctrl_msg_from_json(const cJSON *root, ctrl_msg_t *msg);
+
+// 取字符串字段，不存在时返回 NULL
+static inline const char *ctrl_msg_str(const ctrl_msg_t *msg, enum ctrl_field field)
+{
+    return msg->str_off[field] < 0 ? NULL : msg->strings + msg->str_off[field];
+}
+
+#endif // CTRL_PARSER_H
@@ -0,0 +1,71 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+#include <libwebsockets.h>
+#include "types.h"
+
+// 按 action 的命令延迟：从 LWS_CALLBACK_RECEIVE 收到命令，到它产生的所有消息被每个接收者的
+// LWS_CALLBACK_SERVER_WRITEABLE 写完为止，按阶段记录到对数线性（HDR 风格）直方图。
+// 一条命令对应一个 trace，命令产生的每个消息缓冲区持有一份引用，最后一份释放时记录各阶段耗时。
+
+// 阶段（单调时钟，微秒）
+enum latency_stage
+{
+    LATENCY_PARSE,     // 收到完整消息到解码完成
+    LATENCY_HANDLER,   // 解码完成到处理结束，含投递到房间线程的排队，不含上游等待和序列化
+    LATENCY_UPSTREAM,  // 等待歌曲 url 查询（缓存或上游），只有等待过的命令才记录
+    LATENCY_SERIALIZE, // 生成回复和广播消息
+    LATENCY_FANOUT,    // 第一条消息入队到最后一个接收者写完
+    LATENCY_TOTAL,     // 收到到最后一个接收者写完
+    LATENCY_STAGE_MAX
+};
+
+// 每 2 的幂区间分 16 档（相对误差不超过 1/16），最大记录到 2^32 微秒（约 71 分钟），更大的值计入最后一档
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB_COUNT (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BITS 32
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) * LATENCY_SUB_COUNT)
+
+typedef struct latency_hist
+{
+    unsigned long count; // 只在汇总时由各档累加得到
+    unsigned long sum_us;
+    unsigned long max_us;
+    unsigned int buckets[LATENCY_BUCKETS];
+} latency_hist_t;
+
+// 一条命令的计时，处理阶段只在房间所属线程修改，最后一份引用释放后汇总
+typedef struct latency_trace
+{
+    int refcount;                           // 命令本身、产生的消息缓冲区、等待中的上游查询各持有一份
+    int action;                             // enum ctrl
+    char waited;                            // 异步等待过上游
+    lws_usec_t recv_us;                     // 收到消息
+    lws_usec_t mark_us;                     // 当前处理片段的开始时间
+    lws_usec_t fanout_us;                   // 第一条消息入队，0 表示还没有产生消息
+    lws_usec_t stage_us[LATENCY_STAGE_MAX]; // 各阶段累计耗时
+} latency_trace_t;
+
+extern __thread latency_trace_t *t_latency;
+
+latency_trace_t *latency_trace_new(int action, lws_usec_t recv_us);
+void latency_trace_unref(latency_trace_t *trace);
+latency_trace_t *latency_enter(latency_trace_t *trace);
+void latency_leave(latency_trace_t *prev);
+latency_trace_t *latency_hold(lws_usec_t *wait_us);
+latency_trace_t *latency_resume(latency_trace_t *trace, lws_usec_t wait_us);
+void latency_attach(msg_buf_t *buf);
+void latency_serialize_end(lws_usec_t start_us);
+
+int latency_collect(int slot, latency_hist_t out[LATENCY_STAGE_MAX]);
+unsigned long latency_percentile(const latency_hist_t *hist, double q);
+const char *latency_stage_name(enum latency_stage stage);
+const char *get_latency_stats_json(enum ctrl cmd);
+int latency_dump(const char *path);
+
+// 序列化计时的起点，没有正在处理的命令时返回 0，对应的 latency_serialize_end 不做任何事
+static inline lws_usec_t latency_serialize_begin(void)
+{
+    return t_latency ? lws_now_usecs() : 0;
+}
+
+#endif // LATENCY_H
@@ -0,0 +1,91 @@
+#ifndef METRICS_H
+#define METRICS_H
+#include <libwebsockets.h>
+#include "types.h"
+#include "upstream.h"
+
+// 运行指标：热路径只累加当前线程自己的计数块（无锁、无原子读改写），
+// /metrics 被抓取时才遍历所有线程的计数块汇总，输出 Prometheus 文本格式。
+
+// 单调递增的计数器；部分成对的计数器在汇总时相减得到仪表值（如活跃连接数 = 建立 - 关闭）
+enum metric_counter
+{
+    METRIC_CONNECTIONS_OPENED,
+    METRIC_CONNECTIONS_CLOSED,
+    METRIC_ROOMS_CREATED,
+    METRIC_ROOMS_DESTROYED,
+    METRIC_BYTES_RECEIVED,
+    METRIC_BYTES_SENT,
+    METRIC_UPSTREAM_REQUESTS,
+    METRIC_UPSTREAM_ERRORS,
+    METRIC_UPSTREAM_CONNECTS,   // 到上游新建的连接数（其余请求复用了已有连接）
+    METRIC_QUEUE_PUSHED,        // 进入出站队列的消息数
+    METRIC_QUEUE_REMOVED,       // 离开出站队列的消息数（发送、合并、丢弃、清空）
+    METRIC_QUEUE_BYTES_PUSHED,  // 同上，按字节
+    METRIC_QUEUE_BYTES_REMOVED, //
+    METRIC_MSG_BUF_ALLOCATED,   // msg_buf 向系统申请的字节数
+    METRIC_MSG_BUF_FREED,       // msg_buf 归还系统的字节数
+    METRIC_MSG_BUF_POOLED,      // 放回线程池的字节数
+    METRIC_MSG_BUF_REUSED,      // 从线程池取出复用的字节数
+    METRIC_COUNTER_MAX
+};
+
+// 按 action 统计的消息槽位：0 为无 action（操作回复等），其后依次为 enum ctrl，最后是心跳和未知 action
+#define METRIC_ACTION_HEARTBEAT (-1) // 传给 metrics_message_in 表示心跳
+#define METRIC_ACTION_CTRL_COUNT (GET_LATENCY_STATS - GET_CUR_SONG_INFO + 1)
+#define METRIC_ACTION_SLOTS (METRIC_ACTION_CTRL_COUNT + 3)
+
+#define METRIC_FANOUT_BUCKETS 10   // 广播扇出人数直方图的桶数（不含 +Inf）
+#define METRIC_UPSTREAM_BUCKETS 12 // 上游请求耗时直方图的桶数（不含 +Inf）
+
+// 每个线程一份的计数块，只由所属线程写
+typedef struct metrics_block
+{
+    unsigned long counters[METRIC_COUNTER_MAX];
+    unsigned long messages_in[METRIC_ACTION_SLOTS];
+    unsigned long messages_out[METRIC_ACTION_SLOTS];
+    unsigned long fanout[METRIC_FANOUT_BUCKETS + 1]; // 各桶（非累计）计数，最后一个为 +Inf
+    unsigned long fanout_sum;
+    unsigned long upstream[UPSTREAM_ENDPOINT_MAX][METRIC_UPSTREAM_BUCKETS + 1]; // 按接口的耗时直方图，同上
+    unsigned long upstream_sum_us[UPSTREAM_ENDPOINT_MAX];
+    unsigned long upstream_errors[UPSTREAM_ENDPOINT_MAX];
+    struct metrics_block *next;
+} metrics_block_t;
+
+// 每个 /metrics 请求的会话数据（lws 按 per_session_data_size 分配）
+typedef struct metrics_session
+{
+    char *body; // 前面预留 LWS_PRE 字节
+    size_t len;
+} metrics_session_t;
+
+extern __thread metrics_block_t *t_metrics;
+metrics_block_t *metrics_thread_block(void);
+int metrics_action_slot(int action);
+const char *metrics_action_name(int slot);
+void metrics_message_in(int action);
+void metrics_message_out(int action);
+void metrics_fanout(unsigned int recipients);
+void metrics_upstream(enum upstream_endpoint endpoint, lws_usec_t elapsed_us, int ok);
+int callback_metrics(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len);
+
+// 当前线程的计数块（首次使用时登记）
+static inline metrics_block_t *metrics_block(void)
+{
+    return t_metrics ? t_metrics : metrics_thread_block();
+}
+
+// 只有所属线程写，普通的读改写即可；用原子读写保证汇总时不会读到撕裂的值
+static inline void metrics_bump(unsigned long *slot, unsigned long n)
+{
+    __atomic_store_n(slot, __atomic_load_n(slot, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_add(enum metric_counter counter, unsigned long n)
+{
+    metrics_block_t *block = metrics_block();
+    if (block)
+        metrics_bump(&block->counters[counter], n);
+}
+
+#endif // METRICS_H
@@ -0,0 +1,21 @@
+#ifndef MSG_BUF_H
+#define MSG_BUF_H
+#include "types.h"
+
+#define MSG_BUF_POOL_CLASSES 3 // 缓冲区池的容量档位数
+
+msg_buf_t *msg_buf_alloc(size_t len);
+msg_buf_t *msg_buf_new(const char *msg, size_t len);
+msg_buf_t *msg_buf_new_immortal(const char *msg, size_t len);
+msg_buf_t *msg_buf_ref(msg_buf_t *buf);
+msg_buf_t *msg_buf_ws_frame(msg_buf_t *buf, int level, int binary);
+msg_buf_t *msg_buf_cbor(msg_buf_t *buf);
+void msg_buf_unref(msg_buf_t *buf);
+
+// 发送起始地址（前面预留了 LWS_PRE 字节）
+static inline unsigned char *msg_buf_payload(msg_buf_t *buf)
+{
+    return buf->data + LWS_PRE;
+}
+
+#endif // MSG_BUF_H
@@ -0,0 +1,29 @@
+#ifndef MSG_TEMPLATE_H
+#define MSG_TEMPLATE_H
+#include "types.h"
+
+#define MSG_TEMPLATE_MAX_SLOTS 16
+
+// 预渲染的消息模板：模板原文在第一次使用时切分成固定字节片段和变量槽位，
+// 生成消息时只把变量拼接进片段之间，直接写入 msg_buf，不构建 cJSON 树。
+// 槽位：%s 字符串（按 JSON 转义，引号写在模板里）、%d 整数、%f 浮点数
+typedef struct msg_template
+{
+    const char *fmt;                              // 模板原文（须为常量字符串）
+    int ready;                                    // 已切分
+    int slots;                                    // 槽位数
+    char types[MSG_TEMPLATE_MAX_SLOTS];           // 各槽位类型 's' / 'd' / 'f'
+    const char *segs[MSG_TEMPLATE_MAX_SLOTS + 1]; // 槽位之间的固定片段（指向 fmt 内部）
+    size_t seg_lens[MSG_TEMPLATE_MAX_SLOTS + 1];  // 各片段长度
+} msg_template_t;
+
+#define MSG_TEMPLATE_INIT(f) {.fmt = (f)}
+
+msg_buf_t *msg_template_render(msg_template_t *tpl, ...);
+
+msg_buf_t *msg_success(const char *message);
+msg_buf_t *msg_error(const char *message);
+msg_buf_t *msg_heartbeat_ack(void);
+msg_buf_t *msg_progress(double played_percent);
+
+#endif // MSG_TEMPLATE_H
@@ -10,12 +10,18 @@ int remove_song_from_playlist(client_info_t *client, const char *song_hash);
 int update_playing_info(rooms_t *room);
 int play_next_song(client_info_t *client);
 int playbysonghash(client_info_t *client, const char *song_hash);
-const char *get_cur_song_info(rooms_t *room, enum ctrl cmd);
+msg_buf_t *get_cur_song_info(rooms_t *room, enum ctrl cmd);
 int pause_song(client_info_t *client);
 int resume_song(client_info_t *client);
 const char *get_playlist_json(rooms_t *room, enum ctrl cmd);
 int upsongbyhash(client_info_t *client, const char *song_hash);
-const char *get_cur_played_percent(rooms_t *room);
-const char *get_client_list_json(rooms_t *room, enum ctrl cmd);
+int movesongbyhash(client_info_t *client, const char *song_hash, const char *before_hash);
+msg_buf_t *get_cur_played_percent(rooms_t *room);
+lws_usec_t get_played_us(playing_info_t *playing_info);
+double get_played_percent(playing_info_t *playing_info);
+void update_progress_timer(rooms_t *room);
+const char *get_playback_anchor_json(rooms_t *room);
+const char *get_client_list_json(rooms_t *room, unsigned int offset, unsigned int limit, enum ctrl cmd);
 int play_next_song_bysystem(rooms_t *room);
+int prefetch_next_song(rooms_t *room);
 #endif // PLAYLIST_H
\ No newline at end of file
@@ -0,0 +1,12 @@
+#ifndef PLAYLIST_INDEX_H
+#define PLAYLIST_INDEX_H
+#include "types.h"
+#include <stdbool.h>
+
+bool playlist_index_init(playlist_index_t *index);
+void playlist_index_free(playlist_index_t *index);
+playlist_t *playlist_index_find(const playlist_index_t *index, const char *song_hash);
+bool playlist_index_insert(playlist_index_t *index, playlist_t *song);
+void playlist_index_remove(playlist_index_t *index, const playlist_t *song);
+
+#endif // PLAYLIST_INDEX_H
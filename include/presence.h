@@ -0,0 +1,9 @@
+#ifndef PRESENCE_H
+#define PRESENCE_H
+#include "types.h"
+
+void presence_join(rooms_t *room, client_info_t *client);
+void presence_leave(rooms_t *room, client_info_t *client);
+void presence_flush(rooms_t *room);
+
+#endif // PRESENCE_H
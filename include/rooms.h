@@ -3,9 +3,14 @@
 #include "cJSON.h"
 #include "types.h"
 #include <stdbool.h>
-rooms_t *init_rooms();
-rooms_t *insert_room_info(const char *room_id, const char *creater_id, rooms_t *head);
-void remove_room_node(rooms_t *head, rooms_t *node);
-bool init_room_action(rooms_t *room, char *userid, char action, char *action_message);
+room_registry_t *init_rooms();
+uint32_t room_id_hash(const char *room_id);
+unsigned int room_shard_index(const char *room_id, unsigned int count, uint32_t salt);
+rooms_t *find_room(room_registry_t *registry, const char *room_id);
+rooms_t *next_room(room_registry_t *registry, unsigned int *cursor);
+rooms_t *insert_room_info(const char *room_id, const char *creater_id, room_registry_t *registry);
+void remove_room_node(room_registry_t *registry, rooms_t *node);
+bool init_room_action(rooms_t *room, const char *userid, int action, const char *action_message);
+const char *get_room_actions_json(rooms_t *room, unsigned int offset, unsigned int limit, enum ctrl cmd);
 
 #endif // ROOMS_H
@@ -0,0 +1,19 @@
+#ifndef SEND_QUEUE_H
+#define SEND_QUEUE_H
+#include "types.h"
+
+// 出站队列全局统计
+typedef struct send_queue_stats
+{
+    unsigned long conflated;   // 被新消息合并掉的消息数
+    unsigned long dropped;     // 队列满时丢弃的消息数
+    unsigned long disconnects; // 超出预算被断开的连接数
+} send_queue_stats_t;
+
+int send_queue_push(client_info_t *client, msg_buf_t *buf, enum send_policy policy, int action);
+msg_buf_t *send_queue_pop(client_info_t *client);
+void send_queue_clear(client_info_t *client);
+unsigned int send_queue_depth(client_info_t *client);
+send_queue_stats_t send_queue_get_stats(void);
+
+#endif // SEND_QUEUE_H
@@ -0,0 +1,23 @@
+#ifndef SHARD_H
+#define SHARD_H
+#include <libwebsockets.h>
+#include "types.h"
+
+// 多服务线程分片：每个 lws 服务线程（tsi）拥有一份房间注册表，房间按 room_id 哈希固定在某个线程上，
+// 房间状态、定时器只在所属线程访问；其他线程通过投递任务访问，不需要全局锁。
+
+typedef void (*shard_task_fn)(void *arg);
+
+int shard_init(struct lws_context *context, int count);
+void shard_stop(void);
+void shard_destroy(void);
+int shard_count(void);
+int shard_current(void);
+void shard_set_current(int tsi);
+int shard_of_room(const char *room_id);
+room_registry_t *shard_rooms(int tsi);
+int shard_post(int tsi, shard_task_fn fn, void *arg);
+void shard_drain(void);
+int callback_shard(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len);
+
+#endif // SHARD_H
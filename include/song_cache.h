@@ -0,0 +1,45 @@
+#ifndef SONG_CACHE_H
+#define SONG_CACHE_H
+#include <stddef.h>
+#include <libwebsockets.h>
+
+// 缓存的数据种类
+enum song_cache_kind
+{
+    SONG_CACHE_SONG_URL,
+    SONG_CACHE_LYRICS_URL,
+    SONG_CACHE_KIND_MAX
+};
+
+// 查询结果
+enum song_cache_result
+{
+    SONG_CACHE_HIT,    // 命中，回调已经同步执行
+    SONG_CACHE_JOINED, // 已有相同请求在进行中，等待其完成后回调
+    SONG_CACHE_MISS,   // 未命中，调用方负责请求上游并调用 song_cache_complete
+    SONG_CACHE_ERROR
+};
+
+// 查询完成回调，失败时 value 为 NULL
+typedef void (*song_cache_cb)(const char *song_hash, const char *value, void *arg);
+
+// 缓存统计
+typedef struct song_cache_stats
+{
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long coalesced; // 合并到进行中请求的查询数
+    unsigned long expired;   // 因 TTL 过期而重新请求的次数
+    unsigned long stale;     // 上游失败时以过期值应答的次数
+    unsigned long evictions; // 因内存上限被 LRU 淘汰的条目数
+    unsigned long entries;
+    size_t bytes;
+} song_cache_stats_t;
+
+int song_cache_init(size_t max_bytes, lws_usec_t song_url_ttl_us, lws_usec_t lyrics_url_ttl_us, lws_usec_t stale_grace_us);
+void song_cache_destroy(void);
+enum song_cache_result song_cache_acquire(enum song_cache_kind kind, const char *song_hash, song_cache_cb cb, void *arg);
+void song_cache_complete(enum song_cache_kind kind, const char *song_hash, const char *value);
+song_cache_stats_t song_cache_get_stats(void);
+
+#endif // SONG_CACHE_H
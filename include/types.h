@@ -2,7 +2,37 @@
 #define TYPES_H
 #include <arpa/inet.h>
 #include <libwebsockets.h>
+#include <stdint.h>
 #include <time.h>
+// 广播消息缓冲区（引用计数，只读，前面预留 LWS_PRE 字节）
+typedef struct msg_buf
+{
+    int refcount;                // 引用计数，最后一个持有者释放，MSG_BUF_IMMORTAL 表示常驻不释放
+    short pool;                  // 所属的内存池档位，-1 表示直接 malloc/free
+    size_t len;                  // 消息长度（不含 LWS_PRE）
+    size_t size;                 // 分配的总字节数，用于内存统计
+    struct msg_buf *next;        // 空闲链表（只在池中使用）
+    struct msg_buf *frame;       // 编码好的完整 WebSocket 帧（permessage-deflate 连接共用），首次使用时生成
+    struct msg_buf *cbor;        // 消息的 CBOR 编码（ctrl-protocol.bin 连接共用），首次使用时生成
+    struct latency_trace *trace; // 产生该消息的命令，最后一个持有者释放时结束计时
+    unsigned char data[];        // LWS_PRE + 消息 + '\0'
+} msg_buf_t;
+#define MSG_BUF_IMMORTAL (-1)
+// 出站消息投递策略
+enum send_policy
+{
+    SEND_RELIABLE, // 不可丢弃（操作回复、播放列表、成员列表等）
+    SEND_CONFLATE, // 可合并，队列中同类消息只保留最新一条（播放进度）
+};
+// 出站队列元素
+typedef struct send_item
+{
+    msg_buf_t *buf;
+    int action; // 合并时按 action 区分同类消息
+    char policy;
+} send_item_t;
+#define SEND_QUEUE_CAPACITY 64                 // 每个连接最多排队的消息数
+#define SEND_QUEUE_MAX_BYTES (4 * 1024 * 1024) // 每个连接最多排队的字节数
 // 歌曲信息
 typedef struct playlist
 {
@@ -14,11 +44,27 @@ typedef struct playlist
     char lyrics_url[256];
     char cover_url[256];
     struct playlist *next;
+    struct playlist *prev; // 双向链表，删除/移动不需要从头遍历
 } playlist_t;
+// 播放列表索引槽位
+typedef struct playlist_slot
+{
+    uint32_t hash;    // song_hash 的哈希值
+    playlist_t *song; // 为 NULL 表示空槽
+} playlist_slot_t;
+// 播放列表索引（开放寻址、线性探测，按 song_hash 索引到链表节点）
+typedef struct playlist_index
+{
+    playlist_slot_t *slots;
+    unsigned int capacity; // 槽位数量，始终为 2 的幂
+    unsigned int count;    // 播放列表中的歌曲数量
+} playlist_index_t;
 // 正在播放的歌曲信息
 typedef struct playing_info
 {
-    lws_sorted_usec_list_t timer;
+    lws_sorted_usec_list_t timer;           // 歌曲结束/预取定时器，按精确时间触发
+    lws_sorted_usec_list_t progress_timer;  // 进度广播定时器，暂停时不运行
+    lws_sorted_usec_list_t url_retry_timer; // 歌曲 url 获取失败后，等上游熔断冷却再重试
     char song_name[128];
     char song_hash[128];
     char song_url[256];
@@ -27,10 +73,15 @@ typedef struct playing_info
     char duration[16];
     char lyrics_url[256];
     char cover_url[256];
-    double played_percent;
     char is_playing;
-    time_t start_time;
-    time_t last_update_time;
+    char prefetch_started;    // 本首歌已经触发过预取
+    char url_retried;         // 本首歌的 url 已经重试过一次，再失败就跳过
+    char next_song_hash[128]; // 预取的下一首
+    char next_song_url[256];  // 预取到的下一首播放 url
+    lws_usec_t duration_us;     // 歌曲时长
+    lws_usec_t started_us;      // 开始播放的单调时钟时间，0 表示尚未开始
+    lws_usec_t paused_at_us;    // 暂停时刻，0 表示未暂停
+    lws_usec_t paused_total_us; // 累计暂停时长
     struct rooms *room;
     pthread_mutex_t lock;
 } playing_info_t;
@@ -41,20 +92,43 @@ typedef struct client_info
     char ip[INET_ADDRSTRLEN];
     struct rooms *room; // 对应房间节点
     char userId[64];
-    char latest_msg[1024]; // 服务器单独回复信息
-    char is_data_to_send;  // 是否有数据需要发送
+    send_item_t send_queue[SEND_QUEUE_CAPACITY]; // 出站消息环形队列
+    unsigned int queue_head;                     // 队首下标
+    unsigned int queue_len;                      // 当前排队数量
+    size_t queue_bytes;                          // 当前排队字节数
+    unsigned int queue_drops;                    // 被合并/丢弃的消息数
+    char over_budget;                            // 超出队列预算，等待断开
+    char want_progress;                          // 订阅周期性进度广播（旧客户端兼容）
+    int refcount;                                // 连接、房间成员列表、跨线程任务各持有一份引用
+    int tsi;                                     // 连接所在的服务线程
+    int room_tsi;                                // 房间所属的服务线程
+    int wake_pending;                            // 已投递唤醒发送的任务，尚未执行
+    msg_buf_t *tx_buf;                           // 正在分片发送的消息（只在连接所在线程访问）
+    size_t tx_offset;                            // tx_buf 已发送的字节数
+    char *rx_buf;                                // 跨多次接收回调的消息拼接缓冲区，按实际长度增长
+    size_t rx_len;                               // rx_buf 中已拼接的字节数
+    size_t rx_cap;                               // rx_buf 容量
+    char rx_discard;                             // 消息超长，丢弃到最后一个分片为止
+    char deflate;                                // 协商了 permessage-deflate，出站消息以预编码的完整帧发送
+    char binary;                                 // ctrl-protocol.bin 连接，收发 CBOR 编码的消息
     struct client_info *next;
     struct client_info *prev;
     pthread_mutex_t lock;
 } client_info_t;
+// 合并窗口内待广播的成员变化
+typedef struct presence_event
+{
+    char userId[64];
+    char ip[INET_ADDRSTRLEN];
+    char joined; // 1 加入，0 离开
+} presence_event_t;
 // 房间操作信息
 typedef struct room_ctrl
 {
     char userid[64];
-    char action;
+    int action; // enum ctrl，取值超出 char 范围
     char action_message[512];
     time_t action_time;
-    struct room_ctrl *next;
 } room_ctrl_t;
 // 房间信息
 typedef struct rooms
@@ -62,16 +136,39 @@ typedef struct rooms
     char room_id[64];
     char creater_id[64];
     unsigned int client_counter;
+    unsigned int progress_subscribers; // 订阅周期性进度广播的客户端数量
+    int tsi;                           // 所属服务线程，房间状态与定时器只在该线程访问
     client_info_t *client_info;
-    char latest_msg[1024];
     pthread_mutex_t lock;
     playlist_t *playlist_head;
     playlist_t *playlist_tail;
     playlist_t *current_song;
-    room_ctrl_t *room_ctrl_head;
+    playlist_index_t playlist_index; // song_hash -> 播放列表节点
+    unsigned long playlist_version;  // 播放列表版本号，每次增量广播加一
+    room_ctrl_t *action_log;         // 操作记录环形缓冲区，满了覆盖最旧的记录
+    unsigned int action_capacity;    // 环形缓冲区容量
+    unsigned int action_next;        // 下一条记录写入的位置
+    unsigned int action_count;       // 缓冲区中的记录数
+    unsigned long action_total;      // 累计记录数（含已被覆盖的）
+    presence_event_t *presence_events;     // 合并窗口内待广播的成员变化
+    unsigned int presence_count;           // 待广播的变化数
+    unsigned int presence_capacity;        // presence_events 容量
+    lws_sorted_usec_list_t presence_timer; // 合并窗口到期时广播
     playing_info_t playing_info;
-    struct rooms *next;
 } rooms_t;
+// 房间哈希表槽位
+typedef struct room_slot
+{
+    uint32_t hash; // room_id 的哈希值，比较前先比哈希，减少 strcmp
+    rooms_t *room; // 为 NULL 表示空槽
+} room_slot_t;
+// 房间注册表（开放寻址、线性探测的哈希表，按 room_id 索引）
+typedef struct room_registry
+{
+    room_slot_t *slots;
+    unsigned int capacity; // 槽位数量，始终为 2 的幂
+    unsigned int count;    // 已登记的房间数量
+} room_registry_t;
 // 操作枚举
 enum ctrl
 {
@@ -88,6 +185,15 @@ enum ctrl
     BROADCAST_SONG_LIST,
     BROADCAST_CLIENT_LIST,
     GET_CLEIENT_LIST,
+    BROADCAST_PRELOAD_HINT,
+    TIME_SYNC,
+    BROADCAST_PLAYBACK_ANCHOR,
+    SUBSCRIBE_PROGRESS,
+    MOVE_SONG,
+    GET_ROOM_ACTIONS,
+    BROADCAST_PLAYLIST_DELTA,
+    BROADCAST_PRESENCE,
+    GET_LATENCY_STATS,
 };
 
 enum CODE
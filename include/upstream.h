@@ -0,0 +1,47 @@
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+#include <libwebsockets.h>
+#include <curl/curl.h>
+
+// 上游接口，地址为 --upstream-url 加各自的路径
+enum upstream_endpoint
+{
+    UPSTREAM_SONG_URL,     // /song/url?hash=
+    UPSTREAM_SEARCH_LYRIC, // /search/lyric?hash=
+    UPSTREAM_ENDPOINT_MAX
+};
+
+// 每个接口一个熔断器：连续失败达到阈值后打开，冷却期内请求直接失败；
+// 冷却期过后半开，放行一个探测请求，成功则关闭，失败则再次打开
+enum upstream_breaker_state
+{
+    UPSTREAM_BREAKER_CLOSED,
+    UPSTREAM_BREAKER_OPEN,
+    UPSTREAM_BREAKER_HALF_OPEN,
+    UPSTREAM_BREAKER_STATE_MAX
+};
+
+// 按接口的容错统计
+typedef struct upstream_endpoint_stats
+{
+    int breaker_state;                                     // enum upstream_breaker_state
+    unsigned long transitions[UPSTREAM_BREAKER_STATE_MAX]; // 进入各状态的次数
+    unsigned long rejected;                                // 熔断期间直接失败的请求数
+    unsigned long timeouts;                                // 超过截止时间的请求数
+    unsigned long hedged;                                  // 发出的对冲请求数
+    unsigned long hedge_wins;                              // 对冲请求先成功的次数
+    lws_usec_t hedge_delay_us;                             // 当前的对冲延迟（近期 p95），0 表示样本不足
+} upstream_endpoint_stats_t;
+
+// 上游请求完成回调，请求失败时 data 为 NULL
+typedef void (*upstream_cb)(const char *data, size_t size, void *arg);
+
+int upstream_init(struct lws_context *context);
+void upstream_destroy(void);
+const char *upstream_endpoint_name(enum upstream_endpoint endpoint);
+const char *upstream_breaker_state_name(enum upstream_breaker_state state);
+int upstream_get(enum upstream_endpoint endpoint, const char *hash, upstream_cb cb, void *arg);
+void upstream_get_stats(upstream_endpoint_stats_t stats[UPSTREAM_ENDPOINT_MAX]);
+int callback_upstream(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len);
+
+#endif // UPSTREAM_H
@@ -3,7 +3,10 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <libwebsockets.h>
+#include "types.h"
 
-void timer_callback(lws_sorted_usec_list_t *sul);
+void progress_timer_callback(lws_sorted_usec_list_t *sul);
+void broadcast_response_room(rooms_t *room, const char *msg, int action);
+void broadcast_buf_room(rooms_t *room, msg_buf_t *buf, int action);
 
 #endif // WEBSOCKET_SERVICE_H
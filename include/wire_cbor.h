@@ -0,0 +1,68 @@
+#ifndef WIRE_CBOR_H
+#define WIRE_CBOR_H
+#include <stddef.h>
+#include "cJSON.h"
+#include "ctrl_parser.h"
+
+// ctrl-protocol.bin 子协议：命令和广播与 ctrl-protocol 的 JSON 消息结构完全相同，
+// 以 CBOR（RFC 8949）编码，对象的键用下表的整数编号代替字段名，表外的键仍以文本编码。
+// 编号是客户端协议的一部分，只能在末尾追加，不能修改或复用已有编号。
+enum wire_key
+{
+    WIRE_KEY_ERROR_CODE,     // "error_code"
+    WIRE_KEY_STATUS,         // "status"
+    WIRE_KEY_MESSAGE,        // "message"
+    WIRE_KEY_ACTION,         // "action"
+    WIRE_KEY_DATA,           // "data"
+    WIRE_KEY_TYPE,           // "type"
+    WIRE_KEY_USERID,         // "userid"
+    WIRE_KEY_PARAMS,         // "params"
+    WIRE_KEY_T0,             // "t0"
+    WIRE_KEY_T1,             // "t1"
+    WIRE_KEY_T2,             // "t2"
+    WIRE_KEY_ENABLE,         // "enable"
+    WIRE_KEY_OFFSET,         // "offset"
+    WIRE_KEY_LIMIT,          // "limit"
+    WIRE_KEY_SONGNAME,       // "songname"
+    WIRE_KEY_SONGHASH,       // "songhash"
+    WIRE_KEY_SINGERNAME,     // "singername"
+    WIRE_KEY_ALBUMNAME,      // "albumname"
+    WIRE_KEY_DURATION,       // "duration"
+    WIRE_KEY_COVERURL,       // "coverurl"
+    WIRE_KEY_BEFOREHASH,     // "beforehash"
+    WIRE_KEY_ALBUM_NAME,     // "album_name"
+    WIRE_KEY_COVER_URL,      // "cover_url"
+    WIRE_KEY_SONG_URL,       // "song_url"
+    WIRE_KEY_LYRICS_URL,     // "lyrics_url"
+    WIRE_KEY_PLAYED_PERCENT, // "played_percent"
+    WIRE_KEY_POSITION_MS,    // "position_ms"
+    WIRE_KEY_SERVER_TIME_MS, // "server_time_ms"
+    WIRE_KEY_IS_PLAYING,     // "is_playing"
+    WIRE_KEY_DURATION_MS,    // "duration_ms"
+    WIRE_KEY_RATE,           // "rate"
+    WIRE_KEY_VERSION,        // "version"
+    WIRE_KEY_CURRENT,        // "current"
+    WIRE_KEY_PLAYLIST,       // "playlist"
+    WIRE_KEY_OP,             // "op"
+    WIRE_KEY_INDEX,          // "index"
+    WIRE_KEY_SONG,           // "song"
+    WIRE_KEY_CLIENT_LIST,    // "client_list"
+    WIRE_KEY_CLIENT_COUNTER, // "client_counter"
+    WIRE_KEY_TOTAL,          // "total"
+    WIRE_KEY_USER_ID,        // "userId"
+    WIRE_KEY_IP,             // "ip"
+    WIRE_KEY_JOINED,         // "joined"
+    WIRE_KEY_LEFT,           // "left"
+    WIRE_KEY_ACTIONS,        // "actions"
+    WIRE_KEY_AVAILABLE,      // "available"
+    WIRE_KEY_TIME,           // "time"
+    WIRE_KEY_QUEUE_DEPTH,    // "queue_depth"
+    WIRE_KEY_QUEUE_DROPS,    // "queue_drops"
+    WIRE_KEY_AFTER,          // "after"
+    WIRE_KEY_MAX
+};
+
+size_t wire_cbor_encode(const cJSON *item, unsigned char *out, size_t cap);
+int wire_cbor_decode(const unsigned char *in, size_t len, ctrl_msg_t *msg);
+
+#endif // WIRE_CBOR_H
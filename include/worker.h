@@ -0,0 +1,14 @@
+#ifndef WORKER_H
+#define WORKER_H
+#include <libwebsockets.h>
+
+// 多进程模式：路由进程在监听端口上接受连接，按握手请求里的 roomid 哈希
+// 把连接 fd 交给对应的工作进程，同一个房间的成员总是落在同一个进程里。
+// 指标按进程分别统计，/metrics?worker=N 抓取 N 号进程（不带参数时为 0 号），需要逐个抓取后汇总。
+
+int workers_start(int count, int port, int *ctrl_fd);
+int worker_self(int *count);
+int worker_attach(struct lws_vhost *vhost, int ctrl_fd);
+int callback_worker(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len);
+
+#endif // WORKER_H
@@ -0,0 +1,14 @@
+#ifndef WS_DEFLATE_H
+#define WS_DEFLATE_H
+#include <stddef.h>
+
+// 服务器发往客户端的帧不加掩码，帧头最长 10 字节
+#define WS_FRAME_HEADER_MAX 10
+// 短于此长度的消息压缩收益很小，直接按原文发送
+#define WS_DEFLATE_MIN_LEN 128
+
+size_t ws_frame_header_len(size_t len);
+size_t ws_frame_bound(size_t len);
+size_t ws_frame_encode(unsigned char *out, size_t cap, const unsigned char *payload, size_t len, int level, int binary);
+
+#endif // WS_DEFLATE_H
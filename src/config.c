@@ -0,0 +1,223 @@
+#include "config.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+server_config_t g_config = {
+    .port = 3375,
+    .threads = 1,
+    .workers = 1,
+    .prefetch_threshold = 0.8,
+    .progress_interval_ms = 5000,
+    .song_cache_max_bytes = 16 * 1024 * 1024,
+    .song_url_ttl_us = 10 * 60 * LWS_US_PER_SEC,
+    .lyrics_url_ttl_us = 24 * 60 * 60 * LWS_US_PER_SEC,
+    .stale_grace_us = 10 * 60 * LWS_US_PER_SEC,
+    .action_log_capacity = 128,
+    .presence_window_ms = 200,
+    .max_message_bytes = 256 * 1024,
+    .deflate_level = 0,
+    .latency_dump_interval_s = 60,
+    .upstream_url = "http://47.112.6.94:3000",
+    .song_url_timeout_ms = 2000,
+    .lyrics_url_timeout_ms = 3000,
+    .breaker_failures = 5,
+    .breaker_cooldown_ms = 5000,
+};
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "用法: %s [选项]\n"
+            "  -p, --port <端口>               监听端口 (默认 %d)\n"
+            "  -t, --threads <数量>            lws 服务线程数 (默认 %d)\n"
+            "  -w, --workers <数量>            工作进程数，>1 时按房间把连接分配到各进程，\n"
+            "                                  指标按进程分别用 /metrics?worker=N 抓取 (默认 %d)\n"
+            "      --prefetch-threshold <0~1>  播放进度超过该值时预取下一首 (默认 %.2f, >=1 关闭)\n"
+            "      --progress-interval <毫秒>  播放进度广播间隔 (默认 %d)\n"
+            "      --legacy-progress           新连接默认订阅周期性进度广播（否则需 progress=1 或 SUBSCRIBE_PROGRESS）\n"
+            "      --song-cache-mb <MB>        歌曲/歌词 url 缓存内存上限 (默认 %zu)\n"
+            "      --song-url-ttl <秒>         歌曲 url 缓存有效期 (默认 %lld)\n"
+            "      --lyrics-url-ttl <秒>       歌词 url 缓存有效期 (默认 %lld)\n"
+            "      --stale-grace <秒>          上游失败时仍以过期不超过该时长的缓存应答 (默认 %lld, 0 不使用过期值)\n"
+            "      --action-log-capacity <条>  每个房间保留的操作记录条数 (默认 %u)\n"
+            "      --presence-window-ms <毫秒> 成员加入/离开合并广播的窗口 (默认 %d, 0 立即广播)\n"
+            "      --max-message-kb <KB>       单条入站消息的长度上限 (默认 %zu)\n"
+            "      --deflate-level <0~9>       permessage-deflate 压缩级别 (默认 %d, 0 不压缩)\n"
+            "      --latency-dump <文件>       周期性写出各命令分阶段延迟统计（多进程模式下追加 .<pid>）\n"
+            "      --latency-dump-interval <秒> 延迟统计写出间隔 (默认 %d, 0 只在退出时写)\n"
+            "      --upstream-url <地址>       上游音乐 API 地址 (默认 %s)\n"
+            "      --upstream-max-connections <数量> 到上游的并发连接数上限 (默认 %d, 0 不限)\n"
+            "      --upstream-http2            与上游使用 HTTP/2（http:// 地址按 h2c 直接协商）\n"
+            "      --song-url-timeout-ms <毫秒> 歌曲 url 查询的截止时间 (默认 %d)\n"
+            "      --lyrics-url-timeout-ms <毫秒> 歌词查询的截止时间 (默认 %d)\n"
+            "      --breaker-failures <次>     连续失败多少次后熔断该上游接口 (默认 %d, 0 不熔断)\n"
+            "      --breaker-cooldown-ms <毫秒> 熔断后放行探测请求的间隔 (默认 %d)\n"
+            "      --upstream-hedge            请求超过近期 p95 耗时未完成时再发一个对冲请求\n"
+            "  -h, --help                      显示帮助\n",
+            prog, g_config.port, g_config.threads, g_config.workers, g_config.prefetch_threshold, g_config.progress_interval_ms, g_config.song_cache_max_bytes / (1024 * 1024),
+            (long long)(g_config.song_url_ttl_us / LWS_US_PER_SEC), (long long)(g_config.lyrics_url_ttl_us / LWS_US_PER_SEC),
+            (long long)(g_config.stale_grace_us / LWS_US_PER_SEC),
+            g_config.action_log_capacity, g_config.presence_window_ms, g_config.max_message_bytes / 1024,
+            g_config.deflate_level, g_config.latency_dump_interval_s, g_config.upstream_url,
+            g_config.upstream_max_connections, g_config.song_url_timeout_ms, g_config.lyrics_url_timeout_ms,
+            g_config.breaker_failures, g_config.breaker_cooldown_ms);
+}
+
+// 解析命令行参数，出错或 --help 时返回 -1
+int parse_config(int argc, char **argv)
+{
+    enum
+    {
+        OPT_PREFETCH_THRESHOLD = 256,
+        OPT_PROGRESS_INTERVAL,
+        OPT_LEGACY_PROGRESS,
+        OPT_SONG_CACHE_MB,
+        OPT_SONG_URL_TTL,
+        OPT_LYRICS_URL_TTL,
+        OPT_ACTION_LOG_CAPACITY,
+        OPT_PRESENCE_WINDOW_MS,
+        OPT_MAX_MESSAGE_KB,
+        OPT_DEFLATE_LEVEL,
+        OPT_LATENCY_DUMP,
+        OPT_LATENCY_DUMP_INTERVAL,
+        OPT_UPSTREAM_URL,
+        OPT_UPSTREAM_MAX_CONNECTIONS,
+        OPT_UPSTREAM_HTTP2,
+        OPT_STALE_GRACE,
+        OPT_SONG_URL_TIMEOUT_MS,
+        OPT_LYRICS_URL_TIMEOUT_MS,
+        OPT_BREAKER_FAILURES,
+        OPT_BREAKER_COOLDOWN_MS,
+        OPT_UPSTREAM_HEDGE,
+    };
+    static const struct option long_options[] = {
+        {"port", required_argument, NULL, 'p'},
+        {"threads", required_argument, NULL, 't'},
+        {"workers", required_argument, NULL, 'w'},
+        {"prefetch-threshold", required_argument, NULL, OPT_PREFETCH_THRESHOLD},
+        {"progress-interval", required_argument, NULL, OPT_PROGRESS_INTERVAL},
+        {"legacy-progress", no_argument, NULL, OPT_LEGACY_PROGRESS},
+        {"song-cache-mb", required_argument, NULL, OPT_SONG_CACHE_MB},
+        {"song-url-ttl", required_argument, NULL, OPT_SONG_URL_TTL},
+        {"lyrics-url-ttl", required_argument, NULL, OPT_LYRICS_URL_TTL},
+        {"action-log-capacity", required_argument, NULL, OPT_ACTION_LOG_CAPACITY},
+        {"presence-window-ms", required_argument, NULL, OPT_PRESENCE_WINDOW_MS},
+        {"max-message-kb", required_argument, NULL, OPT_MAX_MESSAGE_KB},
+        {"deflate-level", required_argument, NULL, OPT_DEFLATE_LEVEL},
+        {"latency-dump", required_argument, NULL, OPT_LATENCY_DUMP},
+        {"latency-dump-interval", required_argument, NULL, OPT_LATENCY_DUMP_INTERVAL},
+        {"upstream-url", required_argument, NULL, OPT_UPSTREAM_URL},
+        {"upstream-max-connections", required_argument, NULL, OPT_UPSTREAM_MAX_CONNECTIONS},
+        {"upstream-http2", no_argument, NULL, OPT_UPSTREAM_HTTP2},
+        {"stale-grace", required_argument, NULL, OPT_STALE_GRACE},
+        {"song-url-timeout-ms", required_argument, NULL, OPT_SONG_URL_TIMEOUT_MS},
+        {"lyrics-url-timeout-ms", required_argument, NULL, OPT_LYRICS_URL_TIMEOUT_MS},
+        {"breaker-failures", required_argument, NULL, OPT_BREAKER_FAILURES},
+        {"breaker-cooldown-ms", required_argument, NULL, OPT_BREAKER_COOLDOWN_MS},
+        {"upstream-hedge", no_argument, NULL, OPT_UPSTREAM_HEDGE},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:t:w:h", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            g_config.port = atoi(optarg);
+            break;
+        case 't':
+            g_config.threads = atoi(optarg);
+            break;
+        case 'w':
+            g_config.workers = atoi(optarg);
+            break;
+        case OPT_PREFETCH_THRESHOLD:
+            g_config.prefetch_threshold = atof(optarg);
+            break;
+        case OPT_PROGRESS_INTERVAL:
+            g_config.progress_interval_ms = atoi(optarg);
+            break;
+        case OPT_LEGACY_PROGRESS:
+            g_config.progress_default = 1;
+            break;
+        case OPT_SONG_CACHE_MB:
+            g_config.song_cache_max_bytes = (size_t)atol(optarg) * 1024 * 1024;
+            break;
+        case OPT_SONG_URL_TTL:
+            g_config.song_url_ttl_us = atoll(optarg) * LWS_US_PER_SEC;
+            break;
+        case OPT_LYRICS_URL_TTL:
+            g_config.lyrics_url_ttl_us = atoll(optarg) * LWS_US_PER_SEC;
+            break;
+        case OPT_ACTION_LOG_CAPACITY:
+            g_config.action_log_capacity = (unsigned int)atoi(optarg);
+            break;
+        case OPT_PRESENCE_WINDOW_MS:
+            g_config.presence_window_ms = atoi(optarg);
+            break;
+        case OPT_MAX_MESSAGE_KB:
+            g_config.max_message_bytes = (size_t)atol(optarg) * 1024;
+            break;
+        case OPT_DEFLATE_LEVEL:
+            g_config.deflate_level = atoi(optarg);
+            break;
+        case OPT_LATENCY_DUMP:
+            g_config.latency_dump_path = optarg;
+            break;
+        case OPT_LATENCY_DUMP_INTERVAL:
+            g_config.latency_dump_interval_s = atoi(optarg);
+            break;
+        case OPT_UPSTREAM_URL:
+        {
+            // 去掉结尾的 /，拼接时统一加路径
+            size_t n = strlen(optarg);
+            while (n > 0 && optarg[n - 1] == '/')
+                optarg[--n] = '\0';
+            g_config.upstream_url = optarg;
+            break;
+        }
+        case OPT_UPSTREAM_MAX_CONNECTIONS:
+            g_config.upstream_max_connections = atoi(optarg);
+            break;
+        case OPT_UPSTREAM_HTTP2:
+            g_config.upstream_http2 = 1;
+            break;
+        case OPT_STALE_GRACE:
+            g_config.stale_grace_us = atoll(optarg) * LWS_US_PER_SEC;
+            break;
+        case OPT_SONG_URL_TIMEOUT_MS:
+            g_config.song_url_timeout_ms = atoi(optarg);
+            break;
+        case OPT_LYRICS_URL_TIMEOUT_MS:
+            g_config.lyrics_url_timeout_ms = atoi(optarg);
+            break;
+        case OPT_BREAKER_FAILURES:
+            g_config.breaker_failures = atoi(optarg);
+            break;
+        case OPT_BREAKER_COOLDOWN_MS:
+            g_config.breaker_cooldown_ms = atoi(optarg);
+            break;
+        case OPT_UPSTREAM_HEDGE:
+            g_config.upstream_hedge = 1;
+            break;
+        default:
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    if (g_config.port <= 0 || g_config.threads <= 0 || g_config.workers <= 0 || g_config.prefetch_threshold < 0 ||
+        g_config.progress_interval_ms <= 0 || g_config.action_log_capacity == 0 ||
+        g_config.presence_window_ms < 0 || g_config.max_message_bytes == 0 ||
+        g_config.deflate_level < 0 || g_config.deflate_level > 9 || g_config.latency_dump_interval_s < 0 ||
+        g_config.upstream_max_connections < 0 || g_config.stale_grace_us < 0 || g_config.song_url_timeout_ms <= 0 ||
+        g_config.lyrics_url_timeout_ms <= 0 || g_config.breaker_failures < 0 || g_config.breaker_cooldown_ms <= 0 ||
+        (strncmp(g_config.upstream_url, "http://", 7) && strncmp(g_config.upstream_url, "https://", 8)))
+    {
+        print_usage(argv[0]);
+        return -1;
+    }
+    return 0;
+}
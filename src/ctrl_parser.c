@@ -0,0 +1,576 @@
+#include "ctrl_parser.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 控制消息的单遍扫描解析：按固定命令格式（userid、action、type、t0、params.*）
+// 把字段直接解码到 ctrl_msg_t，不构建 cJSON 树、不分配内存。
+// 遇到扫描器不处理的形状（语法错误、重复字段、嵌套过深、字符串超出容量）
+// 返回 -1，由调用方退回 cJSON_Parse + ctrl_msg_from_json。
+
+#define CTRL_MAX_DEPTH 32 // 跳过未知值时允许的最大嵌套深度
+
+typedef struct ctrl_scanner
+{
+    const char *p;
+    const char *end;
+    ctrl_msg_t *msg;
+} ctrl_scanner_t;
+
+static const char *g_field_names[CTRL_FIELD_MAX] = {
+    "userid", "type", "songname", "songhash", "singername", "albumname", "duration", "coverurl", "beforehash",
+};
+
+// 与 cJSON 相同：超出 int 范围时取边界值
+static int number_to_int(double value)
+{
+    if (value >= INT_MAX)
+        return INT_MAX;
+    if (value <= (double)INT_MIN)
+        return INT_MIN;
+    return (int)value;
+}
+
+// 清空消息（其他编码的解码器同样以此开始）
+void ctrl_msg_reset(ctrl_msg_t *msg)
+{
+    msg->flags = 0;
+    msg->action = 0;
+    msg->t0 = 0;
+    msg->enable = 0;
+    msg->offset = 0;
+    msg->limit = 0;
+    for (int i = 0; i < CTRL_FIELD_MAX; i++)
+        msg->str_off[i] = -1;
+    msg->used = 0;
+}
+
+static void skip_ws(ctrl_scanner_t *s)
+{
+    while (s->p < s->end && (*s->p == ' ' || *s->p == '\t' || *s->p == '\n' || *s->p == '\r'))
+        s->p++;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static int read_hex4(ctrl_scanner_t *s, unsigned int *out)
+{
+    if (s->end - s->p < 4)
+        return -1;
+    unsigned int value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int h = hex_value(s->p[i]);
+        if (h < 0)
+            return -1;
+        value = (value << 4) | h;
+    }
+    s->p += 4;
+    *out = value;
+    return 0;
+}
+
+// 解码一个转义序列（s->p 指向反斜杠之后），写入 tmp 返回字节数，失败返回 0
+static size_t scan_escape(ctrl_scanner_t *s, char *tmp)
+{
+    if (s->p >= s->end)
+        return 0;
+    switch (*s->p++)
+    {
+    case '"':
+        tmp[0] = '"';
+        return 1;
+    case '\\':
+        tmp[0] = '\\';
+        return 1;
+    case '/':
+        tmp[0] = '/';
+        return 1;
+    case 'b':
+        tmp[0] = '\b';
+        return 1;
+    case 'f':
+        tmp[0] = '\f';
+        return 1;
+    case 'n':
+        tmp[0] = '\n';
+        return 1;
+    case 'r':
+        tmp[0] = '\r';
+        return 1;
+    case 't':
+        tmp[0] = '\t';
+        return 1;
+    case 'u':
+        break;
+    default:
+        return 0;
+    }
+
+    unsigned int cp;
+    if (read_hex4(s, &cp) < 0)
+        return 0;
+    if (cp >= 0xD800 && cp <= 0xDBFF)
+    {
+        // UTF-16 代理对
+        unsigned int low;
+        if (s->end - s->p < 2 || s->p[0] != '\\' || s->p[1] != 'u')
+            return 0;
+        s->p += 2;
+        if (read_hex4(s, &low) < 0 || low < 0xDC00 || low > 0xDFFF)
+            return 0;
+        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+    }
+    else if ((cp >= 0xDC00 && cp <= 0xDFFF) || cp == 0)
+    {
+        return 0; // 孤立的低位代理、与 C 字符串不兼容的 \u0000 交给 cJSON 处理
+    }
+    if (cp < 0x80)
+    {
+        tmp[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800)
+    {
+        tmp[0] = (char)(0xC0 | (cp >> 6));
+        tmp[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000)
+    {
+        tmp[0] = (char)(0xE0 | (cp >> 12));
+        tmp[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        tmp[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    tmp[0] = (char)(0xF0 | (cp >> 18));
+    tmp[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    tmp[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    tmp[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// 解析字符串（s->p 指向开头的引号），out 为 NULL 时只跳过；
+// 写入 out 时以 '\0' 结尾，超出 cap 返回 -1
+static int scan_string(ctrl_scanner_t *s, char *out, size_t cap, size_t *out_len)
+{
+    size_t n = 0;
+    s->p++;
+    while (s->p < s->end)
+    {
+        // 不含转义的连续片段整段拷贝
+        const char *run = s->p;
+        while (s->p < s->end && *s->p != '"' && *s->p != '\\' && (unsigned char)*s->p >= 0x20)
+            s->p++;
+        size_t run_len = s->p - run;
+        if (run_len)
+        {
+            if (out)
+            {
+                if (n + run_len >= cap)
+                    return -1;
+                memcpy(out + n, run, run_len);
+            }
+            n += run_len;
+        }
+        if (s->p >= s->end)
+            break;
+
+        char c = *s->p++;
+        if (c == '"')
+        {
+            if (out)
+                out[n] = '\0';
+            if (out_len)
+                *out_len = n;
+            return 0;
+        }
+        if (c != '\\')
+            return -1; // 未转义的控制字符
+
+        char tmp[4];
+        size_t tmp_len = scan_escape(s, tmp);
+        if (!tmp_len)
+            return -1;
+        if (out)
+        {
+            if (n + tmp_len >= cap)
+                return -1;
+            memcpy(out + n, tmp, tmp_len);
+        }
+        n += tmp_len;
+    }
+    return -1;
+}
+
+// 解析数字，先按 JSON 语法校验再交给 strtod
+static int scan_number(ctrl_scanner_t *s, double *out)
+{
+    const char *p = s->p;
+    if (p < s->end && *p == '-')
+        p++;
+    if (p >= s->end || *p < '0' || *p > '9')
+        return -1;
+    while (p < s->end && *p >= '0' && *p <= '9')
+        p++;
+    if (p < s->end && *p == '.')
+    {
+        p++;
+        if (p >= s->end || *p < '0' || *p > '9')
+            return -1;
+        while (p < s->end && *p >= '0' && *p <= '9')
+            p++;
+    }
+    if (p < s->end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        if (p < s->end && (*p == '+' || *p == '-'))
+            p++;
+        if (p >= s->end || *p < '0' || *p > '9')
+            return -1;
+        while (p < s->end && *p >= '0' && *p <= '9')
+            p++;
+    }
+    // 数字之后一定是 JSON 的分隔符，strtod 不会越过 p
+    char *num_end = NULL;
+    double value = strtod(s->p, &num_end);
+    if (num_end != p)
+        return -1;
+    s->p = p;
+    if (out)
+        *out = value;
+    return 0;
+}
+
+static int scan_literal(ctrl_scanner_t *s, const char *literal)
+{
+    size_t len = strlen(literal);
+    if ((size_t)(s->end - s->p) < len || memcmp(s->p, literal, len) != 0)
+        return -1;
+    s->p += len;
+    return 0;
+}
+
+// 跳过任意值
+static int skip_value(ctrl_scanner_t *s, int depth)
+{
+    if (depth > CTRL_MAX_DEPTH)
+        return -1;
+    skip_ws(s);
+    if (s->p >= s->end)
+        return -1;
+    switch (*s->p)
+    {
+    case '"':
+        return scan_string(s, NULL, 0, NULL);
+    case 't':
+        return scan_literal(s, "true");
+    case 'f':
+        return scan_literal(s, "false");
+    case 'n':
+        return scan_literal(s, "null");
+    case '{':
+    case '[':
+    {
+        char close = *s->p == '{' ? '}' : ']';
+        int is_object = close == '}';
+        s->p++;
+        skip_ws(s);
+        if (s->p < s->end && *s->p == close)
+        {
+            s->p++;
+            return 0;
+        }
+        while (s->p < s->end)
+        {
+            if (is_object)
+            {
+                skip_ws(s);
+                if (s->p >= s->end || *s->p != '"' || scan_string(s, NULL, 0, NULL) < 0)
+                    return -1;
+                skip_ws(s);
+                if (s->p >= s->end || *s->p++ != ':')
+                    return -1;
+            }
+            if (skip_value(s, depth + 1) < 0)
+                return -1;
+            skip_ws(s);
+            if (s->p >= s->end)
+                return -1;
+            if (*s->p == ',')
+            {
+                s->p++;
+                continue;
+            }
+            if (*s->p++ == close)
+                return 0;
+            return -1;
+        }
+        return -1;
+    }
+    default:
+        return scan_number(s, NULL);
+    }
+}
+
+// 字段名解码到 key 并转成小写（cJSON_GetObjectItem 不区分大小写），
+// 过长的字段名一定不是已知字段，返回空串
+static int scan_key(ctrl_scanner_t *s, char *key, size_t cap)
+{
+    skip_ws(s);
+    if (s->p >= s->end || *s->p != '"')
+        return -1;
+    const char *start = s->p;
+    if (scan_string(s, key, cap, NULL) == 0)
+    {
+        for (char *k = key; *k; k++)
+        {
+            if (*k >= 'A' && *k <= 'Z')
+                *k += 'a' - 'A';
+        }
+    }
+    else
+    {
+        s->p = start;
+        key[0] = '\0';
+        if (scan_string(s, NULL, 0, NULL) < 0)
+            return -1;
+    }
+    skip_ws(s);
+    return s->p < s->end && *s->p++ == ':' ? 0 : -1;
+}
+
+// 字符串字段：解码进 msg->strings；不是字符串时与 cJSON_IsString 一样视为不存在
+static int scan_string_field(ctrl_scanner_t *s, enum ctrl_field field)
+{
+    ctrl_msg_t *msg = s->msg;
+    if (msg->str_off[field] >= 0)
+        return -1; // 重复字段
+    skip_ws(s);
+    if (s->p >= s->end || *s->p != '"')
+        return skip_value(s, 0);
+    size_t len = 0;
+    if (scan_string(s, msg->strings + msg->used, CTRL_MSG_STRINGS - msg->used, &len) < 0)
+        return -1;
+    msg->str_off[field] = (short)msg->used;
+    msg->used += len + 1;
+    return 0;
+}
+
+// 数字字段：不是数字时视为不存在
+static int scan_number_field(ctrl_scanner_t *s, unsigned int flag, double *out)
+{
+    if (s->msg->flags & flag)
+        return -1;
+    skip_ws(s);
+    if (s->p >= s->end || (*s->p != '-' && (*s->p < '0' || *s->p > '9')))
+        return skip_value(s, 0);
+    if (scan_number(s, out) < 0)
+        return -1;
+    s->msg->flags |= flag;
+    return 0;
+}
+
+static int find_field(const char *key, int first, int last)
+{
+    for (int i = first; i <= last; i++)
+    {
+        if (!strcmp(key, g_field_names[i]))
+            return i;
+    }
+    return -1;
+}
+
+// 遍历对象的每个成员，is_params 区分顶层和 params
+static int scan_object(ctrl_scanner_t *s, int is_params)
+{
+    ctrl_msg_t *msg = s->msg;
+    char key[16];
+    skip_ws(s);
+    if (s->p >= s->end || *s->p++ != '{')
+        return -1;
+    skip_ws(s);
+    if (s->p < s->end && *s->p == '}')
+    {
+        s->p++;
+        return 0;
+    }
+    while (s->p < s->end)
+    {
+        if (scan_key(s, key, sizeof(key)) < 0)
+            return -1;
+
+        int ret;
+        double value = 0;
+        int field = is_params ? find_field(key, CTRL_FIELD_SONGNAME, CTRL_FIELD_BEFOREHASH)
+                              : find_field(key, CTRL_FIELD_USERID, CTRL_FIELD_TYPE);
+        if (field >= 0)
+        {
+            ret = scan_string_field(s, field);
+        }
+        else if (!is_params && !strcmp(key, "action"))
+        {
+            ret = scan_number_field(s, CTRL_HAS_ACTION, &value);
+            if (ret == 0 && (msg->flags & CTRL_HAS_ACTION))
+                msg->action = number_to_int(value);
+        }
+        else if (!is_params && !strcmp(key, "t0"))
+        {
+            ret = scan_number_field(s, CTRL_HAS_T0, &msg->t0);
+        }
+        else if (!is_params && !strcmp(key, "params"))
+        {
+            skip_ws(s);
+            if (msg->flags & CTRL_HAS_PARAMS)
+                ret = -1;
+            else if (s->p < s->end && *s->p == '{')
+            {
+                msg->flags |= CTRL_HAS_PARAMS;
+                ret = scan_object(s, 1);
+            }
+            else
+                ret = skip_value(s, 0);
+        }
+        else if (is_params && !strcmp(key, "enable"))
+        {
+            skip_ws(s);
+            if (msg->flags & CTRL_HAS_ENABLE)
+                ret = -1;
+            else if (scan_literal(s, "true") == 0)
+            {
+                msg->flags |= CTRL_HAS_ENABLE;
+                msg->enable = 1;
+                ret = 0;
+            }
+            else if (scan_literal(s, "false") == 0)
+            {
+                msg->flags |= CTRL_HAS_ENABLE;
+                msg->enable = 0;
+                ret = 0;
+            }
+            else
+            {
+                ret = scan_number_field(s, CTRL_HAS_ENABLE, &value);
+                if (ret == 0 && (msg->flags & CTRL_HAS_ENABLE))
+                    msg->enable = number_to_int(value);
+            }
+        }
+        else if (is_params && !strcmp(key, "offset"))
+        {
+            ret = scan_number_field(s, CTRL_HAS_OFFSET, &value);
+            if (ret == 0 && (msg->flags & CTRL_HAS_OFFSET))
+                msg->offset = number_to_int(value);
+        }
+        else if (is_params && !strcmp(key, "limit"))
+        {
+            ret = scan_number_field(s, CTRL_HAS_LIMIT, &value);
+            if (ret == 0 && (msg->flags & CTRL_HAS_LIMIT))
+                msg->limit = number_to_int(value);
+        }
+        else
+        {
+            ret = skip_value(s, 1);
+        }
+        if (ret < 0)
+            return -1;
+
+        skip_ws(s);
+        if (s->p >= s->end)
+            return -1;
+        if (*s->p == ',')
+        {
+            s->p++;
+            continue;
+        }
+        return *s->p++ == '}' ? 0 : -1;
+    }
+    return -1;
+}
+
+// 快速解析控制消息，成功返回 0；返回 -1 时调用方应改用 cJSON 解析
+int ctrl_parse(const char *in, size_t len, ctrl_msg_t *msg)
+{
+    ctrl_scanner_t s = {in, in + len, msg};
+    ctrl_msg_reset(msg);
+    if (scan_object(&s, 0) < 0)
+        return -1;
+    skip_ws(&s);
+    return s.p == s.end || *s.p == '\0' ? 0 : -1;
+}
+
+// 写入字符串字段（len 不含结尾的 '\0'），超出容量返回 -1
+int ctrl_msg_put_string(ctrl_msg_t *msg, enum ctrl_field field, const char *str, size_t len)
+{
+    if (len + 1 > CTRL_MSG_STRINGS - msg->used)
+        return -1;
+    memcpy(msg->strings + msg->used, str, len);
+    msg->strings[msg->used + len] = '\0';
+    msg->str_off[field] = (short)msg->used;
+    msg->used += len + 1;
+    return 0;
+}
+
+static int put_string(ctrl_msg_t *msg, enum ctrl_field field, const cJSON *item)
+{
+    if (!cJSON_IsString(item))
+        return 0;
+    return ctrl_msg_put_string(msg, field, item->valuestring, strlen(item->valuestring));
+}
+
+// 从 cJSON 树提取字段（快速解析不处理的消息），字符串超出容量返回 -1
+int ctrl_msg_from_json(const cJSON *root, ctrl_msg_t *msg)
+{
+    ctrl_msg_reset(msg);
+    if (!cJSON_IsObject(root))
+        return 0;
+    const cJSON *params = cJSON_GetObjectItem(root, "params");
+    for (int i = 0; i < CTRL_FIELD_MAX; i++)
+    {
+        const cJSON *parent = i < CTRL_FIELD_SONGNAME ? root : params;
+        if (cJSON_IsObject(parent) && put_string(msg, i, cJSON_GetObjectItem(parent, g_field_names[i])) < 0)
+            return -1;
+    }
+    const cJSON *item = cJSON_GetObjectItem(root, "action");
+    if (cJSON_IsNumber(item))
+    {
+        msg->flags |= CTRL_HAS_ACTION;
+        msg->action = item->valueint;
+    }
+    item = cJSON_GetObjectItem(root, "t0");
+    if (cJSON_IsNumber(item))
+    {
+        msg->flags |= CTRL_HAS_T0;
+        msg->t0 = item->valuedouble;
+    }
+    if (!cJSON_IsObject(params))
+        return 0;
+    msg->flags |= CTRL_HAS_PARAMS;
+    item = cJSON_GetObjectItem(params, "enable");
+    if (cJSON_IsBool(item) || cJSON_IsNumber(item))
+    {
+        msg->flags |= CTRL_HAS_ENABLE;
+        msg->enable = cJSON_IsBool(item) ? cJSON_IsTrue(item) : item->valueint;
+    }
+    item = cJSON_GetObjectItem(params, "offset");
+    if (cJSON_IsNumber(item))
+    {
+        msg->flags |= CTRL_HAS_OFFSET;
+        msg->offset = item->valueint;
+    }
+    item = cJSON_GetObjectItem(params, "limit");
+    if (cJSON_IsNumber(item))
+    {
+        msg->flags |= CTRL_HAS_LIMIT;
+        msg->limit = item->valueint;
+    }
+    return 0;
+}
@@ -0,0 +1,345 @@
+#include "latency.h"
+#include "metrics.h"
+#include "cJSON.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+__thread latency_trace_t *t_latency = NULL;
+
+// 每个线程一份直方图，只由所属线程写；按 action 槽位在第一次记录时分配 LATENCY_STAGE_MAX 个直方图
+typedef struct latency_block
+{
+    latency_hist_t *hists[METRIC_ACTION_SLOTS];
+    struct latency_block *next;
+} latency_block_t;
+
+static __thread latency_block_t *t_block = NULL;
+static latency_block_t *g_blocks = NULL; // 只增不删
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *g_stage_names[LATENCY_STAGE_MAX] = {
+    [LATENCY_PARSE] = "parse",
+    [LATENCY_HANDLER] = "handler",
+    [LATENCY_UPSTREAM] = "upstream",
+    [LATENCY_SERIALIZE] = "serialize",
+    [LATENCY_FANOUT] = "fanout",
+    [LATENCY_TOTAL] = "total",
+};
+
+// 报告的分位数
+static const struct
+{
+    const char *name;
+    double q;
+} g_quantiles[] = {{"p50", 0.5}, {"p99", 0.99}, {"p999", 0.999}};
+#define LATENCY_QUANTILES (sizeof(g_quantiles) / sizeof(g_quantiles[0]))
+
+const char *latency_stage_name(enum latency_stage stage)
+{
+    return g_stage_names[stage];
+}
+
+// 值所在的档：小于 16 的值各占一档，之后每个 2 的幂区间按最高 5 位分 16 档
+static unsigned int bucket_of(unsigned long us)
+{
+    if (us >= (1UL << LATENCY_MAX_BITS))
+        us = (1UL << LATENCY_MAX_BITS) - 1;
+    if (us < LATENCY_SUB_COUNT)
+        return (unsigned int)us;
+    int shift = 63 - __builtin_clzl(us) - LATENCY_SUB_BITS;
+    return (unsigned int)((shift + 1) * LATENCY_SUB_COUNT + ((us >> shift) & (LATENCY_SUB_COUNT - 1)));
+}
+
+// 档内的最大值
+static unsigned long bucket_upper(unsigned int bucket)
+{
+    if (bucket < LATENCY_SUB_COUNT)
+        return bucket;
+    int shift = (int)(bucket / LATENCY_SUB_COUNT) - 1;
+    unsigned long sub = bucket % LATENCY_SUB_COUNT + LATENCY_SUB_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+// 当前线程某个 action 槽位的直方图
+static latency_hist_t *thread_hists(int slot)
+{
+    latency_block_t *block = t_block;
+    if (!block)
+    {
+        block = (latency_block_t *)calloc(1, sizeof(latency_block_t));
+        if (!block)
+        {
+            lwsl_err("Failed to allocate memory for latency_block_t\n");
+            return NULL;
+        }
+        pthread_mutex_lock(&g_lock);
+        block->next = g_blocks;
+        g_blocks = block;
+        pthread_mutex_unlock(&g_lock);
+        t_block = block;
+    }
+    latency_hist_t *hists = block->hists[slot];
+    if (!hists)
+    {
+        hists = (latency_hist_t *)calloc(LATENCY_STAGE_MAX, sizeof(latency_hist_t));
+        if (!hists)
+        {
+            lwsl_err("Failed to allocate memory for latency_hist_t\n");
+            return NULL;
+        }
+        __atomic_store_n(&block->hists[slot], hists, __ATOMIC_RELEASE);
+    }
+    return hists;
+}
+
+static void hist_record(latency_hist_t *hist, lws_usec_t us)
+{
+    unsigned long value = us > 0 ? (unsigned long)us : 0;
+    unsigned int *bucket = &hist->buckets[bucket_of(value)];
+    __atomic_store_n(bucket, __atomic_load_n(bucket, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    metrics_bump(&hist->sum_us, value);
+    if (value > hist->max_us)
+        __atomic_store_n(&hist->max_us, value, __ATOMIC_RELAXED);
+}
+
+// 最后一份引用释放（所有接收者写完），把各阶段耗时记入当前线程的直方图
+static void trace_record(latency_trace_t *trace)
+{
+    // 没有产生任何消息（投递失败、连接已断开等）的命令不计入
+    if (!trace->fanout_us)
+        return;
+    latency_hist_t *hists = thread_hists(metrics_action_slot(trace->action));
+    if (!hists)
+        return;
+    lws_usec_t now = lws_now_usecs();
+    lws_usec_t *stage = trace->stage_us;
+    stage[LATENCY_FANOUT] = now - trace->fanout_us;
+    stage[LATENCY_TOTAL] = now - trace->recv_us;
+    // 处理片段的墙钟时间包含了其中的序列化
+    stage[LATENCY_HANDLER] -= stage[LATENCY_SERIALIZE];
+    for (int i = 0; i < LATENCY_STAGE_MAX; i++)
+    {
+        if (i == LATENCY_UPSTREAM && !trace->waited)
+            continue;
+        hist_record(&hists[i], stage[i]);
+    }
+}
+
+// 解码完成时创建，之后的处理阶段从此刻开始计时
+latency_trace_t *latency_trace_new(int action, lws_usec_t recv_us)
+{
+    latency_trace_t *trace = (latency_trace_t *)calloc(1, sizeof(latency_trace_t));
+    if (!trace)
+    {
+        lwsl_err("Failed to allocate memory for latency_trace_t\n");
+        return NULL;
+    }
+    trace->refcount = 1;
+    trace->action = action;
+    trace->recv_us = recv_us;
+    trace->mark_us = lws_now_usecs();
+    trace->stage_us[LATENCY_PARSE] = trace->mark_us - recv_us;
+    return trace;
+}
+
+void latency_trace_unref(latency_trace_t *trace)
+{
+    if (!trace || __atomic_sub_fetch(&trace->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+    trace_record(trace);
+    free(trace);
+}
+
+// 在当前线程开始处理 trace 对应的命令，之后生成和入队的消息都归到它名下；返回之前的 trace 供 latency_leave 恢复
+latency_trace_t *latency_enter(latency_trace_t *trace)
+{
+    latency_trace_t *prev = t_latency;
+    if (trace)
+        t_latency = trace;
+    return prev;
+}
+
+// 结束当前处理片段，累计处理耗时
+void latency_leave(latency_trace_t *prev)
+{
+    latency_trace_t *trace = t_latency;
+    if (trace == prev)
+        return;
+    if (trace)
+        trace->stage_us[LATENCY_HANDLER] += lws_now_usecs() - trace->mark_us;
+    t_latency = prev;
+}
+
+// 发起异步查询前取得当前命令的引用，查询完成时交给 latency_resume
+latency_trace_t *latency_hold(lws_usec_t *wait_us)
+{
+    latency_trace_t *trace = t_latency;
+    if (!trace)
+        return NULL;
+    __atomic_add_fetch(&trace->refcount, 1, __ATOMIC_RELAXED);
+    *wait_us = lws_now_usecs();
+    return trace;
+}
+
+// 异步查询完成，累计等待时间并继续处理；缓存命中时在发起查询的处理片段内同步完成，不算等待
+latency_trace_t *latency_resume(latency_trace_t *trace, lws_usec_t wait_us)
+{
+    if (trace && trace != t_latency)
+    {
+        lws_usec_t now = lws_now_usecs();
+        trace->stage_us[LATENCY_UPSTREAM] += now - wait_us;
+        trace->waited = 1;
+        trace->mark_us = now;
+    }
+    return latency_enter(trace);
+}
+
+// 消息入队：第一次入队的消息缓冲区持有当前命令的一份引用，直到所有接收者写完才释放
+void latency_attach(msg_buf_t *buf)
+{
+    latency_trace_t *trace = t_latency;
+    if (!trace || !buf || buf->refcount == MSG_BUF_IMMORTAL || buf->trace)
+        return;
+    __atomic_add_fetch(&trace->refcount, 1, __ATOMIC_RELAXED);
+    buf->trace = trace;
+    if (!trace->fanout_us)
+        trace->fanout_us = lws_now_usecs();
+}
+
+void latency_serialize_end(lws_usec_t start_us)
+{
+    if (start_us && t_latency)
+        t_latency->stage_us[LATENCY_SERIALIZE] += lws_now_usecs() - start_us;
+}
+
+// 汇总所有线程某个 action 槽位的直方图，返回记录过的命令数
+int latency_collect(int slot, latency_hist_t out[LATENCY_STAGE_MAX])
+{
+    memset(out, 0, sizeof(latency_hist_t) * LATENCY_STAGE_MAX);
+    pthread_mutex_lock(&g_lock);
+    for (latency_block_t *block = g_blocks; block; block = block->next)
+    {
+        latency_hist_t *hists = __atomic_load_n(&block->hists[slot], __ATOMIC_ACQUIRE);
+        if (!hists)
+            continue;
+        for (int i = 0; i < LATENCY_STAGE_MAX; i++)
+        {
+            for (int b = 0; b < LATENCY_BUCKETS; b++)
+                out[i].buckets[b] += __atomic_load_n(&hists[i].buckets[b], __ATOMIC_RELAXED);
+            out[i].sum_us += __atomic_load_n(&hists[i].sum_us, __ATOMIC_RELAXED);
+            unsigned long max_us = __atomic_load_n(&hists[i].max_us, __ATOMIC_RELAXED);
+            if (max_us > out[i].max_us)
+                out[i].max_us = max_us;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    for (int i = 0; i < LATENCY_STAGE_MAX; i++)
+    {
+        for (int b = 0; b < LATENCY_BUCKETS; b++)
+            out[i].count += out[i].buckets[b];
+    }
+    return (int)out[LATENCY_TOTAL].count;
+}
+
+// 分位数 q（0~1）所在档的最大值，不超过记录到的最大值
+unsigned long latency_percentile(const latency_hist_t *hist, double q)
+{
+    if (!hist->count)
+        return 0;
+    unsigned long rank = (unsigned long)(q * hist->count);
+    if (rank < q * hist->count || rank == 0)
+        rank++;
+    unsigned long seen = 0;
+    for (unsigned int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        seen += hist->buckets[b];
+        if (seen >= rank)
+        {
+            unsigned long upper = bucket_upper(b);
+            return upper < hist->max_us ? upper : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
+
+// 各 action 各阶段的次数、分位数、最大值和平均值（微秒）
+const char *get_latency_stats_json(enum ctrl cmd)
+{
+    latency_hist_t *hists = (latency_hist_t *)malloc(sizeof(latency_hist_t) * LATENCY_STAGE_MAX);
+    cJSON *root = cJSON_CreateObject();
+    if (!hists || !root)
+    {
+        free(hists);
+        cJSON_Delete(root);
+        return NULL;
+    }
+    cJSON *data = cJSON_CreateArray();
+    for (int slot = 0; slot < METRIC_ACTION_SLOTS; slot++)
+    {
+        if (!latency_collect(slot, hists))
+            continue;
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "action", metrics_action_name(slot));
+        for (int i = 0; i < LATENCY_STAGE_MAX; i++)
+        {
+            if (!hists[i].count)
+                continue;
+            cJSON *stage = cJSON_CreateObject();
+            cJSON_AddNumberToObject(stage, "count", hists[i].count);
+            for (size_t q = 0; q < LATENCY_QUANTILES; q++)
+                cJSON_AddNumberToObject(stage, g_quantiles[q].name, latency_percentile(&hists[i], g_quantiles[q].q));
+            cJSON_AddNumberToObject(stage, "max", hists[i].max_us);
+            cJSON_AddNumberToObject(stage, "mean", (double)hists[i].sum_us / hists[i].count);
+            cJSON_AddItemToObject(item, g_stage_names[i], stage);
+        }
+        cJSON_AddItemToArray(data, item);
+    }
+    free(hists);
+    cJSON_AddNumberToObject(root, "error_code", SUCCESS);
+    cJSON_AddStringToObject(root, "status", "success");
+    cJSON_AddNumberToObject(root, "action", cmd);
+    cJSON_AddItemToObject(root, "data", data);
+    const char *json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json_str;
+}
+
+// 以文本表格写出各 action 各阶段的延迟（微秒），先写临时文件再改名，读取方不会看到写了一半的文件
+int latency_dump(const char *path)
+{
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    latency_hist_t *hists = (latency_hist_t *)malloc(sizeof(latency_hist_t) * LATENCY_STAGE_MAX);
+    FILE *fp = hists ? fopen(tmp_path, "w") : NULL;
+    if (!fp)
+    {
+        lwsl_err("写入延迟统计 %s 失败\n", tmp_path);
+        free(hists);
+        return -1;
+    }
+    fprintf(fp, "# 单位：微秒，统计自进程启动\n");
+    fprintf(fp, "%-26s %-10s %10s %10s %10s %10s %10s %10s\n", "action", "stage", "count", "p50", "p99", "p999", "max",
+            "mean");
+    for (int slot = 0; slot < METRIC_ACTION_SLOTS; slot++)
+    {
+        if (!latency_collect(slot, hists))
+            continue;
+        for (int i = 0; i < LATENCY_STAGE_MAX; i++)
+        {
+            if (!hists[i].count)
+                continue;
+            fprintf(fp, "%-26s %-10s %10lu %10lu %10lu %10lu %10lu %10.1f\n", metrics_action_name(slot), g_stage_names[i],
+                    hists[i].count, latency_percentile(&hists[i], 0.5), latency_percentile(&hists[i], 0.99),
+                    latency_percentile(&hists[i], 0.999), hists[i].max_us, (double)hists[i].sum_us / hists[i].count);
+        }
+    }
+    free(hists);
+    if (fclose(fp) != 0 || rename(tmp_path, path) != 0)
+    {
+        lwsl_err("写入延迟统计 %s 失败\n", path);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,437 @@
+#include "metrics.h"
+#include "send_queue.h"
+#include "song_cache.h"
+#include "latency.h"
+#include "worker.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+__thread metrics_block_t *t_metrics = NULL;
+
+// 所有线程的计数块，只增不删（线程退出后计数仍保留在汇总中）
+static metrics_block_t *g_blocks = NULL;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const unsigned int g_fanout_bounds[METRIC_FANOUT_BUCKETS] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000};
+static const unsigned int g_upstream_bounds_ms[METRIC_UPSTREAM_BUCKETS] = {1, 2, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000};
+
+// 消息槽位的 action 标签
+static const char *g_action_names[METRIC_ACTION_SLOTS] = {
+    [0] = "none",
+    [1 + GET_CUR_SONG_INFO - GET_CUR_SONG_INFO] = "get_cur_song_info",
+    [1 + PLAY_NEXT_SONG - GET_CUR_SONG_INFO] = "play_next_song",
+    [1 + PLAY_BY_SONG_HASH - GET_CUR_SONG_INFO] = "play_by_song_hash",
+    [1 + PAUSE_SONG - GET_CUR_SONG_INFO] = "pause_song",
+    [1 + RESUME_SONG - GET_CUR_SONG_INFO] = "resume_song",
+    [1 + ADD_SONG_TO_PLAYLIST - GET_CUR_SONG_INFO] = "add_song_to_playlist",
+    [1 + REMOVE_SONG_FROM_PLAYLIST - GET_CUR_SONG_INFO] = "remove_song_from_playlist",
+    [1 + UP_SONGBYHASH - GET_CUR_SONG_INFO] = "up_songbyhash",
+    [1 + GET_PLAYLIST - GET_CUR_SONG_INFO] = "get_playlist",
+    [1 + BROADCAST_SONG_INFO - GET_CUR_SONG_INFO] = "broadcast_song_info",
+    [1 + BROADCAST_SONG_LIST - GET_CUR_SONG_INFO] = "broadcast_song_list",
+    [1 + BROADCAST_CLIENT_LIST - GET_CUR_SONG_INFO] = "broadcast_client_list",
+    [1 + GET_CLEIENT_LIST - GET_CUR_SONG_INFO] = "get_client_list",
+    [1 + BROADCAST_PRELOAD_HINT - GET_CUR_SONG_INFO] = "broadcast_preload_hint",
+    [1 + TIME_SYNC - GET_CUR_SONG_INFO] = "time_sync",
+    [1 + BROADCAST_PLAYBACK_ANCHOR - GET_CUR_SONG_INFO] = "broadcast_playback_anchor",
+    [1 + SUBSCRIBE_PROGRESS - GET_CUR_SONG_INFO] = "subscribe_progress",
+    [1 + MOVE_SONG - GET_CUR_SONG_INFO] = "move_song",
+    [1 + GET_ROOM_ACTIONS - GET_CUR_SONG_INFO] = "get_room_actions",
+    [1 + BROADCAST_PLAYLIST_DELTA - GET_CUR_SONG_INFO] = "broadcast_playlist_delta",
+    [1 + BROADCAST_PRESENCE - GET_CUR_SONG_INFO] = "broadcast_presence",
+    [1 + GET_LATENCY_STATS - GET_CUR_SONG_INFO] = "get_latency_stats",
+    [METRIC_ACTION_CTRL_COUNT + 1] = "heartbeat",
+    [METRIC_ACTION_CTRL_COUNT + 2] = "other",
+};
+
+// 为当前线程分配并登记计数块
+metrics_block_t *metrics_thread_block(void)
+{
+    metrics_block_t *block = (metrics_block_t *)calloc(1, sizeof(metrics_block_t));
+    if (!block)
+    {
+        lwsl_err("Failed to allocate memory for metrics_block_t\n");
+        return NULL;
+    }
+    pthread_mutex_lock(&g_lock);
+    block->next = g_blocks;
+    g_blocks = block;
+    pthread_mutex_unlock(&g_lock);
+    t_metrics = block;
+    return block;
+}
+
+// action 对应的消息槽位
+int metrics_action_slot(int action)
+{
+    if (action == 0)
+        return 0;
+    if (action == METRIC_ACTION_HEARTBEAT)
+        return METRIC_ACTION_CTRL_COUNT + 1;
+    if (action >= GET_CUR_SONG_INFO && action <= GET_LATENCY_STATS)
+        return 1 + action - GET_CUR_SONG_INFO;
+    return METRIC_ACTION_CTRL_COUNT + 2;
+}
+
+const char *metrics_action_name(int slot)
+{
+    return slot >= 0 && slot < METRIC_ACTION_SLOTS ? g_action_names[slot] : "other";
+}
+
+// 收到一条客户端消息
+void metrics_message_in(int action)
+{
+    metrics_block_t *block = metrics_block();
+    if (block)
+        metrics_bump(&block->messages_in[metrics_action_slot(action)], 1);
+}
+
+// 一条消息放入某个客户端的出站队列
+void metrics_message_out(int action)
+{
+    metrics_block_t *block = metrics_block();
+    if (block)
+        metrics_bump(&block->messages_out[metrics_action_slot(action)], 1);
+}
+
+// 一次房间广播的接收人数
+void metrics_fanout(unsigned int recipients)
+{
+    metrics_block_t *block = metrics_block();
+    if (!block)
+        return;
+    int i = 0;
+    while (i < METRIC_FANOUT_BUCKETS && recipients > g_fanout_bounds[i])
+        i++;
+    metrics_bump(&block->fanout[i], 1);
+    metrics_bump(&block->fanout_sum, recipients);
+}
+
+// 一次上游请求从发起到完成的耗时（含等待空闲连接），在发起请求的线程上记录
+void metrics_upstream(enum upstream_endpoint endpoint, lws_usec_t elapsed_us, int ok)
+{
+    metrics_block_t *block = metrics_block();
+    if (!block || endpoint < 0 || endpoint >= UPSTREAM_ENDPOINT_MAX)
+        return;
+    int i = 0;
+    while (i < METRIC_UPSTREAM_BUCKETS && elapsed_us > (lws_usec_t)g_upstream_bounds_ms[i] * LWS_US_PER_MS)
+        i++;
+    metrics_bump(&block->upstream[endpoint][i], 1);
+    metrics_bump(&block->upstream_sum_us[endpoint], elapsed_us > 0 ? (unsigned long)elapsed_us : 0);
+    if (!ok)
+        metrics_bump(&block->upstream_errors[endpoint], 1);
+}
+
+// 汇总所有线程的计数块
+static void metrics_collect(metrics_block_t *total)
+{
+    memset(total, 0, sizeof(*total));
+    pthread_mutex_lock(&g_lock);
+    for (metrics_block_t *block = g_blocks; block; block = block->next)
+    {
+        for (int i = 0; i < METRIC_COUNTER_MAX; i++)
+            total->counters[i] += __atomic_load_n(&block->counters[i], __ATOMIC_RELAXED);
+        for (int i = 0; i < METRIC_ACTION_SLOTS; i++)
+        {
+            total->messages_in[i] += __atomic_load_n(&block->messages_in[i], __ATOMIC_RELAXED);
+            total->messages_out[i] += __atomic_load_n(&block->messages_out[i], __ATOMIC_RELAXED);
+        }
+        for (int i = 0; i <= METRIC_FANOUT_BUCKETS; i++)
+            total->fanout[i] += __atomic_load_n(&block->fanout[i], __ATOMIC_RELAXED);
+        total->fanout_sum += __atomic_load_n(&block->fanout_sum, __ATOMIC_RELAXED);
+        for (int e = 0; e < UPSTREAM_ENDPOINT_MAX; e++)
+        {
+            for (int i = 0; i <= METRIC_UPSTREAM_BUCKETS; i++)
+                total->upstream[e][i] += __atomic_load_n(&block->upstream[e][i], __ATOMIC_RELAXED);
+            total->upstream_sum_us[e] += __atomic_load_n(&block->upstream_sum_us[e], __ATOMIC_RELAXED);
+            total->upstream_errors[e] += __atomic_load_n(&block->upstream_errors[e], __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+// 输出文本，前面预留 LWS_PRE 字节供 lws_write 使用
+typedef struct metrics_text
+{
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+} metrics_text_t;
+
+static void text_printf(metrics_text_t *text, const char *fmt, ...)
+{
+    while (!text->failed)
+    {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(text->data + text->len, text->cap - text->len, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+        {
+            text->failed = 1;
+            return;
+        }
+        if ((size_t)n < text->cap - text->len)
+        {
+            text->len += n;
+            return;
+        }
+        char *data = (char *)realloc(text->data, text->cap * 2 + n);
+        if (!data)
+        {
+            text->failed = 1;
+            return;
+        }
+        text->data = data;
+        text->cap = text->cap * 2 + n;
+    }
+}
+
+static void text_metric(metrics_text_t *text, const char *name, const char *type, const char *help, unsigned long value)
+{
+    text_printf(text, "# HELP %s %s\n# TYPE %s %s\n%s %lu\n", name, help, name, type, name, value);
+}
+
+// 按 action 分组的计数器，跳过为 0 的槽位
+static void text_by_action(metrics_text_t *text, const char *name, const char *help, const unsigned long *values)
+{
+    text_printf(text, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (int i = 0; i < METRIC_ACTION_SLOTS; i++)
+    {
+        if (values[i])
+            text_printf(text, "%s{action=\"%s\"} %lu\n", name, g_action_names[i], values[i]);
+    }
+}
+
+// 命令分阶段延迟，以 summary 输出直方图的分位数
+static void text_latency(metrics_text_t *text)
+{
+    static const double quantiles[] = {0.5, 0.99, 0.999};
+    latency_hist_t *hists = (latency_hist_t *)malloc(sizeof(latency_hist_t) * LATENCY_STAGE_MAX);
+    if (!hists)
+    {
+        text->failed = 1;
+        return;
+    }
+    text_printf(text, "# HELP ws_command_latency_seconds 命令从收到到所有接收者写完的分阶段耗时\n"
+                      "# TYPE ws_command_latency_seconds summary\n");
+    for (int slot = 0; slot < METRIC_ACTION_SLOTS; slot++)
+    {
+        if (!latency_collect(slot, hists))
+            continue;
+        for (int i = 0; i < LATENCY_STAGE_MAX; i++)
+        {
+            if (!hists[i].count)
+                continue;
+            const char *action = metrics_action_name(slot), *stage = latency_stage_name((enum latency_stage)i);
+            for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+            {
+                text_printf(text, "ws_command_latency_seconds{action=\"%s\",stage=\"%s\",quantile=\"%g\"} %.6f\n", action,
+                            stage, quantiles[q], latency_percentile(&hists[i], quantiles[q]) / 1e6);
+            }
+            text_printf(text, "ws_command_latency_seconds_sum{action=\"%s\",stage=\"%s\"} %.6f\n", action, stage,
+                        hists[i].sum_us / 1e6);
+            text_printf(text, "ws_command_latency_seconds_count{action=\"%s\",stage=\"%s\"} %lu\n", action, stage,
+                        hists[i].count);
+        }
+    }
+    free(hists);
+}
+
+// 按接口输出一个上游容错计数器
+static void text_by_endpoint(metrics_text_t *text, const char *name, const char *help,
+                             const upstream_endpoint_stats_t *stats, size_t offset)
+{
+    text_printf(text, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (int e = 0; e < UPSTREAM_ENDPOINT_MAX; e++)
+    {
+        text_printf(text, "%s{endpoint=\"%s\"} %lu\n", name, upstream_endpoint_name((enum upstream_endpoint)e),
+                    *(const unsigned long *)((const char *)&stats[e] + offset));
+    }
+}
+
+// 按接口的上游请求耗时直方图、失败数和熔断 / 对冲统计
+static void text_upstream(metrics_text_t *text, const metrics_block_t *total)
+{
+    text_printf(text, "# HELP ws_upstream_request_duration_seconds 上游请求从发起到完成的耗时（含等待空闲连接）\n"
+                      "# TYPE ws_upstream_request_duration_seconds histogram\n");
+    for (int e = 0; e < UPSTREAM_ENDPOINT_MAX; e++)
+    {
+        const char *endpoint = upstream_endpoint_name((enum upstream_endpoint)e);
+        unsigned long cumulative = 0;
+        for (int i = 0; i < METRIC_UPSTREAM_BUCKETS; i++)
+        {
+            cumulative += total->upstream[e][i];
+            text_printf(text, "ws_upstream_request_duration_seconds_bucket{endpoint=\"%s\",le=\"%g\"} %lu\n", endpoint,
+                        g_upstream_bounds_ms[i] / 1000.0, cumulative);
+        }
+        cumulative += total->upstream[e][METRIC_UPSTREAM_BUCKETS];
+        text_printf(text, "ws_upstream_request_duration_seconds_bucket{endpoint=\"%s\",le=\"+Inf\"} %lu\n", endpoint, cumulative);
+        text_printf(text, "ws_upstream_request_duration_seconds_sum{endpoint=\"%s\"} %.6f\n", endpoint,
+                    total->upstream_sum_us[e] / 1e6);
+        text_printf(text, "ws_upstream_request_duration_seconds_count{endpoint=\"%s\"} %lu\n", endpoint, cumulative);
+    }
+    text_printf(text, "# HELP ws_upstream_endpoint_errors_total 按接口统计的失败上游请求数\n"
+                      "# TYPE ws_upstream_endpoint_errors_total counter\n");
+    for (int e = 0; e < UPSTREAM_ENDPOINT_MAX; e++)
+    {
+        text_printf(text, "ws_upstream_endpoint_errors_total{endpoint=\"%s\"} %lu\n",
+                    upstream_endpoint_name((enum upstream_endpoint)e), total->upstream_errors[e]);
+    }
+
+    upstream_endpoint_stats_t stats[UPSTREAM_ENDPOINT_MAX];
+    upstream_get_stats(stats);
+    text_printf(text, "# HELP ws_upstream_breaker_state 上游接口熔断器状态（0 关闭，1 打开，2 半开）\n"
+                      "# TYPE ws_upstream_breaker_state gauge\n");
+    for (int e = 0; e < UPSTREAM_ENDPOINT_MAX; e++)
+    {
+        text_printf(text, "ws_upstream_breaker_state{endpoint=\"%s\"} %d\n",
+                    upstream_endpoint_name((enum upstream_endpoint)e), stats[e].breaker_state);
+    }
+    text_printf(text, "# HELP ws_upstream_breaker_transitions_total 上游接口熔断器进入各状态的次数\n"
+                      "# TYPE ws_upstream_breaker_transitions_total counter\n");
+    for (int e = 0; e < UPSTREAM_ENDPOINT_MAX; e++)
+    {
+        for (int i = 0; i < UPSTREAM_BREAKER_STATE_MAX; i++)
+        {
+            text_printf(text, "ws_upstream_breaker_transitions_total{endpoint=\"%s\",state=\"%s\"} %lu\n",
+                        upstream_endpoint_name((enum upstream_endpoint)e),
+                        upstream_breaker_state_name((enum upstream_breaker_state)i), stats[e].transitions[i]);
+        }
+    }
+    text_by_endpoint(text, "ws_upstream_rejected_total", "熔断期间直接失败的上游请求数", stats,
+                     offsetof(upstream_endpoint_stats_t, rejected));
+    text_by_endpoint(text, "ws_upstream_timeouts_total", "超过截止时间的上游请求数", stats,
+                     offsetof(upstream_endpoint_stats_t, timeouts));
+    text_by_endpoint(text, "ws_upstream_hedged_total", "发出的对冲请求数", stats,
+                     offsetof(upstream_endpoint_stats_t, hedged));
+    text_by_endpoint(text, "ws_upstream_hedge_wins_total", "对冲请求先成功的次数", stats,
+                     offsetof(upstream_endpoint_stats_t, hedge_wins));
+}
+
+// 生成 Prometheus 文本格式的指标，返回的缓冲区前 LWS_PRE 字节为预留空间，*len 为正文长度
+static char *metrics_render(size_t *len)
+{
+    metrics_block_t total;
+    metrics_collect(&total);
+    const unsigned long *c = total.counters;
+    send_queue_stats_t queue = send_queue_get_stats();
+    song_cache_stats_t cache = song_cache_get_stats();
+    unsigned long connections = c[METRIC_CONNECTIONS_OPENED] - c[METRIC_CONNECTIONS_CLOSED];
+    unsigned long rooms = c[METRIC_ROOMS_CREATED] - c[METRIC_ROOMS_DESTROYED];
+
+    metrics_text_t text = {(char *)malloc(LWS_PRE + 8192), LWS_PRE, LWS_PRE + 8192, 0};
+    if (!text.data)
+        return NULL;
+
+    // 多进程模式下每个进程只有自己的计数，标出本进程编号和进程总数，抓取方据此确认是否抓全
+    int workers = 0;
+    int worker = worker_self(&workers);
+    if (worker >= 0)
+    {
+        text_printf(&text, "# HELP ws_worker_info 本进程的编号与工作进程总数（逐个抓取 /metrics?worker=N 后汇总）\n"
+                           "# TYPE ws_worker_info gauge\nws_worker_info{worker=\"%d\",workers=\"%d\"} 1\n",
+                    worker, workers);
+    }
+    text_metric(&text, "ws_connections_opened_total", "counter", "WebSocket 连接建立总数", c[METRIC_CONNECTIONS_OPENED]);
+    text_metric(&text, "ws_connections", "gauge", "当前 WebSocket 连接数", connections);
+    text_metric(&text, "ws_rooms_created_total", "counter", "房间创建总数", c[METRIC_ROOMS_CREATED]);
+    text_metric(&text, "ws_rooms", "gauge", "当前房间数", rooms);
+    text_by_action(&text, "ws_messages_in_total", "收到的客户端消息数", total.messages_in);
+    text_by_action(&text, "ws_messages_out_total", "放入出站队列的消息数（广播按接收人计）", total.messages_out);
+    text_metric(&text, "ws_bytes_received_total", "counter", "收到的 WebSocket 消息字节数", c[METRIC_BYTES_RECEIVED]);
+    text_metric(&text, "ws_bytes_sent_total", "counter", "发送的 WebSocket 字节数（压缩后）", c[METRIC_BYTES_SENT]);
+
+    text_printf(&text, "# HELP ws_broadcast_fanout 每次房间广播的接收人数\n# TYPE ws_broadcast_fanout histogram\n");
+    unsigned long cumulative = 0;
+    for (int i = 0; i < METRIC_FANOUT_BUCKETS; i++)
+    {
+        cumulative += total.fanout[i];
+        text_printf(&text, "ws_broadcast_fanout_bucket{le=\"%u\"} %lu\n", g_fanout_bounds[i], cumulative);
+    }
+    cumulative += total.fanout[METRIC_FANOUT_BUCKETS];
+    text_printf(&text, "ws_broadcast_fanout_bucket{le=\"+Inf\"} %lu\n", cumulative);
+    text_printf(&text, "ws_broadcast_fanout_sum %lu\nws_broadcast_fanout_count %lu\n", total.fanout_sum, cumulative);
+    text_latency(&text);
+
+    text_metric(&text, "ws_upstream_requests_total", "counter", "上游 HTTP 请求数", c[METRIC_UPSTREAM_REQUESTS]);
+    text_metric(&text, "ws_upstream_errors_total", "counter", "失败的上游 HTTP 请求数", c[METRIC_UPSTREAM_ERRORS]);
+    text_metric(&text, "ws_upstream_connections_opened_total", "counter", "到上游新建的连接数", c[METRIC_UPSTREAM_CONNECTS]);
+    text_upstream(&text, &total);
+
+    text_metric(&text, "ws_send_queue_messages", "gauge", "所有连接出站队列中的消息数",
+                c[METRIC_QUEUE_PUSHED] - c[METRIC_QUEUE_REMOVED]);
+    text_metric(&text, "ws_send_queue_bytes", "gauge", "所有连接出站队列中的消息字节数",
+                c[METRIC_QUEUE_BYTES_PUSHED] - c[METRIC_QUEUE_BYTES_REMOVED]);
+    text_metric(&text, "ws_send_queue_conflated_total", "counter", "被新消息合并掉的出站消息数", queue.conflated);
+    text_metric(&text, "ws_send_queue_dropped_total", "counter", "队列满时丢弃的出站消息数", queue.dropped);
+    text_metric(&text, "ws_send_queue_disconnects_total", "counter", "出站队列超出预算被断开的连接数", queue.disconnects);
+
+    text_metric(&text, "ws_song_cache_hits_total", "counter", "歌曲缓存命中数", cache.hits);
+    text_metric(&text, "ws_song_cache_misses_total", "counter", "歌曲缓存未命中数", cache.misses);
+    text_metric(&text, "ws_song_cache_coalesced_total", "counter", "合并到进行中上游请求的查询数", cache.coalesced);
+    text_metric(&text, "ws_song_cache_evictions_total", "counter", "因内存上限淘汰的缓存条目数", cache.evictions);
+    text_metric(&text, "ws_song_cache_stale_total", "counter", "上游失败时以过期值应答的次数", cache.stale);
+    text_metric(&text, "ws_song_cache_entries", "gauge", "歌曲缓存条目数", cache.entries);
+
+    text_printf(&text, "# HELP ws_memory_bytes 各子系统占用的内存\n# TYPE ws_memory_bytes gauge\n");
+    text_printf(&text, "ws_memory_bytes{subsystem=\"msg_buf\"} %lu\n", c[METRIC_MSG_BUF_ALLOCATED] - c[METRIC_MSG_BUF_FREED]);
+    text_printf(&text, "ws_memory_bytes{subsystem=\"msg_buf_pool\"} %lu\n", c[METRIC_MSG_BUF_POOLED] - c[METRIC_MSG_BUF_REUSED]);
+    text_printf(&text, "ws_memory_bytes{subsystem=\"song_cache\"} %zu\n", cache.bytes);
+    text_printf(&text, "ws_memory_bytes{subsystem=\"client_info\"} %zu\n", connections * sizeof(client_info_t));
+    text_printf(&text, "ws_memory_bytes{subsystem=\"room_info\"} %zu\n", rooms * sizeof(rooms_t));
+
+    if (text.failed)
+    {
+        free(text.data);
+        return NULL;
+    }
+    *len = text.len - LWS_PRE;
+    return text.data;
+}
+
+// /metrics 挂载点的 HTTP 回调
+int callback_metrics(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len)
+{
+    metrics_session_t *session = (metrics_session_t *)user;
+    switch (reason)
+    {
+    case LWS_CALLBACK_HTTP:
+    {
+        unsigned char headers[LWS_PRE + 256];
+        unsigned char *start = headers + LWS_PRE, *p = start, *end = headers + sizeof(headers) - 1;
+        free(session->body);
+        session->body = metrics_render(&session->len);
+        if (!session->body)
+            return lws_return_http_status(wsi, HTTP_STATUS_INTERNAL_SERVER_ERROR, NULL) ? -1 : 0;
+        if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, "text/plain; version=0.0.4; charset=utf-8", session->len, &p, end) ||
+            lws_finalize_write_http_header(wsi, start, &p, end))
+            return 1;
+        lws_callback_on_writable(wsi);
+        return 0;
+    }
+    case LWS_CALLBACK_HTTP_WRITEABLE:
+    {
+        if (!session->body)
+            break;
+        int ret = lws_write(wsi, (unsigned char *)session->body + LWS_PRE, session->len, LWS_WRITE_HTTP_FINAL);
+        free(session->body);
+        session->body = NULL;
+        if (ret < 0 || lws_http_transaction_completed(wsi))
+            return -1;
+        return 0;
+    }
+    case LWS_CALLBACK_CLOSED_HTTP:
+        free(session->body);
+        session->body = NULL;
+        break;
+    default:
+        break;
+    }
+    return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
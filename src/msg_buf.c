@@ -0,0 +1,178 @@
+#include "msg_buf.h"
+#include "ws_deflate.h"
+#include "wire_cbor.h"
+#include "metrics.h"
+#include "latency.h"
+#include <stdlib.h>
+#include <string.h>
+
+// 按容量分档的线程本地空闲链表：消息发送完后缓冲区回到释放它的线程的池中，
+// 稳定运行时生成消息不再调用 malloc/free
+static const size_t g_pool_sizes[MSG_BUF_POOL_CLASSES] = {256, 1024, 4096};
+#define MSG_BUF_POOL_MAX_FREE 256 // 每个线程每档最多缓存的空闲缓冲区
+
+static __thread msg_buf_t *t_free[MSG_BUF_POOL_CLASSES];
+static __thread unsigned int t_free_count[MSG_BUF_POOL_CLASSES];
+
+// 分配可容纳 len 字节消息的缓冲区，调用方写入 msg_buf_payload() 后由 len 标明长度
+msg_buf_t *msg_buf_alloc(size_t len)
+{
+    short pool = -1;
+    size_t capacity = len;
+    for (short i = 0; i < MSG_BUF_POOL_CLASSES; i++)
+    {
+        if (len <= g_pool_sizes[i])
+        {
+            pool = i;
+            capacity = g_pool_sizes[i];
+            break;
+        }
+    }
+
+    msg_buf_t *buf = pool >= 0 ? t_free[pool] : NULL;
+    if (buf)
+    {
+        t_free[pool] = buf->next;
+        t_free_count[pool]--;
+        metrics_add(METRIC_MSG_BUF_REUSED, buf->size);
+    }
+    else
+    {
+        buf = (msg_buf_t *)malloc(sizeof(msg_buf_t) + LWS_PRE + capacity + 1);
+        if (!buf)
+        {
+            lwsl_err("Failed to allocate memory for msg_buf_t\n");
+            return NULL;
+        }
+        buf->pool = pool;
+        buf->size = sizeof(msg_buf_t) + LWS_PRE + capacity + 1;
+        metrics_add(METRIC_MSG_BUF_ALLOCATED, buf->size);
+    }
+    buf->refcount = 1;
+    buf->len = len;
+    buf->next = NULL;
+    buf->frame = NULL;
+    buf->cbor = NULL;
+    buf->trace = NULL;
+    buf->data[LWS_PRE + len] = '\0';
+    return buf;
+}
+
+// 新建广播消息缓冲区：只序列化/拷贝一次，之后所有客户端共享同一份只读数据
+msg_buf_t *msg_buf_new(const char *msg, size_t len)
+{
+    if (!msg)
+        return NULL;
+    msg_buf_t *buf = msg_buf_alloc(len);
+    if (!buf)
+        return NULL;
+    memcpy(buf->data + LWS_PRE, msg, len);
+    return buf;
+}
+
+// 新建常驻缓冲区（固定回复等），引用计数不再变化，进程退出前不释放
+msg_buf_t *msg_buf_new_immortal(const char *msg, size_t len)
+{
+    if (!msg)
+        return NULL;
+    msg_buf_t *buf = (msg_buf_t *)malloc(sizeof(msg_buf_t) + LWS_PRE + len + 1);
+    if (!buf)
+    {
+        lwsl_err("Failed to allocate memory for msg_buf_t\n");
+        return NULL;
+    }
+    buf->refcount = MSG_BUF_IMMORTAL;
+    buf->pool = -1;
+    buf->len = len;
+    buf->size = sizeof(msg_buf_t) + LWS_PRE + len + 1;
+    buf->next = NULL;
+    buf->frame = NULL;
+    buf->cbor = NULL;
+    buf->trace = NULL;
+    metrics_add(METRIC_MSG_BUF_ALLOCATED, buf->size);
+    memcpy(buf->data + LWS_PRE, msg, len);
+    buf->data[LWS_PRE + len] = '\0';
+    return buf;
+}
+
+// 增加引用
+msg_buf_t *msg_buf_ref(msg_buf_t *buf)
+{
+    if (buf && buf->refcount != MSG_BUF_IMMORTAL)
+        __atomic_add_fetch(&buf->refcount, 1, __ATOMIC_RELAXED);
+    return buf;
+}
+
+// 消息编码成的完整文本帧或二进制帧（level > 0 时按 permessage-deflate 压缩），第一次使用时生成并缓存，
+// 房间广播只压缩一次，所有成员共用同一个帧；返回值的生命周期跟随 buf
+msg_buf_t *msg_buf_ws_frame(msg_buf_t *buf, int level, int binary)
+{
+    msg_buf_t *frame = __atomic_load_n(&buf->frame, __ATOMIC_ACQUIRE);
+    if (frame)
+        return frame;
+    size_t cap = ws_frame_bound(buf->len);
+    frame = msg_buf_alloc(cap);
+    if (!frame)
+        return NULL;
+    frame->len = ws_frame_encode(msg_buf_payload(frame), cap, msg_buf_payload(buf), buf->len, level, binary);
+    // 多个线程同时生成时只保留先完成的一份
+    msg_buf_t *expected = NULL;
+    if (!__atomic_compare_exchange_n(&buf->frame, &expected, frame, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        msg_buf_unref(frame);
+        return expected;
+    }
+    return frame;
+}
+
+// 消息的 CBOR 编码（ctrl-protocol.bin），第一次使用时从 JSON 转码并缓存，
+// 房间广播只转码一次，所有二进制连接共用；返回值的生命周期跟随 buf
+msg_buf_t *msg_buf_cbor(msg_buf_t *buf)
+{
+    msg_buf_t *cbor = __atomic_load_n(&buf->cbor, __ATOMIC_ACQUIRE);
+    if (cbor)
+        return cbor;
+    cJSON *root = cJSON_ParseWithLength((const char *)msg_buf_payload(buf), buf->len);
+    if (!root)
+        return NULL;
+    size_t len = wire_cbor_encode(root, NULL, 0);
+    cbor = msg_buf_alloc(len);
+    if (cbor)
+        wire_cbor_encode(root, msg_buf_payload(cbor), len);
+    cJSON_Delete(root);
+    if (!cbor)
+        return NULL;
+    msg_buf_t *expected = NULL;
+    if (!__atomic_compare_exchange_n(&buf->cbor, &expected, cbor, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        msg_buf_unref(cbor);
+        return expected;
+    }
+    return cbor;
+}
+
+// 释放引用，最后一个引用释放时回收到当前线程的池中（池满或超大缓冲区直接释放）
+void msg_buf_unref(msg_buf_t *buf)
+{
+    if (!buf || buf->refcount == MSG_BUF_IMMORTAL)
+        return;
+    if (__atomic_sub_fetch(&buf->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+    msg_buf_unref(buf->frame);
+    buf->frame = NULL;
+    msg_buf_unref(buf->cbor);
+    buf->cbor = NULL;
+    // 所有接收者都已写完（或已丢弃），结束产生它的命令的计时
+    latency_trace_unref(buf->trace);
+    buf->trace = NULL;
+    if (buf->pool >= 0 && t_free_count[buf->pool] < MSG_BUF_POOL_MAX_FREE)
+    {
+        buf->next = t_free[buf->pool];
+        t_free[buf->pool] = buf;
+        t_free_count[buf->pool]++;
+        metrics_add(METRIC_MSG_BUF_POOLED, buf->size);
+        return;
+    }
+    metrics_add(METRIC_MSG_BUF_FREED, buf->size);
+    free(buf);
+}
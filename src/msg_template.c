@@ -0,0 +1,232 @@
+#include "msg_template.h"
+#include "msg_buf.h"
+#include "latency.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 常用回复的模板（error_code 对应 SUCCESS / -FAIL）
+static msg_template_t g_tpl_success = MSG_TEMPLATE_INIT("{\"error_code\":0,\"status\":\"success\",\"message\":\"%s\"}");
+static msg_template_t g_tpl_error = MSG_TEMPLATE_INIT("{\"error_code\":-1,\"status\":\"error\",\"message\":\"%s\"}");
+static msg_template_t g_tpl_progress = MSG_TEMPLATE_INIT("{\"error_code\":0,\"status\":\"success\",\"action\":%d,"
+                                                         "\"data\":{\"played_percent\":%f}}");
+
+static msg_buf_t *g_heartbeat_ack = NULL;
+static pthread_once_t g_heartbeat_once = PTHREAD_ONCE_INIT;
+
+// 把模板原文切分成片段和槽位，只在第一次使用时执行
+static int template_prepare(msg_template_t *tpl)
+{
+    int ret = 0;
+    pthread_mutex_lock(&g_lock);
+    if (!tpl->ready)
+    {
+        const char *seg = tpl->fmt;
+        int slots = 0;
+        for (const char *p = tpl->fmt; *p; p++)
+        {
+            if (p[0] != '%' || (p[1] != 's' && p[1] != 'd' && p[1] != 'f'))
+                continue;
+            if (slots >= MSG_TEMPLATE_MAX_SLOTS)
+            {
+                lwsl_err("消息模板槽位过多: %s\n", tpl->fmt);
+                ret = -1;
+                break;
+            }
+            tpl->segs[slots] = seg;
+            tpl->seg_lens[slots] = p - seg;
+            tpl->types[slots] = p[1];
+            slots++;
+            seg = ++p + 1;
+        }
+        if (ret == 0)
+        {
+            tpl->segs[slots] = seg;
+            tpl->seg_lens[slots] = strlen(seg);
+            tpl->slots = slots;
+            __atomic_store_n(&tpl->ready, 1, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    return ret;
+}
+
+// 与 cJSON 相同的数字格式：整数按整数输出，其余取能精确还原的最短表示
+static size_t format_number(double value, char *out, size_t size)
+{
+    if (isnan(value) || isinf(value))
+        return snprintf(out, size, "null");
+    if (value == (double)(long long)value && value < 1e15 && value > -1e15)
+        return snprintf(out, size, "%lld", (long long)value);
+    int n = snprintf(out, size, "%1.15g", value);
+    if (strtod(out, NULL) != value)
+        n = snprintf(out, size, "%1.17g", value);
+    return n;
+}
+
+// 字符串按 JSON 转义后的长度
+static size_t escaped_len(const char *s)
+{
+    size_t len = 0;
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++)
+    {
+        if (*p == '"' || *p == '\\' || *p == '\b' || *p == '\f' || *p == '\n' || *p == '\r' || *p == '\t')
+            len += 2;
+        else if (*p < 0x20)
+            len += 6;
+        else
+            len++;
+    }
+    return len;
+}
+
+// 按 JSON 转义写入 out，返回写入后的位置
+static unsigned char *escape_copy(unsigned char *out, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++)
+    {
+        switch (*p)
+        {
+        case '"':
+        case '\\':
+            *out++ = '\\';
+            *out++ = *p;
+            break;
+        case '\b':
+            *out++ = '\\';
+            *out++ = 'b';
+            break;
+        case '\f':
+            *out++ = '\\';
+            *out++ = 'f';
+            break;
+        case '\n':
+            *out++ = '\\';
+            *out++ = 'n';
+            break;
+        case '\r':
+            *out++ = '\\';
+            *out++ = 'r';
+            break;
+        case '\t':
+            *out++ = '\\';
+            *out++ = 't';
+            break;
+        default:
+            if (*p < 0x20)
+            {
+                memcpy(out, "\\u00", 4);
+                out[4] = hex[*p >> 4];
+                out[5] = hex[*p & 0xf];
+                out += 6;
+            }
+            else
+            {
+                *out++ = *p;
+            }
+            break;
+        }
+    }
+    return out;
+}
+
+// 按模板生成消息：先算出总长度，再把片段和变量依次写入缓冲区（缓冲区来自线程本地池）
+msg_buf_t *msg_template_render(msg_template_t *tpl, ...)
+{
+    if (!__atomic_load_n(&tpl->ready, __ATOMIC_ACQUIRE) && template_prepare(tpl) < 0)
+        return NULL;
+
+    lws_usec_t serialize_us = latency_serialize_begin();
+    const char *values[MSG_TEMPLATE_MAX_SLOTS];
+    size_t lens[MSG_TEMPLATE_MAX_SLOTS];
+    char numbers[MSG_TEMPLATE_MAX_SLOTS][32];
+    size_t total = tpl->seg_lens[tpl->slots];
+
+    va_list ap;
+    va_start(ap, tpl);
+    for (int i = 0; i < tpl->slots; i++)
+    {
+        total += tpl->seg_lens[i];
+        switch (tpl->types[i])
+        {
+        case 's':
+            values[i] = va_arg(ap, const char *);
+            if (!values[i])
+                values[i] = "";
+            lens[i] = escaped_len(values[i]);
+            break;
+        case 'd':
+            lens[i] = snprintf(numbers[i], sizeof(numbers[i]), "%d", va_arg(ap, int));
+            values[i] = numbers[i];
+            break;
+        default:
+            lens[i] = format_number(va_arg(ap, double), numbers[i], sizeof(numbers[i]));
+            values[i] = numbers[i];
+            break;
+        }
+        total += lens[i];
+    }
+    va_end(ap);
+
+    msg_buf_t *buf = msg_buf_alloc(total);
+    if (!buf)
+        return NULL;
+    unsigned char *out = msg_buf_payload(buf);
+    for (int i = 0; i < tpl->slots; i++)
+    {
+        memcpy(out, tpl->segs[i], tpl->seg_lens[i]);
+        out += tpl->seg_lens[i];
+        if (tpl->types[i] == 's')
+        {
+            out = escape_copy(out, values[i]);
+        }
+        else
+        {
+            memcpy(out, values[i], lens[i]);
+            out += lens[i];
+        }
+    }
+    memcpy(out, tpl->segs[tpl->slots], tpl->seg_lens[tpl->slots]);
+    latency_serialize_end(serialize_us);
+    return buf;
+}
+
+// 成功回复 {"error_code":0,"status":"success","message":...}
+msg_buf_t *msg_success(const char *message)
+{
+    return msg_template_render(&g_tpl_success, message);
+}
+
+// 失败回复 {"error_code":-1,"status":"error","message":...}
+msg_buf_t *msg_error(const char *message)
+{
+    return msg_template_render(&g_tpl_error, message);
+}
+
+static void heartbeat_ack_init(void)
+{
+    msg_buf_t *buf = msg_success("heartbeat");
+    if (!buf)
+        return;
+    g_heartbeat_ack = msg_buf_new_immortal((const char *)msg_buf_payload(buf), buf->len);
+    msg_buf_unref(buf);
+}
+
+// 心跳回复内容固定，只生成一次，所有连接共享同一个常驻缓冲区
+msg_buf_t *msg_heartbeat_ack(void)
+{
+    pthread_once(&g_heartbeat_once, heartbeat_ack_init);
+    return g_heartbeat_ack;
+}
+
+// 播放进度广播
+msg_buf_t *msg_progress(double played_percent)
+{
+    return msg_template_render(&g_tpl_progress, (int)BROADCAST_SONG_INFO, played_percent);
+}
@@ -1,253 +1,664 @@
+#include <math.h>
 #include <stdlib.h>
 #include <libwebsockets.h>
 #include "cJSON.h"
 #include "playlist.h"
 #include "websocket_service.h"
 #include "rooms.h"
-
-#define SERVICE_IP_ADDRESS "47.112.6.94"
-#define SERVICE_PORT 3000
+#include "upstream.h"
+#include "song_cache.h"
+#include "config.h"
+#include "shard.h"
+#include "playlist_index.h"
+#include "msg_buf.h"
+#include "msg_template.h"
+#include "latency.h"
 
 extern struct lws_context *context;
 
-// 内存结构体
-struct ResponseData
+// 异步上游请求的上下文：房间可能在请求期间被销毁，所以只保存 room_id 再重新查找
+typedef struct pending_lookup
 {
-    char *data;
-    size_t size;
-};
+    char room_id[64];
+    char song_hash[128];
+    latency_trace_t *trace; // 等待查询结果的命令（只有切歌时的歌曲 url 查询计时）
+    lws_usec_t wait_us;     // 开始等待的时间
+} pending_lookup_t;
 
-// 写入回调函数
-static size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp)
+static pending_lookup_t *new_pending_lookup(rooms_t *room, const char *song_hash)
 {
-    size_t realsize = size * nmemb;
-    struct ResponseData *mem = (struct ResponseData *)userp;
-
-    char *ptr = realloc(mem->data, mem->size + realsize + 1);
-    if (!ptr)
-        return 0;
+    pending_lookup_t *pending = (pending_lookup_t *)malloc(sizeof(pending_lookup_t));
+    if (!pending)
+    {
+        lwsl_err("Failed to allocate memory for pending_lookup_t\n");
+        return NULL;
+    }
+    memset(pending, 0, sizeof(pending_lookup_t));
+    strncpy(pending->room_id, room->room_id, sizeof(pending->room_id) - 1);
+    strncpy(pending->song_hash, song_hash, sizeof(pending->song_hash) - 1);
+    return pending;
+}
 
-    mem->data = ptr;
-    memcpy(&(mem->data[mem->size]), contents, realsize);
-    mem->size += realsize;
-    mem->data[mem->size] = 0;
+// 解析歌词搜索结果，拼接为最终的歌词 url
+static int parse_lyrics_url(const char *data, char *lyrics_url, size_t size)
+{
+    cJSON *root = cJSON_Parse(data);
+    if (!root)
+    {
+        const char *error_ptr = cJSON_GetErrorPtr();
+        lwsl_err("JSON 解析错误: %s\n", error_ptr ? error_ptr : "");
+        return -1;
+    }
+    cJSON *candidates = cJSON_GetObjectItem(root, "candidates");
+    cJSON *candidate = cJSON_GetArrayItem(candidates, 0);
+    cJSON *id = cJSON_GetObjectItem(candidate, "id");
+    cJSON *accesskey = cJSON_GetObjectItem(candidate, "accesskey");
+    if (!cJSON_IsArray(candidates) || !cJSON_IsString(id) || !cJSON_IsString(accesskey))
+    {
+        lwsl_err("JSON 解析错误");
+        cJSON_Delete(root);
+        return -1;
+    }
+    // 拼接歌词 url
+    snprintf(lyrics_url, size, "%s/lyric?id=%s&accesskey=%s&decode=true&fmt=lrc", g_config.upstream_url, id->valuestring, accesskey->valuestring);
+    cJSON_Delete(root);
+    return 0;
+}
 
-    return realsize;
+// 解析歌曲 url 查询结果
+static int parse_song_url(const char *data, char *song_url, size_t size)
+{
+    cJSON *root = cJSON_Parse(data);
+    if (!root)
+    {
+        const char *error_ptr = cJSON_GetErrorPtr();
+        lwsl_err("JSON 解析错误: %s\n", error_ptr ? error_ptr : "");
+        return -1;
+    }
+    cJSON *urls = cJSON_GetObjectItem(root, "url");
+    cJSON *url_obj = cJSON_GetArrayItem(urls, 0);
+    if (!cJSON_IsArray(urls) || !cJSON_IsString(url_obj))
+    {
+        lwsl_err("JSON 解析错误");
+        cJSON_Delete(root);
+        return -1;
+    }
+    snprintf(song_url, size, "%s", url_obj->valuestring);
+    cJSON_Delete(root);
+    return 0;
 }
 
-// 通用的HTTP请求函数
-struct ResponseData *http_request(const char *url,
-                                  const char *method,
-                                  const char *post_data,
-                                  struct curl_slist *headers)
+// 向房间广播当前歌曲信息
+static void broadcast_cur_song_info(rooms_t *room)
 {
-    CURL *curl;
-    CURLcode res;
-    struct ResponseData *response;
+    msg_buf_t *buf = get_cur_song_info(room, BROADCAST_SONG_INFO);
+    if (buf)
+    {
+        broadcast_buf_room(room, buf, BROADCAST_SONG_INFO);
+        msg_buf_unref(buf);
+    }
+}
 
-    response = malloc(sizeof(struct ResponseData));
-    response->data = malloc(1);
-    response->size = 0;
+// 上游查询的上下文
+typedef struct upstream_lookup
+{
+    enum song_cache_kind kind;
+    char song_hash[128];
+} upstream_lookup_t;
 
-    curl = curl_easy_init();
-    if (!curl)
+// 上游查询完成：解析结果写入缓存，缓存负责回调所有等待者
+static void upstream_lookup_done(const char *data, size_t size, void *arg)
+{
+    upstream_lookup_t *lookup = (upstream_lookup_t *)arg;
+    char value[256] = {0};
+    int ret = -1;
+    if (data)
     {
-        free(response->data);
-        free(response);
-        return NULL;
+        ret = lookup->kind == SONG_CACHE_SONG_URL ? parse_song_url(data, value, sizeof(value))
+                                                  : parse_lyrics_url(data, value, sizeof(value));
     }
+    song_cache_complete(lookup->kind, lookup->song_hash, ret < 0 ? NULL : value);
+    free(lookup);
+}
 
-    // 基本设置
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)response);
+// 查询歌曲 url / 歌词 url：先查缓存，相同 song_hash 的并发查询只请求一次上游
+static int resolve_song_data(enum song_cache_kind kind, const char *song_hash, song_cache_cb cb, void *arg)
+{
+    enum song_cache_result result = song_cache_acquire(kind, song_hash, cb, arg);
+    if (result == SONG_CACHE_ERROR)
+        return -1;
+    if (result != SONG_CACHE_MISS)
+        return 0;
 
-    // 方法设置
-    if (strcmp(method, "POST") == 0)
+    upstream_lookup_t *lookup = (upstream_lookup_t *)malloc(sizeof(upstream_lookup_t));
+    if (!lookup)
     {
-        curl_easy_setopt(curl, CURLOPT_POST, 1L);
-        if (post_data)
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_data);
+        lwsl_err("Failed to allocate memory for upstream_lookup_t\n");
+        song_cache_complete(kind, song_hash, NULL);
+        return 0;
     }
-    else if (strcmp(method, "PUT") == 0)
+    lookup->kind = kind;
+    snprintf(lookup->song_hash, sizeof(lookup->song_hash), "%s", song_hash);
+    enum upstream_endpoint endpoint = kind == SONG_CACHE_SONG_URL ? UPSTREAM_SONG_URL : UPSTREAM_SEARCH_LYRIC;
+    if (upstream_get(endpoint, song_hash, upstream_lookup_done, lookup) < 0)
     {
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
-        if (post_data)
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_data);
+        free(lookup);
+        song_cache_complete(kind, song_hash, NULL);
     }
-    else if (strcmp(method, "DELETE") == 0)
+    return 0;
+}
+
+// 歌词 url 查询完成：回填到播放列表，正在播放时同步更新并广播
+static void lyrics_url_ready(const char *song_hash, const char *lyrics_url, void *arg)
+{
+    pending_lookup_t *pending = (pending_lookup_t *)arg;
+    rooms_t *room = find_room(shard_rooms(shard_current()), pending->room_id);
+    if (!room || !lyrics_url)
+    {
+        free(pending);
+        return;
+    }
+    playlist_t *song = playlist_index_find(&room->playlist_index, pending->song_hash);
+    if (song)
+    {
+        strncpy(song->lyrics_url, lyrics_url, sizeof(song->lyrics_url) - 1);
+    }
+    if (strcmp(room->playing_info.song_hash, pending->song_hash) == 0 &&
+        strcmp(room->playing_info.lyrics_url, lyrics_url) != 0)
+    {
+        pthread_mutex_lock(&room->playing_info.lock);
+        strncpy(room->playing_info.lyrics_url, lyrics_url, sizeof(room->playing_info.lyrics_url) - 1);
+        pthread_mutex_unlock(&room->playing_info.lock);
+        broadcast_cur_song_info(room);
+    }
+    free(pending);
+}
+
+// 异步获取歌词 url
+static int request_lyrics_url(rooms_t *room, const char *song_hash)
+{
+    pending_lookup_t *pending = new_pending_lookup(room, song_hash);
+    if (!pending)
+        return -1;
+    if (resolve_song_data(SONG_CACHE_LYRICS_URL, song_hash, lyrics_url_ready, pending) < 0)
     {
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+        free(pending);
+        return -1;
     }
+    return 0;
+}
 
-    // 头部设置
-    if (headers)
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+// 当前播放位置（微秒），由单调时钟按需计算，不再周期性累加
+lws_usec_t get_played_us(playing_info_t *playing_info)
+{
+    if (!playing_info->started_us)
+        return 0;
+    lws_usec_t now = playing_info->paused_at_us ? playing_info->paused_at_us : lws_now_usecs();
+    lws_usec_t played = now - playing_info->started_us - playing_info->paused_total_us;
+    if (played < 0)
+        played = 0;
+    if (playing_info->duration_us && played > playing_info->duration_us)
+        played = playing_info->duration_us;
+    return played;
+}
 
-    // 其他选项
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "MyCurlClient/1.0");
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+// 当前播放进度 0~1
+double get_played_percent(playing_info_t *playing_info)
+{
+    if (!playing_info->duration_us)
+        return 0;
+    return (double)get_played_us(playing_info) / (double)playing_info->duration_us;
+}
 
-    // 执行请求
-    res = curl_easy_perform(curl);
+static void playback_timer_callback(lws_sorted_usec_list_t *sul);
 
-    if (res != CURLE_OK)
+// 按精确时间布置下一次唤醒：预取点或者歌曲结束，暂停时不占用定时器
+static void schedule_playback(rooms_t *room)
+{
+    playing_info_t *playing_info = &room->playing_info;
+    if (!playing_info->is_playing)
+    {
+        lws_sul_cancel(&playing_info->timer);
+        return;
+    }
+    if (playing_info->duration_us <= 0)
     {
-        lwsl_err("Failed to perform HTTP request: %s--:%s", url, curl_easy_strerror(res));
-        free(response->data);
-        free(response);
-        response = NULL;
+        // 时长未知（旧数据或异常值）时不自动切歌，等客户端切歌；
+        // 不能按 0 立即到期，否则下一首 url 命中缓存时会同步重新布置，每轮事件循环都切一次歌
+        lws_sul_cancel(&playing_info->timer);
+        return;
     }
+    lws_usec_t played = get_played_us(playing_info);
+    lws_usec_t wake_us = playing_info->duration_us - played;
+    if (!playing_info->prefetch_started && g_config.prefetch_threshold < 1)
+    {
+        lws_usec_t prefetch_us = (lws_usec_t)(playing_info->duration_us * g_config.prefetch_threshold) - played;
+        if (prefetch_us < wake_us)
+            wake_us = prefetch_us > 0 ? prefetch_us : 0;
+    }
+    lws_sul_schedule(context, room->tsi, &playing_info->timer, playback_timer_callback, wake_us);
+}
 
-    curl_easy_cleanup(curl);
-    return response;
+// 歌曲结束/预取定时器
+static void playback_timer_callback(lws_sorted_usec_list_t *sul)
+{
+    playing_info_t *playing_info = lws_container_of(sul, playing_info_t, timer);
+    rooms_t *room = playing_info->room;
+    if (!playing_info->is_playing)
+        return;
+    lws_usec_t played = get_played_us(playing_info);
+    if (played >= playing_info->duration_us)
+    {
+        // 播放结束，切到下一首（url 就绪后重新布置定时器）
+        play_next_song_bysystem(room);
+        return;
+    }
+    // 超过预取阈值，提前准备下一首
+    if (!playing_info->prefetch_started && g_config.prefetch_threshold < 1 &&
+        played >= (lws_usec_t)(playing_info->duration_us * g_config.prefetch_threshold))
+    {
+        prefetch_next_song(room);
+    }
+    schedule_playback(room);
 }
 
-// 获取歌词 url
-char *get_lyrics_url(const char *song_hash)
+// 周期性进度广播只在播放中且有客户端订阅时运行
+void update_progress_timer(rooms_t *room)
 {
-    struct ResponseData *response;
-    char url[256] = {0};
-    char *lyrics_url = (char *)malloc(256);
-    memset(lyrics_url, 0, 256);
-    if (!song_hash)
+    playing_info_t *playing_info = &room->playing_info;
+    if (playing_info->is_playing && playing_info->started_us && room->progress_subscribers)
+    {
+        lws_sul_schedule(context, room->tsi, &playing_info->progress_timer, progress_timer_callback,
+                         g_config.progress_interval_ms * LWS_US_PER_MS);
+    }
+    else
     {
-        free(lyrics_url);
+        lws_sul_cancel(&playing_info->progress_timer);
+    }
+}
+
+// 播放锚点：服务器时间 + 播放位置 + 速率，客户端据此自行推算进度
+const char *get_playback_anchor_json(rooms_t *room)
+{
+    lws_usec_t serialize_us = latency_serialize_begin();
+    playing_info_t *playing = &room->playing_info;
+    cJSON *root = cJSON_CreateObject();
+    if (!root)
+        return NULL;
+    cJSON *data = cJSON_CreateObject();
+    if (!data)
+    {
+        cJSON_Delete(root);
         return NULL;
     }
+    pthread_mutex_lock(&playing->lock);
+    cJSON_AddNumberToObject(root, "error_code", SUCCESS);
+    cJSON_AddStringToObject(root, "status", "success");
+    cJSON_AddNumberToObject(root, "action", BROADCAST_PLAYBACK_ANCHOR);
+    cJSON_AddStringToObject(data, "songhash", playing->song_hash);
+    cJSON_AddNumberToObject(data, "server_time_ms", lws_now_usecs() / 1000.0);
+    cJSON_AddNumberToObject(data, "position_ms", get_played_us(playing) / 1000.0);
+    cJSON_AddNumberToObject(data, "duration_ms", playing->duration_us / 1000.0);
+    cJSON_AddNumberToObject(data, "rate", playing->is_playing && playing->started_us ? 1 : 0);
+    cJSON_AddItemToObject(root, "data", data);
+    pthread_mutex_unlock(&playing->lock);
+    const char *json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    latency_serialize_end(serialize_us);
+    return json_str;
+}
 
-    // 拼接url
-    snprintf(url, sizeof(url), "http://%s:%d/search/lyric?hash=%s", SERVICE_IP_ADDRESS, SERVICE_PORT, song_hash);
-    response = http_request(url, "GET", NULL, NULL);
-    if (!response)
+// 播放状态变化时广播锚点（只在状态变化时发送，不再周期性推送）
+static void broadcast_playback_anchor(rooms_t *room)
+{
+    const char *json = get_playback_anchor_json(room);
+    if (json)
     {
-        free(lyrics_url);
-        return "";
+        broadcast_response_room(room, json, BROADCAST_PLAYBACK_ANCHOR);
+        free((char *)json);
     }
-    // 开始解析接收到的 json 数据，拼接为最终的歌词 url
-    cJSON *root = cJSON_Parse(response->data);
-    if (!root)
+}
+
+// 歌曲 url 就绪，开始播放并广播
+static void start_playback(rooms_t *room, const char *song_url)
+{
+    playing_info_t *playing_info = &room->playing_info;
+    pthread_mutex_lock(&playing_info->lock);
+    strncpy(playing_info->song_url, song_url, sizeof(playing_info->song_url) - 1);
+    playing_info->is_playing = 1;
+    playing_info->started_us = lws_now_usecs();
+    playing_info->paused_at_us = 0;
+    playing_info->paused_total_us = 0;
+    pthread_mutex_unlock(&playing_info->lock);
+    schedule_playback(room);
+    update_progress_timer(room);
+    broadcast_cur_song_info(room);
+    broadcast_playback_anchor(room);
+}
+
+static void url_retry_callback(lws_sorted_usec_list_t *sul);
+
+// 歌曲 url 查询完成：仍是当前歌曲时开始播放并广播
+static void song_url_ready(const char *song_hash, const char *song_url, void *arg)
+{
+    pending_lookup_t *pending = (pending_lookup_t *)arg;
+    // 开始播放的广播归到发起切歌的命令下
+    latency_trace_t *prev = latency_resume(pending->trace, pending->wait_us);
+    rooms_t *room = find_room(shard_rooms(shard_current()), pending->room_id);
+    // 房间已销毁或者期间已经切歌时不再播放
+    if (room && strcmp(room->playing_info.song_hash, pending->song_hash) == 0)
     {
-        const char *error_ptr = cJSON_GetErrorPtr();
-        if (error_ptr != NULL)
+        if (song_url)
         {
-            char msg[128] = {0};
-            sprintf(msg, "JSON 解析错误:%s", error_ptr);
-            lwsl_err("JSON 解析错误: %s\n", error_ptr);
-            cJSON_Delete(root);
-            free(response->data);
-            free(response);
-            free(lyrics_url);
-            return "";
+            start_playback(room, song_url);
+        }
+        else
+        {
+            // 没有 url 不能开始播放：等熔断冷却后重试，不在这里直接切歌，避免上游故障时同步连环切歌
+            lwsl_err("获取歌曲 url 失败: %s\n", pending->song_hash);
+            lws_sul_schedule(context, room->tsi, &room->playing_info.url_retry_timer, url_retry_callback,
+                             (lws_usec_t)g_config.breaker_cooldown_ms * LWS_US_PER_MS);
         }
-        return "";
     }
-    cJSON *candidates = cJSON_GetObjectItem(root, "candidates");
-    if (!cJSON_IsArray(candidates))
+    latency_leave(prev);
+    latency_trace_unref(pending->trace);
+    free(pending);
+}
+
+// 异步获取歌曲 url（缓存命中时同步完成）
+static int request_song_url(rooms_t *room, const char *song_hash)
+{
+    pending_lookup_t *pending = new_pending_lookup(room, song_hash);
+    if (!pending)
+        return -1;
+    pending->trace = latency_hold(&pending->wait_us);
+    if (resolve_song_data(SONG_CACHE_SONG_URL, song_hash, song_url_ready, pending) < 0)
     {
-        lwsl_err("JSON 解析错误");
-        cJSON_Delete(root);
-        free(response->data);
-        free(response);
-        free(lyrics_url);
-        return "";
+        latency_trace_unref(pending->trace);
+        free(pending);
+        return -1;
     }
-    cJSON *candidate = cJSON_GetArrayItem(candidates, 0);
-    cJSON *id = cJSON_GetObjectItem(candidate, "id");
-    cJSON *accesskey = cJSON_GetObjectItem(candidate, "accesskey");
-    // 拼接歌词 url
-    snprintf(lyrics_url, 255, "http://%s:%d/lyric?id=%s&accesskey=%s&decode=true&fmt=lrc", SERVICE_IP_ADDRESS, SERVICE_PORT, id->valuestring, accesskey->valuestring);
-    free(response->data);
-    free(response);
-    cJSON_Delete(root);
-    return lyrics_url;
+    return 0;
 }
 
-// 获取歌曲 url
-char *get_song_url(const char *song_hash)
+// 歌曲 url 重试定时器：第一次到期时重新获取，重试仍失败则跳到下一首
+static void url_retry_callback(lws_sorted_usec_list_t *sul)
 {
-    struct ResponseData *response;
-    char url[256] = {0};
-    char *song_url = (char *)malloc(256);
-    memset(song_url, 0, 256);
-    if (!song_hash)
+    playing_info_t *playing_info = lws_container_of(sul, playing_info_t, url_retry_timer);
+    rooms_t *room = playing_info->room;
+    if (playing_info->started_us)
+        return;
+    if (!playing_info->url_retried)
     {
-        free(song_url);
+        playing_info->url_retried = 1;
+        if (request_song_url(room, playing_info->song_hash) == 0)
+            return;
+    }
+    lwsl_err("歌曲 url 重试仍失败，跳过: %s\n", playing_info->song_hash);
+    play_next_song_bysystem(room);
+}
+
+// 当前歌曲的下一首（播放列表结束后回到开头）
+static playlist_t *next_song_of(rooms_t *room)
+{
+    if (!room->current_song)
         return NULL;
+    return room->current_song->next ? room->current_song->next : room->playlist_head->next;
+}
+
+// 预加载提示：把下一首的播放地址提前推给客户端缓冲
+static const char *get_preload_hint_json(rooms_t *room, playlist_t *next)
+{
+    cJSON *root = cJSON_CreateObject();
+    if (!root)
+        return NULL;
+    cJSON *data = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "error_code", SUCCESS);
+    cJSON_AddStringToObject(root, "status", "success");
+    cJSON_AddNumberToObject(root, "action", BROADCAST_PRELOAD_HINT);
+    cJSON_AddStringToObject(data, "songname", next->song_name);
+    cJSON_AddStringToObject(data, "songhash", next->song_hash);
+    cJSON_AddStringToObject(data, "singername", next->singer_name);
+    cJSON_AddStringToObject(data, "album_name", next->album_name);
+    cJSON_AddStringToObject(data, "duration", next->duration);
+    cJSON_AddStringToObject(data, "lyrics_url", next->lyrics_url);
+    cJSON_AddStringToObject(data, "song_url", room->playing_info.next_song_url);
+    cJSON_AddStringToObject(data, "cover_url", next->cover_url);
+    cJSON_AddItemToObject(root, "data", data);
+    const char *json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json_str;
+}
+
+// 预取完成：暂存下一首的 url 并推送预加载提示
+static void prefetch_ready(const char *song_hash, const char *song_url, void *arg)
+{
+    pending_lookup_t *pending = (pending_lookup_t *)arg;
+    rooms_t *room = find_room(shard_rooms(shard_current()), pending->room_id);
+    playlist_t *next = room ? next_song_of(room) : NULL;
+    if (!song_url || !next || strcmp(room->playing_info.next_song_hash, pending->song_hash) != 0 ||
+        strcmp(next->song_hash, pending->song_hash) != 0)
+    {
+        // 预取失败或者期间播放列表已变化，切歌时按正常流程获取
+        free(pending);
+        return;
     }
-    // 拼接url
-    snprintf(url, sizeof(url), "http://%s:%d/song/url?hash=%s", SERVICE_IP_ADDRESS, SERVICE_PORT, song_hash);
-    response = http_request(url, "GET", NULL, NULL);
-    if (!response)
+    pthread_mutex_lock(&room->playing_info.lock);
+    strncpy(room->playing_info.next_song_url, song_url, sizeof(room->playing_info.next_song_url) - 1);
+    pthread_mutex_unlock(&room->playing_info.lock);
+    const char *hint_json = get_preload_hint_json(room, next);
+    if (hint_json)
     {
-        free(song_url);
-        return "";
+        broadcast_response_room(room, hint_json, BROADCAST_PRELOAD_HINT);
+        free((char *)hint_json);
     }
-    cJSON *root = cJSON_Parse(response->data);
-    if (!root)
+    free(pending);
+}
+
+// 预取下一首的播放 url（每首歌只触发一次）
+int prefetch_next_song(rooms_t *room)
+{
+    if (!room || room->playing_info.prefetch_started)
+        return -1;
+    playlist_t *next = next_song_of(room);
+    if (!next)
+        return -1;
+    room->playing_info.prefetch_started = 1;
+    strncpy(room->playing_info.next_song_hash, next->song_hash, sizeof(room->playing_info.next_song_hash) - 1);
+    room->playing_info.next_song_url[0] = '\0';
+    lwsl_notice("房间 %s 预取下一首: %s\n", room->room_id, next->song_name);
+    pending_lookup_t *pending = new_pending_lookup(room, next->song_hash);
+    if (!pending)
+        return -1;
+    if (resolve_song_data(SONG_CACHE_SONG_URL, next->song_hash, prefetch_ready, pending) < 0)
     {
-        const char *error_ptr = cJSON_GetErrorPtr();
-        if (error_ptr != NULL)
-        {
-            char msg[128] = {0};
-            sprintf(msg, "JSON 解析错误:%s", error_ptr);
-            lwsl_err("JSON 解析错误: %s\n", error_ptr);
-            cJSON_Delete(root);
-            free(response->data);
-            free(response);
-            free(song_url);
-            return "";
-        }
-        return "";
+        free(pending);
+        return -1;
     }
-    cJSON *urls = cJSON_GetObjectItem(root, "url");
-    if (!cJSON_IsArray(urls))
+    return 0;
+}
+
+// 播放列表变化后下一首可能改变，允许重新预取
+static void reset_prefetch(rooms_t *room)
+{
+    room->playing_info.prefetch_started = 0;
+    room->playing_info.next_song_hash[0] = '\0';
+    room->playing_info.next_song_url[0] = '\0';
+}
+
+// 播放列表变化后，下一首与已预取的不一致时重新预取
+static void refresh_prefetch(rooms_t *room)
+{
+    playlist_t *next = next_song_of(room);
+    if (room->playing_info.prefetch_started && (!next || strcmp(next->song_hash, room->playing_info.next_song_hash) != 0))
     {
-        lwsl_err("JSON 解析错误");
-        cJSON_Delete(root);
-        free(response->data);
-        free(response);
-        free(song_url);
-        return "";
+        reset_prefetch(room);
     }
-    cJSON *url_obj = cJSON_GetArrayItem(urls, 0);
-    strncpy(song_url, url_obj->valuestring, 255);
-    free(response->data);
-    free(response);
-    cJSON_Delete(root);
-    return song_url;
 }
 
-// 获取该房间所有的客户端信息
-const char *get_client_list_json(rooms_t *room, enum ctrl cmd)
+// 分页获取该房间的客户端信息：跳过前 offset 个，最多返回 limit 个，total 为成员总数
+const char *get_client_list_json(rooms_t *room, unsigned int offset, unsigned int limit, enum ctrl cmd)
 {
+    if (!room)
+        return NULL;
+    lws_usec_t serialize_us = latency_serialize_begin();
     cJSON *root = cJSON_CreateObject();
-    cJSON *client_list = cJSON_CreateArray();
-    client_info_t *client = room->client_info->next;
-    if (!room || !root)
+    if (!root)
         return NULL;
+    cJSON *client_list = cJSON_CreateArray();
+    unsigned int index = 0;
 
     pthread_mutex_lock(&room->lock);
-    while (client)
+    for (client_info_t *client = room->client_info->next; client && index < offset + limit; client = client->next, index++)
     {
+        if (index < offset)
+            continue;
         cJSON *client_info = cJSON_CreateObject();
         cJSON_AddStringToObject(client_info, "ip", client->ip);
         cJSON_AddStringToObject(client_info, "userId", client->userId);
-        cJSON_AddNumberToObject(client_info, "client_counter", room->client_counter);
+        cJSON_AddNumberToObject(client_info, "queue_depth", client->queue_len);
+        cJSON_AddNumberToObject(client_info, "queue_drops", client->queue_drops);
         cJSON_AddItemToArray(client_list, client_info);
-        client = client->next;
     }
+    cJSON_AddNumberToObject(root, "total", room->client_counter);
     pthread_mutex_unlock(&room->lock);
+    cJSON_AddNumberToObject(root, "offset", offset);
     cJSON_AddItemToObject(root, "client_list", client_list);
     cJSON_AddNumberToObject(root, "action", cmd);
     cJSON_AddStringToObject(root, "status", "success");
     cJSON_AddNumberToObject(root, "error_code", SUCCESS);
-    const char *json = cJSON_Print(root);
+    const char *json = cJSON_PrintUnformatted(root);
     cJSON_Delete(root);
+    latency_serialize_end(serialize_us);
     return json;
 }
 
+// 从播放列表链表摘下节点（索引不变）
+static void playlist_unlink(rooms_t *room, playlist_t *song)
+{
+    song->prev->next = song->next;
+    if (song->next)
+    {
+        song->next->prev = song->prev;
+    }
+    else
+    {
+        room->playlist_tail = song->prev;
+    }
+    song->next = NULL;
+    song->prev = NULL;
+}
+
+// 把节点接到 pos 后面（pos 可以是头节点）
+static void playlist_link_after(rooms_t *room, playlist_t *pos, playlist_t *song)
+{
+    song->prev = pos;
+    song->next = pos->next;
+    if (pos->next)
+    {
+        pos->next->prev = song;
+    }
+    else
+    {
+        room->playlist_tail = song;
+    }
+    pos->next = song;
+}
+
+// 播放列表增量消息：每条带递增的版本号，客户端发现版本不连续时用 GET_PLAYLIST 重新拉取全量。
+// 插入和移动用 after（前一首歌的 songhash，空串表示列表开头）表示位置，双方都按 songhash 索引定位，不用数下标
+#define PLAYLIST_DELTA_HEAD "{\"error_code\":0,\"status\":\"success\",\"action\":%d,\"data\":{\"version\":%f,"
+static msg_template_t g_tpl_delta_insert = MSG_TEMPLATE_INIT(
+    PLAYLIST_DELTA_HEAD "\"op\":\"insert\",\"after\":\"%s\",\"song\":{\"songname\":\"%s\",\"songhash\":\"%s\","
+                        "\"singername\":\"%s\",\"album_name\":\"%s\",\"duration\":\"%s\",\"cover_url\":\"%s\"}}}");
+static msg_template_t g_tpl_delta_remove = MSG_TEMPLATE_INIT(
+    PLAYLIST_DELTA_HEAD "\"op\":\"remove\",\"songhash\":\"%s\"}}");
+static msg_template_t g_tpl_delta_move = MSG_TEMPLATE_INIT(
+    PLAYLIST_DELTA_HEAD "\"op\":\"move\",\"songhash\":\"%s\",\"after\":\"%s\"}}");
+static msg_template_t g_tpl_delta_current = MSG_TEMPLATE_INIT(
+    PLAYLIST_DELTA_HEAD "\"op\":\"current\",\"songhash\":\"%s\"}}");
+
+// 歌曲在播放列表中的位置：前一首歌的 songhash，排在最前面时为空串
+static const char *playlist_anchor(rooms_t *room, playlist_t *song)
+{
+    return song->prev && song->prev != room->playlist_head ? song->prev->song_hash : "";
+}
+
+// 歌曲插入到 after 之后
+static msg_buf_t *playlist_delta_insert(rooms_t *room, playlist_t *song)
+{
+    return msg_template_render(&g_tpl_delta_insert, (int)BROADCAST_PLAYLIST_DELTA, (double)++room->playlist_version,
+                               playlist_anchor(room, song), song->song_name, song->song_hash, song->singer_name,
+                               song->album_name, song->duration, song->cover_url);
+}
+
+// 歌曲被删除
+static msg_buf_t *playlist_delta_remove(rooms_t *room, playlist_t *song)
+{
+    return msg_template_render(&g_tpl_delta_remove, (int)BROADCAST_PLAYLIST_DELTA, (double)++room->playlist_version,
+                               song->song_hash);
+}
+
+// 歌曲移动到 after 之后
+static msg_buf_t *playlist_delta_move(rooms_t *room, playlist_t *song)
+{
+    return msg_template_render(&g_tpl_delta_move, (int)BROADCAST_PLAYLIST_DELTA, (double)++room->playlist_version,
+                               song->song_hash, playlist_anchor(room, song));
+}
+
+// 当前歌曲变化，播放列表为空时 songhash 为空串
+static msg_buf_t *playlist_delta_current(rooms_t *room)
+{
+    return msg_template_render(&g_tpl_delta_current, (int)BROADCAST_PLAYLIST_DELTA, (double)++room->playlist_version,
+                               room->current_song ? room->current_song->song_hash : "");
+}
+
+// 广播增量消息（不能持有 room->lock，广播时要再次加锁遍历成员）
+static void broadcast_playlist_delta(rooms_t *room, msg_buf_t *delta)
+{
+    if (delta)
+    {
+        broadcast_buf_room(room, delta, BROADCAST_PLAYLIST_DELTA);
+        msg_buf_unref(delta);
+    }
+}
+
+// 播放列表被删空：停止播放并清空正在播放的信息
+static void stop_playback(rooms_t *room)
+{
+    playing_info_t *playing_info = &room->playing_info;
+    pthread_mutex_lock(&playing_info->lock);
+    lws_sul_cancel(&playing_info->timer);
+    lws_sul_cancel(&playing_info->progress_timer);
+    lws_sul_cancel(&playing_info->url_retry_timer);
+    playing_info->url_retried = 0;
+    playing_info->song_name[0] = '\0';
+    playing_info->song_hash[0] = '\0';
+    playing_info->song_url[0] = '\0';
+    playing_info->singer_name[0] = '\0';
+    playing_info->album_name[0] = '\0';
+    playing_info->duration[0] = '\0';
+    playing_info->lyrics_url[0] = '\0';
+    playing_info->cover_url[0] = '\0';
+    playing_info->is_playing = 0;
+    playing_info->duration_us = 0;
+    playing_info->started_us = 0;
+    playing_info->paused_at_us = 0;
+    playing_info->paused_total_us = 0;
+    reset_prefetch(room);
+    pthread_mutex_unlock(&playing_info->lock);
+    broadcast_playlist_delta(room, playlist_delta_current(room));
+    broadcast_cur_song_info(room);
+}
+
+// 歌曲时长（秒）须是正的有限数字，且不超过一天，避免换算成微秒时溢出
+static bool valid_duration(const char *duration)
+{
+    char *end = NULL;
+    double seconds = strtod(duration, &end);
+    return end != duration && *end == '\0' && isfinite(seconds) && seconds > 0 && seconds <= 86400;
+}
+
 int insert_song_to_playlist(client_info_t *client, const char *song_name, const char *song_hash,
                             const char *singer_name, const char *album_name,
                             const char *duration, const char *cover_url)
@@ -257,6 +668,17 @@ int insert_song_to_playlist(client_info_t *client, const char *song_name, const
     {
         return -1;
     }
+    if (!duration || !valid_duration(duration))
+    {
+        lwsl_err("歌曲时长无效: %s\n", duration ? duration : "(null)");
+        return -1;
+    }
+    // song_hash 是索引键，同一首歌不能重复加入
+    if (playlist_index_find(&room->playlist_index, song_hash))
+    {
+        lwsl_err("歌曲已在播放列表中: %s\n", song_hash);
+        return -1;
+    }
 
     playlist_t *new_song = (playlist_t *)malloc(sizeof(playlist_t));
     if (!new_song)
@@ -271,17 +693,16 @@ int insert_song_to_playlist(client_info_t *client, const char *song_name, const
     strncpy(new_song->album_name, album_name, sizeof(new_song->album_name) - 1);
     strncpy(new_song->duration, duration, sizeof(new_song->duration) - 1);
     strncpy(new_song->cover_url, cover_url, sizeof(new_song->cover_url) - 1);
-    new_song->next = NULL;
-
-    char *lyrics_url = get_lyrics_url(song_hash);
-    // 获取歌词 url 并且填充进去
-    strncpy(new_song->lyrics_url, lyrics_url, sizeof(new_song->lyrics_url));
-    free(lyrics_url);
+    if (!playlist_index_insert(&room->playlist_index, new_song))
+    {
+        free(new_song);
+        return -1;
+    }
 
     // 插入到播放列表末尾
-    playlist_t *tail = room->playlist_tail;
-    tail->next = new_song;
-    room->playlist_tail = new_song;
+    playlist_link_after(room, room->playlist_tail, new_song);
+    refresh_prefetch(room);
+    broadcast_playlist_delta(room, playlist_delta_insert(room, new_song));
 
     // 如果是第一首歌曲，则更新当前歌曲信息
     if (room->current_song == NULL)
@@ -289,6 +710,8 @@ int insert_song_to_playlist(client_info_t *client, const char *song_name, const
         room->current_song = new_song;
         update_playing_info(room);
     }
+    // 异步获取歌词 url，完成后回填
+    request_lyrics_url(room, song_hash);
     char message[128] = {0};
     snprintf(message, sizeof(message), "添加歌曲：%s", song_name);
     init_room_action(room, client->userId, ADD_SONG_TO_PLAYLIST, message);
@@ -306,29 +729,35 @@ int remove_song_from_playlist(client_info_t *client, const char *song_hash)
         return -1;
     }
 
-    playlist_t *prev = room->playlist_head;
-    playlist_t *curr = prev->next;
-
-    while (curr)
+    playlist_t *curr = playlist_index_find(&room->playlist_index, song_hash);
+    if (!curr)
     {
-        if (strcmp(curr->song_hash, song_hash) == 0)
-        {
-            char message[256] = {0};
-            snprintf(message, sizeof(message), "删除歌曲：%s", curr->song_name);
-            init_room_action(room, client->userId, REMOVE_SONG_FROM_PLAYLIST, message);
-            prev->next = curr->next;
-            if (curr == room->playlist_tail)
-            {
-                room->playlist_tail = prev;
-            }
-            free(curr);
-            return 0;
-        }
-        prev = curr;
-        curr = curr->next;
+        return -1; // 未找到歌曲
     }
+    char message[256] = {0};
+    snprintf(message, sizeof(message), "删除歌曲：%s", curr->song_name);
+    init_room_action(room, client->userId, REMOVE_SONG_FROM_PLAYLIST, message);
 
-    return -1; // 未找到歌曲
+    // 删除的是正在播放的歌曲时切到下一首，列表删空则停止播放
+    int was_current = curr == room->current_song;
+    playlist_t *next = was_current ? next_song_of(room) : NULL;
+    if (next == curr)
+    {
+        next = NULL;
+    }
+    msg_buf_t *delta = playlist_delta_remove(room, curr);
+    playlist_index_remove(&room->playlist_index, curr);
+    playlist_unlink(room, curr);
+    free(curr);
+    broadcast_playlist_delta(room, delta);
+    if (was_current)
+    {
+        room->current_song = next;
+        next ? update_playing_info(room) : stop_playback(room);
+        return 0;
+    }
+    refresh_prefetch(room);
+    return 0;
 }
 // 切换正在播放的歌曲信息
 int update_playing_info(rooms_t *room)
@@ -340,6 +769,7 @@ int update_playing_info(rooms_t *room)
 
     playlist_t *curr = room->current_song;
     playing_info_t *playing_info = &room->playing_info;
+    broadcast_playlist_delta(room, playlist_delta_current(room));
 
     pthread_mutex_lock(&playing_info->lock);
 
@@ -350,24 +780,42 @@ int update_playing_info(rooms_t *room)
     strncpy(playing_info->duration, curr->duration, sizeof(playing_info->duration) - 1);
     strncpy(playing_info->lyrics_url, curr->lyrics_url, sizeof(playing_info->lyrics_url) - 1);
     strncpy(playing_info->cover_url, curr->cover_url, sizeof(playing_info->cover_url) - 1);
-    // 获取歌曲 url 填充进去
-    char *song_url = get_song_url(curr->song_hash);
-    strncpy(playing_info->song_url, song_url, sizeof(playing_info->song_url));
-    free(song_url);
-    playing_info->played_percent = 0; // 重置播放进度
-    playing_info->is_playing = 1;     // 设置为正在播放
-    playing_info->start_time = time(NULL);
-    playing_info->last_update_time = playing_info->start_time;
-    lws_sul_schedule(context, 0, &playing_info->timer, timer_callback, 1 * LWS_US_PER_SEC);
+    playing_info->song_url[0] = '\0';
+    playing_info->duration_us = (lws_usec_t)(atof(curr->duration) * LWS_US_PER_SEC);
+    playing_info->started_us = 0; // 重置播放进度
+    playing_info->paused_at_us = 0;
+    playing_info->paused_total_us = 0;
+    playing_info->is_playing = 0; // 歌曲 url 就绪后才开始播放
+    playing_info->url_retried = 0;
+    lws_sul_cancel(&playing_info->timer);
+    lws_sul_cancel(&playing_info->progress_timer);
+    lws_sul_cancel(&playing_info->url_retry_timer);
+    // 取出预取暂存的 url，重新开始下一首的预取
+    char staged_url[256] = {0};
+    if (strcmp(playing_info->next_song_hash, curr->song_hash) == 0)
+    {
+        strncpy(staged_url, playing_info->next_song_url, sizeof(staged_url) - 1);
+    }
+    reset_prefetch(room);
     pthread_mutex_unlock(&playing_info->lock);
 
+    // 已经预取到的直接开始播放，否则异步获取歌曲 url，完成后开始播放并广播
+    if (strlen(staged_url))
+    {
+        start_playback(room, staged_url);
+        return 0;
+    }
+    if (request_song_url(room, curr->song_hash) < 0)
+    {
+        return -1;
+    }
     return 0;
 }
 
 // 系统播放下一首
 int play_next_song_bysystem(rooms_t *room)
 {
-    if (!room || room->current_song)
+    if (!room || !room->current_song)
         return -1;
     pthread_mutex_lock(&room->lock);
     room->current_song = room->current_song->next;
@@ -377,7 +825,7 @@ int play_next_song_bysystem(rooms_t *room)
         room->current_song = room->playlist_head->next;
     }
     pthread_mutex_unlock(&room->lock);
-    update_playing_info(room);
+    return update_playing_info(room);
 }
 
 int play_next_song(client_info_t *client)
@@ -416,25 +864,20 @@ int playbysonghash(client_info_t *client, const char *song_hash)
         return -1;
     }
 
-    playlist_t *curr = room->playlist_head->next;
     pthread_mutex_lock(&room->lock);
-    while (curr)
+    playlist_t *curr = playlist_index_find(&room->playlist_index, song_hash);
+    if (!curr)
     {
-        if (strcmp(curr->song_hash, song_hash) == 0)
-        {
-            room->current_song = curr;
-            char message[1024] = {0};
-            snprintf(message, sizeof(message), "播放了%s", room->current_song->song_name);
-            init_room_action(room, client->userId, PLAY_BY_SONG_HASH, message);
-            pthread_mutex_unlock(&room->lock);
-            update_playing_info(room);
-            return 0;
-        }
-        curr = curr->next;
+        pthread_mutex_unlock(&room->lock);
+        return -1; // 未找到歌曲
     }
+    room->current_song = curr;
+    char message[1024] = {0};
+    snprintf(message, sizeof(message), "播放了%s", room->current_song->song_name);
+    init_room_action(room, client->userId, PLAY_BY_SONG_HASH, message);
     pthread_mutex_unlock(&room->lock);
-
-    return -1; // 未找到歌曲
+    update_playing_info(room);
+    return 0;
 }
 // 将歌曲置顶
 int upsongbyhash(client_info_t *client, const char *song_hash)
@@ -447,103 +890,85 @@ int upsongbyhash(client_info_t *client, const char *song_hash)
         return -1;
     }
 
-    playlist_t *prev = room->playlist_head;
-    playlist_t *curr = prev->next;
-
     pthread_mutex_lock(&room->lock);
-
-    while (curr)
+    playlist_t *curr = playlist_index_find(&room->playlist_index, song_hash);
+    if (!curr)
     {
-        if (strcmp(curr->song_hash, song_hash) == 0)
-        {
-            char message[256] = {0};
-            snprintf(message, sizeof(message), "将歌曲置顶：%s", curr->song_name);
-            init_room_action(room, client->userId, UP_SONGBYHASH, message);
-            // 找到歌曲，进行置顶操作
-            prev->next = curr->next;
-            if (curr == room->playlist_tail)
-            {
-                room->playlist_tail = prev;
-            }
-            // 插入到头节点后面
-            curr->next = room->playlist_head->next;
-            room->playlist_head->next = curr;
-            pthread_mutex_unlock(&room->lock);
-            return 0;
-        }
-        prev = curr;
-        curr = curr->next;
+        pthread_mutex_unlock(&room->lock);
+        return -1; // 未找到歌曲
     }
+    char message[256] = {0};
+    snprintf(message, sizeof(message), "将歌曲置顶：%s", curr->song_name);
+    init_room_action(room, client->userId, UP_SONGBYHASH, message);
+    // 插入到头节点后面
+    playlist_unlink(room, curr);
+    playlist_link_after(room, room->playlist_head, curr);
+    refresh_prefetch(room);
+    msg_buf_t *delta = playlist_delta_move(room, curr);
     pthread_mutex_unlock(&room->lock);
-
-    return -1; // 未找到歌曲
+    broadcast_playlist_delta(room, delta);
+    return 0;
 }
-
-// 获取当前播放进度，用于JSON广播
-const char *get_cur_played_percent(rooms_t *room)
+// 将歌曲移动到 before_hash 对应歌曲之前，before_hash 为空时移动到末尾
+int movesongbyhash(client_info_t *client, const char *song_hash, const char *before_hash)
 {
-    playing_info_t playing = room->playing_info;
-    cJSON *root = cJSON_CreateObject();
-    if (!root)
+    if (!client)
+        return -1;
+    rooms_t *room = client->room;
+    if (!room || !song_hash)
     {
-        return NULL;
+        return -1;
     }
-    cJSON *data = cJSON_CreateObject();
-    if (!data)
+
+    pthread_mutex_lock(&room->lock);
+    playlist_t *curr = playlist_index_find(&room->playlist_index, song_hash);
+    playlist_t *before = before_hash && strlen(before_hash) ? playlist_index_find(&room->playlist_index, before_hash) : NULL;
+    if (!curr || curr == before || (before_hash && strlen(before_hash) && !before))
     {
-        return NULL;
+        pthread_mutex_unlock(&room->lock);
+        return -1; // 未找到歌曲
     }
-
-    pthread_mutex_lock(&playing.lock);
-
-    cJSON_AddNumberToObject(data, "played_percent", playing.played_percent);
-    cJSON_AddNumberToObject(root, "error_code", SUCCESS);
-    cJSON_AddStringToObject(root, "status", "success");
-    cJSON_AddNumberToObject(root, "action", BROADCAST_SONG_INFO);
-    cJSON_AddItemToObject(root, "data", data);
-
-    pthread_mutex_unlock(&playing.lock);
-
-    const char *json_str = cJSON_Print(root);
-    cJSON_Delete(root);
-    return json_str;
+    char message[256] = {0};
+    snprintf(message, sizeof(message), "移动歌曲：%s", curr->song_name);
+    init_room_action(room, client->userId, MOVE_SONG, message);
+    playlist_unlink(room, curr);
+    playlist_link_after(room, before ? before->prev : room->playlist_tail, curr);
+    refresh_prefetch(room);
+    msg_buf_t *delta = playlist_delta_move(room, curr);
+    pthread_mutex_unlock(&room->lock);
+    broadcast_playlist_delta(room, delta);
+    return 0;
 }
 
-const char *get_cur_song_info(rooms_t *room, enum ctrl cmd)
+// 获取当前播放进度，用于JSON广播
+msg_buf_t *get_cur_played_percent(rooms_t *room)
 {
-    playing_info_t playing = room->playing_info;
-
-    cJSON *root = cJSON_CreateObject();
-    if (!root)
-        return NULL;
-
-    cJSON *data = cJSON_CreateObject();
-    if (!data)
-        return NULL;
-
-    pthread_mutex_lock(&playing.lock);
-
-    cJSON_AddNumberToObject(root, "error_code", SUCCESS);
-    cJSON_AddStringToObject(root, "status", "success");
-    cJSON_AddNumberToObject(root, "action", cmd);
-    cJSON_AddStringToObject(data, "songname", playing.song_name);
-    cJSON_AddStringToObject(data, "songhash", playing.song_hash);
-    cJSON_AddStringToObject(data, "singername", playing.singer_name);
-    cJSON_AddStringToObject(data, "album_name", playing.album_name);
-    cJSON_AddStringToObject(data, "duration", playing.duration);
-    cJSON_AddStringToObject(data, "lyrics_url", playing.lyrics_url);
-    cJSON_AddStringToObject(data, "song_url", playing.song_url);
-    cJSON_AddStringToObject(data, "cover_url", playing.cover_url);
-    cJSON_AddNumberToObject(data, "played_percent", playing.played_percent);
-    cJSON_AddNumberToObject(data, "is_playing", playing.is_playing);
-    cJSON_AddItemToObject(root, "data", data);
+    playing_info_t *playing = &room->playing_info;
+    pthread_mutex_lock(&playing->lock);
+    double percent = get_played_percent(playing);
+    pthread_mutex_unlock(&playing->lock);
+    return msg_progress(percent);
+}
 
-    pthread_mutex_unlock(&playing.lock);
+static msg_template_t g_tpl_song_info = MSG_TEMPLATE_INIT(
+    "{\"error_code\":0,\"status\":\"success\",\"action\":%d,\"data\":{"
+    "\"songname\":\"%s\",\"songhash\":\"%s\",\"singername\":\"%s\",\"album_name\":\"%s\","
+    "\"duration\":\"%s\",\"lyrics_url\":\"%s\",\"song_url\":\"%s\",\"cover_url\":\"%s\","
+    "\"played_percent\":%f,\"is_playing\":%d,\"server_time_ms\":%f,\"position_ms\":%f}}");
 
-    const char *json_str = cJSON_PrintUnformatted(root);
+msg_buf_t *get_cur_song_info(rooms_t *room, enum ctrl cmd)
+{
+    playing_info_t *playing = &room->playing_info;
 
-    cJSON_Delete(root);
-    return json_str;
+    pthread_mutex_lock(&playing->lock);
+    msg_buf_t *buf = msg_template_render(&g_tpl_song_info, (int)cmd,
+                                         playing->song_name, playing->song_hash, playing->singer_name,
+                                         playing->album_name, playing->duration, playing->lyrics_url,
+                                         playing->song_url, playing->cover_url,
+                                         get_played_percent(playing), (int)playing->is_playing,
+                                         lws_now_usecs() / 1000.0, get_played_us(playing) / 1000.0);
+    pthread_mutex_unlock(&playing->lock);
+    return buf;
 }
 int pause_song(client_info_t *client)
 {
@@ -555,10 +980,17 @@ int pause_song(client_info_t *client)
         return -1;
     }
     pthread_mutex_lock(&room->playing_info.lock);
+    if (room->playing_info.is_playing && room->playing_info.started_us)
+    {
+        room->playing_info.paused_at_us = lws_now_usecs();
+    }
     room->playing_info.is_playing = 0;
-    room->playing_info.last_update_time = time(NULL);
     pthread_mutex_unlock(&room->playing_info.lock);
+    // 暂停期间不需要任何定时器
+    lws_sul_cancel(&room->playing_info.timer);
+    lws_sul_cancel(&room->playing_info.progress_timer);
     init_room_action(room, client->userId, PAUSE_SONG, "暂停播放");
+    broadcast_playback_anchor(room);
     return 0;
 }
 int resume_song(client_info_t *client)
@@ -571,16 +1003,29 @@ int resume_song(client_info_t *client)
         return -1;
     }
     pthread_mutex_lock(&room->playing_info.lock);
+    if (!room->playing_info.started_us)
+    {
+        // 还没有开始播放（没有歌曲或 url 未就绪），url 就绪后会自动开始
+        pthread_mutex_unlock(&room->playing_info.lock);
+        return room->current_song ? 0 : -1;
+    }
+    if (room->playing_info.paused_at_us)
+    {
+        room->playing_info.paused_total_us += lws_now_usecs() - room->playing_info.paused_at_us;
+        room->playing_info.paused_at_us = 0;
+    }
     room->playing_info.is_playing = 1;
-    room->playing_info.last_update_time = time(NULL);
     pthread_mutex_unlock(&room->playing_info.lock);
     init_room_action(room, client->userId, RESUME_SONG, "继续播放");
-    lws_sul_schedule(context, 0, &(room->playing_info).timer, timer_callback, 1 * LWS_US_PER_SEC);
+    schedule_playback(room);
+    update_progress_timer(room);
+    broadcast_playback_anchor(room);
     return 0;
 }
 // 获取当前房间播放列表
 const char *get_playlist_json(rooms_t *room, enum ctrl cmd)
 {
+    lws_usec_t serialize_us = latency_serialize_begin();
     playlist_t *curr = room->playlist_head->next;
     cJSON *root = cJSON_CreateObject();
     if (!root)
@@ -600,6 +1045,9 @@ const char *get_playlist_json(rooms_t *room, enum ctrl cmd)
         cJSON_AddItemToArray(playlist, item);
         curr = curr->next;
     }
+    // 版本号与当前歌曲，客户端以此为基准应用之后的增量消息
+    cJSON_AddNumberToObject(root, "version", room->playlist_version);
+    cJSON_AddStringToObject(root, "current", room->current_song ? room->current_song->song_hash : "");
     pthread_mutex_unlock(&room->lock);
     // 添加到json对象中
     cJSON_AddItemToObject(root, "playlist", playlist);
@@ -608,5 +1056,6 @@ const char *get_playlist_json(rooms_t *room, enum ctrl cmd)
     cJSON_AddNumberToObject(root, "action", cmd);
     const char *json_str = cJSON_PrintUnformatted(root);
     cJSON_Delete(root);
+    latency_serialize_end(serialize_us);
     return json_str;
 }
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "playlist_index.h"
+#include <stdlib.h>
+#include <string.h>
+#include <libwebsockets.h>
+
+#define PLAYLIST_INDEX_INIT_CAPACITY 16
+
+static uint32_t song_hash_of(const char *song_hash)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)song_hash; *p; p++)
+    {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// 查找 song_hash 所在槽位，未找到时返回应插入的空槽位
+static unsigned int index_probe(const playlist_index_t *index, const char *song_hash, uint32_t hash)
+{
+    unsigned int mask = index->capacity - 1;
+    unsigned int i = hash & mask;
+    while (index->slots[i].song)
+    {
+        if (index->slots[i].hash == hash && strcmp(index->slots[i].song->song_hash, song_hash) == 0)
+        {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+// 扩容并重新散列（负载超过 3/4 时调用）
+static bool index_grow(playlist_index_t *index)
+{
+    unsigned int new_capacity = index->capacity * 2;
+    playlist_slot_t *new_slots = (playlist_slot_t *)calloc(new_capacity, sizeof(playlist_slot_t));
+    if (!new_slots)
+    {
+        lwsl_err("Failed to allocate memory for playlist index\n");
+        return false;
+    }
+    for (unsigned int i = 0; i < index->capacity; i++)
+    {
+        playlist_slot_t *slot = &index->slots[i];
+        if (!slot->song)
+            continue;
+        unsigned int j = slot->hash & (new_capacity - 1);
+        while (new_slots[j].song)
+        {
+            j = (j + 1) & (new_capacity - 1);
+        }
+        new_slots[j] = *slot;
+    }
+    free(index->slots);
+    index->slots = new_slots;
+    index->capacity = new_capacity;
+    return true;
+}
+
+bool playlist_index_init(playlist_index_t *index)
+{
+    index->capacity = PLAYLIST_INDEX_INIT_CAPACITY;
+    index->count = 0;
+    index->slots = (playlist_slot_t *)calloc(index->capacity, sizeof(playlist_slot_t));
+    if (!index->slots)
+    {
+        lwsl_err("Failed to allocate memory for playlist index\n");
+        return false;
+    }
+    return true;
+}
+
+// 只释放索引本身，链表节点由播放列表负责释放
+void playlist_index_free(playlist_index_t *index)
+{
+    free(index->slots);
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+}
+
+playlist_t *playlist_index_find(const playlist_index_t *index, const char *song_hash)
+{
+    if (!index->slots || !song_hash)
+        return NULL;
+    return index->slots[index_probe(index, song_hash, song_hash_of(song_hash))].song;
+}
+
+// 登记歌曲，song_hash 已存在时返回 false
+bool playlist_index_insert(playlist_index_t *index, playlist_t *song)
+{
+    if ((index->count + 1) * 4 > index->capacity * 3 && !index_grow(index))
+    {
+        return false;
+    }
+    uint32_t hash = song_hash_of(song->song_hash);
+    unsigned int slot = index_probe(index, song->song_hash, hash);
+    if (index->slots[slot].song)
+    {
+        return false;
+    }
+    index->slots[slot].hash = hash;
+    index->slots[slot].song = song;
+    index->count++;
+    return true;
+}
+
+// 删除歌曲的槽位（向后移位删除，不留墓碑）
+void playlist_index_remove(playlist_index_t *index, const playlist_t *song)
+{
+    unsigned int mask = index->capacity - 1;
+    unsigned int hole = index_probe(index, song->song_hash, song_hash_of(song->song_hash));
+    if (index->slots[hole].song != song)
+        return;
+    unsigned int i = hole;
+    index->slots[hole].song = NULL;
+    for (;;)
+    {
+        i = (i + 1) & mask;
+        if (!index->slots[i].song)
+            break;
+        unsigned int home = index->slots[i].hash & mask;
+        // home 不在 (hole, i] 区间内时，该元素可以前移填洞
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            index->slots[hole] = index->slots[i];
+            index->slots[i].song = NULL;
+            hole = i;
+        }
+    }
+    index->count--;
+}
@@ -0,0 +1,124 @@
+#include "presence.h"
+#include "cJSON.h"
+#include "config.h"
+#include "websocket_service.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 成员变化的增量广播：加入/离开先记录在房间的待广播列表中，
+// 合并窗口到期后合成一条消息，短时间内大量加入只广播一次；
+// 完整成员列表由客户端按需分页拉取（GET_CLEIENT_LIST）。
+
+extern struct lws_context *context;
+
+static void presence_timer_callback(lws_sorted_usec_list_t *sul)
+{
+    rooms_t *room = lws_container_of(sul, rooms_t, presence_timer);
+    presence_flush(room);
+}
+
+// 生成合并后的成员变化消息
+static const char *get_presence_json(rooms_t *room)
+{
+    cJSON *root = cJSON_CreateObject();
+    if (!root)
+        return NULL;
+    cJSON *data = cJSON_CreateObject();
+    cJSON *joined = cJSON_CreateArray();
+    cJSON *left = cJSON_CreateArray();
+    for (unsigned int i = 0; i < room->presence_count; i++)
+    {
+        presence_event_t *event = &room->presence_events[i];
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "userId", event->userId);
+        cJSON_AddStringToObject(item, "ip", event->ip);
+        cJSON_AddItemToArray(event->joined ? joined : left, item);
+    }
+    cJSON_AddNumberToObject(root, "error_code", SUCCESS);
+    cJSON_AddStringToObject(root, "status", "success");
+    cJSON_AddNumberToObject(root, "action", BROADCAST_PRESENCE);
+    cJSON_AddNumberToObject(data, "client_counter", room->client_counter);
+    cJSON_AddItemToObject(data, "joined", joined);
+    cJSON_AddItemToObject(data, "left", left);
+    cJSON_AddItemToObject(root, "data", data);
+    const char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json;
+}
+
+// 广播窗口内累积的成员变化
+void presence_flush(rooms_t *room)
+{
+    lws_sul_cancel(&room->presence_timer);
+    if (!room->presence_count)
+        return;
+    const char *json = get_presence_json(room);
+    room->presence_count = 0;
+    if (json)
+    {
+        broadcast_response_room(room, json, BROADCAST_PRESENCE);
+        free((char *)json);
+    }
+}
+
+static void presence_record(rooms_t *room, client_info_t *client, int joined)
+{
+    // 窗口内同一连接身份的相反变化互相抵消（加入后马上离开、断线重连）
+    for (unsigned int i = 0; i < room->presence_count; i++)
+    {
+        presence_event_t *event = &room->presence_events[i];
+        if (event->joined != joined && !strcmp(event->userId, client->userId) && !strcmp(event->ip, client->ip))
+        {
+            *event = room->presence_events[--room->presence_count];
+            return;
+        }
+    }
+
+    if (room->presence_count == room->presence_capacity)
+    {
+        unsigned int capacity = room->presence_capacity ? room->presence_capacity * 2 : 8;
+        presence_event_t *events = (presence_event_t *)realloc(room->presence_events, capacity * sizeof(presence_event_t));
+        if (!events)
+        {
+            // 先把已有的变化发出去，腾出空间
+            lwsl_err("Failed to allocate memory for presence_event_t\n");
+            presence_flush(room);
+            if (!room->presence_capacity)
+                return;
+        }
+        else
+        {
+            room->presence_events = events;
+            room->presence_capacity = capacity;
+        }
+    }
+
+    presence_event_t *event = &room->presence_events[room->presence_count++];
+    snprintf(event->userId, sizeof(event->userId), "%s", client->userId);
+    snprintf(event->ip, sizeof(event->ip), "%s", client->ip);
+    event->joined = joined;
+
+    if (g_config.presence_window_ms <= 0)
+    {
+        presence_flush(room);
+    }
+    else if (room->presence_count == 1)
+    {
+        // 窗口从第一条变化开始计时，之后的变化不再推迟广播
+        lws_sul_schedule(context, room->tsi, &room->presence_timer, presence_timer_callback,
+                         g_config.presence_window_ms * LWS_US_PER_MS);
+    }
+}
+
+// 成员加入（在房间所属的服务线程上调用）
+void presence_join(rooms_t *room, client_info_t *client)
+{
+    presence_record(room, client, 1);
+}
+
+// 成员离开（在房间所属的服务线程上调用）
+void presence_leave(rooms_t *room, client_info_t *client)
+{
+    presence_record(room, client, 0);
+}
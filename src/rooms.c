@@ -1,91 +1,196 @@
 #include "rooms.h"
+#include "playlist_index.h"
+#include "config.h"
+#include "metrics.h"
+#include "latency.h"
 #include <stdlib.h>
 #include <string.h>
 #include <libwebsockets.h>
 
-// 初始化房间操作链表（带头结点）
-room_ctrl_t *init_action_list()
+// 记录房间操作：写入环形缓冲区，满了覆盖最旧的记录，不再分配内存
+bool init_room_action(rooms_t *room, const char *userid, int action, const char *action_message)
 {
-    room_ctrl_t *head = (room_ctrl_t *)malloc(sizeof(room_ctrl_t));
-    memset(head, 0, sizeof(room_ctrl_t));
-    return head;
-}
-// 头插法插入房间操作节点
-bool insert_room_action(rooms_t *room, room_ctrl_t *new_node)
-{
-    if (room == NULL || new_node == NULL)
+    if (room == NULL || userid == NULL || action_message == NULL || !room->action_capacity)
     {
         return false;
     }
-    room_ctrl_t *head = room->room_ctrl_head;
-    new_node->next = head->next;
-    head->next = new_node;
+    room_ctrl_t *entry = &room->action_log[room->action_next];
+    memset(entry, 0, sizeof(room_ctrl_t));
+    strncpy(entry->userid, userid, sizeof(entry->userid) - 1);
+    entry->action = action;
+    strncpy(entry->action_message, action_message, sizeof(entry->action_message) - 1);
+    entry->action_time = time(NULL);
+    room->action_next = (room->action_next + 1) % room->action_capacity;
+    if (room->action_count < room->action_capacity)
+    {
+        room->action_count++;
+    }
+    room->action_total++;
     return true;
 }
-// 新建操作节点并插入链表中
-bool init_room_action(rooms_t *room, char *userid, char action, char *action_message)
+
+// 按从新到旧的顺序分页获取操作记录（offset 为跳过的条数）
+const char *get_room_actions_json(rooms_t *room, unsigned int offset, unsigned int limit, enum ctrl cmd)
 {
-    if (room == NULL || userid == NULL || action_message == NULL)
+    lws_usec_t serialize_us = latency_serialize_begin();
+    cJSON *root = cJSON_CreateObject();
+    if (!root)
+        return NULL;
+    cJSON *actions = cJSON_CreateArray();
+    for (unsigned int i = offset; i < room->action_count && i - offset < limit; i++)
     {
-        return false;
+        // 第 i 新的记录
+        room_ctrl_t *entry = &room->action_log[(room->action_next + room->action_capacity - 1 - i) % room->action_capacity];
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "userid", entry->userid);
+        cJSON_AddNumberToObject(item, "action", entry->action);
+        cJSON_AddStringToObject(item, "message", entry->action_message);
+        cJSON_AddNumberToObject(item, "time", (double)entry->action_time);
+        cJSON_AddItemToArray(actions, item);
     }
-    room_ctrl_t *new_node = (room_ctrl_t *)malloc(sizeof(room_ctrl_t));
-    memset(new_node, 0, sizeof(room_ctrl_t));
-    strncpy(new_node->userid, userid, 63);
-    new_node->action = action;
-    strncpy(new_node->action_message, action_message, 511);
-    return insert_room_action(room, new_node);
+    cJSON_AddItemToObject(root, "actions", actions);
+    cJSON_AddNumberToObject(root, "total", room->action_total);
+    cJSON_AddNumberToObject(root, "available", room->action_count);
+    cJSON_AddNumberToObject(root, "error_code", SUCCESS);
+    cJSON_AddStringToObject(root, "status", "success");
+    cJSON_AddNumberToObject(root, "action", cmd);
+    const char *json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    latency_serialize_end(serialize_us);
+    return json_str;
 }
-// 释放房间操作链表
-void free_room_action(rooms_t *room)
+
+#define ROOM_REGISTRY_INIT_CAPACITY 64
+
+// FNV-1a 哈希，房间分片等场景也复用该函数
+uint32_t room_id_hash(const char *room_id)
 {
-    room_ctrl_t *cur = room->room_ctrl_head->next;
-    while (cur != NULL)
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)room_id; *p; p++)
     {
-        room_ctrl_t *next = cur->next;
-        free(cur);
-        cur = next;
+        hash ^= *p;
+        hash *= 16777619u;
     }
-    free(room->room_ctrl_head);
-    room->room_ctrl_head = NULL;
+    return hash;
 }
-// 带头结点的房间链表初始化
-rooms_t *init_rooms()
+
+// 把房间分配到 count 个分片之一（salt 区分服务线程/工作进程两级分片，避免两级结果相关）。
+// FNV-1a 对短 room_id 的高位分布不均，先用 murmur3 的收尾混合打散再按乘法取区间
+unsigned int room_shard_index(const char *room_id, unsigned int count, uint32_t salt)
+{
+    uint32_t hash = room_id_hash(room_id) ^ (salt * 0x9e3779b9u);
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return (unsigned int)(((uint64_t)hash * count) >> 32);
+}
+
+// 查找 room_id 所在槽位，未找到时返回应插入的空槽位
+static unsigned int registry_probe(const room_registry_t *registry, const char *room_id, uint32_t hash)
 {
-    rooms_t *room = (rooms_t *)malloc(sizeof(rooms_t));
-    if (!room)
+    unsigned int mask = registry->capacity - 1;
+    unsigned int i = hash & mask;
+    while (registry->slots[i].room)
     {
-        lwsl_err("Failed to allocate memory for rooms\n");
-        return NULL;
+        if (registry->slots[i].hash == hash && strcmp(registry->slots[i].room->room_id, room_id) == 0)
+        {
+            break;
+        }
+        i = (i + 1) & mask;
     }
-    memset(room, 0, sizeof(room));
-    strcpy(room->room_id, "head");
-    room->client_counter = 0;
-    room->client_info = NULL;
-    pthread_mutex_init(&room->lock, NULL);
-    room->next = NULL;
-    room->playlist_head = NULL;
-    return room;
+    return i;
 }
-// 头插法插入房间节点
-bool insert_room_node(rooms_t *head, rooms_t *new_node)
+
+// 扩容并重新散列（负载超过 3/4 时调用）
+static bool registry_grow(room_registry_t *registry)
 {
-    if (head == NULL || new_node == NULL)
+    unsigned int new_capacity = registry->capacity * 2;
+    room_slot_t *new_slots = (room_slot_t *)calloc(new_capacity, sizeof(room_slot_t));
+    if (!new_slots)
     {
+        lwsl_err("Failed to allocate memory for room registry\n");
         return false;
     }
-    new_node->next = head->next;
-    head->next = new_node;
+    for (unsigned int i = 0; i < registry->capacity; i++)
+    {
+        room_slot_t *slot = &registry->slots[i];
+        if (!slot->room)
+            continue;
+        unsigned int j = slot->hash & (new_capacity - 1);
+        while (new_slots[j].room)
+        {
+            j = (j + 1) & (new_capacity - 1);
+        }
+        new_slots[j] = *slot;
+    }
+    free(registry->slots);
+    registry->slots = new_slots;
+    registry->capacity = new_capacity;
     return true;
 }
-// 新建房间节点插入房间链表,返回该房间节点
-rooms_t *insert_room_info(const char *room_id, const char *creater_id, rooms_t *head)
+
+// 房间注册表初始化
+room_registry_t *init_rooms()
+{
+    room_registry_t *registry = (room_registry_t *)malloc(sizeof(room_registry_t));
+    if (!registry)
+    {
+        lwsl_err("Failed to allocate memory for rooms\n");
+        return NULL;
+    }
+    registry->capacity = ROOM_REGISTRY_INIT_CAPACITY;
+    registry->count = 0;
+    registry->slots = (room_slot_t *)calloc(registry->capacity, sizeof(room_slot_t));
+    if (!registry->slots)
+    {
+        lwsl_err("Failed to allocate memory for rooms\n");
+        free(registry);
+        return NULL;
+    }
+    return registry;
+}
+
+// 按 room_id 查找房间，不存在返回 NULL
+rooms_t *find_room(room_registry_t *registry, const char *room_id)
+{
+    if (!registry || !room_id)
+        return NULL;
+    return registry->slots[registry_probe(registry, room_id, room_id_hash(room_id))].room;
+}
+
+// 遍历注册表，cursor 从 0 开始，返回 NULL 表示遍历结束（遍历期间不可增删房间）
+rooms_t *next_room(room_registry_t *registry, unsigned int *cursor)
 {
+    while (*cursor < registry->capacity)
+    {
+        rooms_t *room = registry->slots[(*cursor)++].room;
+        if (room)
+            return room;
+    }
+    return NULL;
+}
+
+// 新建房间节点登记到注册表,返回该房间节点
+rooms_t *insert_room_info(const char *room_id, const char *creater_id, room_registry_t *registry)
+{
+    if ((registry->count + 1) * 4 > registry->capacity * 3 && !registry_grow(registry))
+    {
+        return NULL;
+    }
+    uint32_t hash = room_id_hash(room_id);
+    unsigned int slot = registry_probe(registry, room_id, hash);
+    if (registry->slots[slot].room)
+    {
+        lwsl_err("Room %s already exists\n", room_id);
+        return NULL;
+    }
     rooms_t *new_node = (rooms_t *)malloc(sizeof(rooms_t));
     if (!new_node)
     {
         lwsl_err("Failed to allocate memory for rooms\n");
-        return false;
+        return NULL;
     }
     memset(new_node, 0, sizeof(rooms_t));
     strncpy(new_node->room_id, room_id, 63);
@@ -111,27 +216,73 @@ rooms_t *insert_room_info(const char *room_id, const char *creater_id, rooms_t *
     }
     memset(new_node->playlist_head, 0, sizeof(playlist_t));
     new_node->playlist_head->next = NULL;
+    new_node->playlist_head->prev = NULL;
+    if (!playlist_index_init(&new_node->playlist_index))
+    {
+        free(new_node->playlist_head);
+        free(new_node->client_info);
+        free(new_node);
+        return NULL;
+    }
     new_node->playlist_tail = new_node->playlist_head;      // 初始化尾节点指向头节点
     new_node->current_song = new_node->playlist_head->next; // 初始化当前播放歌曲指向头节点
     pthread_mutex_init(&new_node->lock, NULL);
     pthread_mutex_init(&new_node->playing_info.lock, NULL);
     new_node->playing_info.room = new_node;
-    new_node->next = NULL;
-    new_node->room_ctrl_head = init_action_list();
-    if (!insert_room_node(head, new_node))
+    new_node->action_capacity = g_config.action_log_capacity;
+    new_node->action_log = (room_ctrl_t *)calloc(new_node->action_capacity, sizeof(room_ctrl_t));
+    if (!new_node->action_log)
     {
-        lwsl_err("Failed to insert room node\n");
-        free(new_node);
-        return NULL;
+        lwsl_err("Failed to allocate memory for room action log\n");
+        new_node->action_capacity = 0;
     }
+
+    // 登记到注册表
+    registry->slots[slot].hash = hash;
+    registry->slots[slot].room = new_node;
+    registry->count++;
+    metrics_add(METRIC_ROOMS_CREATED, 1);
     return new_node;
 }
+
+// 从注册表删除槽位（向后移位删除，不留墓碑）
+static void registry_erase(room_registry_t *registry, unsigned int hole)
+{
+    unsigned int mask = registry->capacity - 1;
+    unsigned int i = hole;
+    registry->slots[hole].room = NULL;
+    for (;;)
+    {
+        i = (i + 1) & mask;
+        if (!registry->slots[i].room)
+            break;
+        unsigned int home = registry->slots[i].hash & mask;
+        // home 不在 (hole, i] 区间内时，该元素可以前移填洞
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            registry->slots[hole] = registry->slots[i];
+            registry->slots[i].room = NULL;
+            hole = i;
+        }
+    }
+    registry->count--;
+}
+
 // 移除对应room节点
-void remove_room_node(rooms_t *head, rooms_t *node)
+void remove_room_node(room_registry_t *registry, rooms_t *node)
 {
+    // 先从注册表摘除
+    unsigned int slot = registry_probe(registry, node->room_id, room_id_hash(node->room_id));
+    if (registry->slots[slot].room == node)
+    {
+        registry_erase(registry, slot);
+    }
     // 取消该房间的定时器
     lws_sul_cancel(&node->playing_info.timer);
-    // 先释放播放列表链表
+    lws_sul_cancel(&node->playing_info.progress_timer);
+    lws_sul_cancel(&node->playing_info.url_retry_timer);
+    lws_sul_cancel(&node->presence_timer);
+    // 释放播放列表链表（含头结点）
     playlist_t *cur = node->playlist_head;
     while (cur != NULL)
     {
@@ -139,26 +290,14 @@ void remove_room_node(rooms_t *head, rooms_t *node)
         free(cur);
         cur = next;
     }
-    free(node->playlist_head);
     node->playlist_head = NULL;
-    // 释放房间操作链表
-    free_room_action(node);
-
-    // 再删除节点
-    rooms_t *foreach_cur = head->next;
-    rooms_t *prev = head;
-    while (foreach_cur != NULL)
-    {
-        if (foreach_cur == node)
-        {
-            prev->next = foreach_cur->next;
-            free(foreach_cur);
-            break;
-        }
-        else
-        {
-            prev = foreach_cur;
-            foreach_cur = foreach_cur->next;
-        }
-    }
-}
\ No newline at end of file
+    playlist_index_free(&node->playlist_index);
+    // 释放房间操作记录
+    free(node->action_log);
+    free(node->presence_events);
+    free(node->client_info);
+    pthread_mutex_destroy(&node->playing_info.lock);
+    pthread_mutex_destroy(&node->lock);
+    free(node);
+    metrics_add(METRIC_ROOMS_DESTROYED, 1);
+}
@@ -0,0 +1,154 @@
+#include "send_queue.h"
+#include "msg_buf.h"
+#include "metrics.h"
+#include <string.h>
+
+static send_queue_stats_t g_stats;
+
+// 队列第 i 个元素（从队首开始计数）
+static send_item_t *queue_at(client_info_t *client, unsigned int i)
+{
+    return &client->send_queue[(client->queue_head + i) % SEND_QUEUE_CAPACITY];
+}
+
+// 删除队列第 i 个元素，后面的元素依次前移
+static void queue_remove_at(client_info_t *client, unsigned int i)
+{
+    send_item_t *item = queue_at(client, i);
+    client->queue_bytes -= item->buf->len;
+    metrics_add(METRIC_QUEUE_REMOVED, 1);
+    metrics_add(METRIC_QUEUE_BYTES_REMOVED, item->buf->len);
+    msg_buf_unref(item->buf);
+    for (; i + 1 < client->queue_len; i++)
+    {
+        *queue_at(client, i) = *queue_at(client, i + 1);
+    }
+    client->queue_len--;
+}
+
+// 查找第一个可合并且 action 相同的元素，action 为 -1 时匹配任意可合并元素
+static int queue_find_conflatable(client_info_t *client, int action)
+{
+    for (unsigned int i = 0; i < client->queue_len; i++)
+    {
+        send_item_t *item = queue_at(client, i);
+        if (item->policy == SEND_CONFLATE && (action < 0 || item->action == action))
+            return i;
+    }
+    return -1;
+}
+
+static int queue_full(client_info_t *client, size_t len)
+{
+    return client->queue_len >= SEND_QUEUE_CAPACITY || client->queue_bytes + len > SEND_QUEUE_MAX_BYTES;
+}
+
+// 消息入队：可合并消息替换掉队列中同类旧消息；不可丢弃的消息在超出预算时返回 -1，由调用方断开连接
+int send_queue_push(client_info_t *client, msg_buf_t *buf, enum send_policy policy, int action)
+{
+    int ret = 0;
+    if (!client || !buf)
+        return -1;
+
+    pthread_mutex_lock(&client->lock);
+    if (client->over_budget)
+    {
+        pthread_mutex_unlock(&client->lock);
+        return -1;
+    }
+    if (policy == SEND_CONFLATE)
+    {
+        int i = queue_find_conflatable(client, action);
+        if (i >= 0)
+        {
+            queue_remove_at(client, i);
+            client->queue_drops++;
+            __atomic_add_fetch(&g_stats.conflated, 1, __ATOMIC_RELAXED);
+        }
+    }
+    // 超出预算时先丢弃可合并的旧消息
+    while (queue_full(client, buf->len))
+    {
+        int i = queue_find_conflatable(client, -1);
+        if (i < 0)
+            break;
+        queue_remove_at(client, i);
+        client->queue_drops++;
+        __atomic_add_fetch(&g_stats.dropped, 1, __ATOMIC_RELAXED);
+    }
+    if (queue_full(client, buf->len))
+    {
+        client->queue_drops++;
+        if (policy == SEND_CONFLATE)
+        {
+            // 进度类消息直接丢弃，下一次进度会覆盖
+            __atomic_add_fetch(&g_stats.dropped, 1, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            client->over_budget = 1;
+            __atomic_add_fetch(&g_stats.disconnects, 1, __ATOMIC_RELAXED);
+            ret = -1;
+        }
+        pthread_mutex_unlock(&client->lock);
+        return ret;
+    }
+    send_item_t *item = queue_at(client, client->queue_len);
+    item->buf = msg_buf_ref(buf);
+    item->action = action;
+    item->policy = policy;
+    client->queue_len++;
+    client->queue_bytes += buf->len;
+    metrics_add(METRIC_QUEUE_PUSHED, 1);
+    metrics_add(METRIC_QUEUE_BYTES_PUSHED, buf->len);
+    pthread_mutex_unlock(&client->lock);
+    return ret;
+}
+
+// 取出队首消息（调用方负责 msg_buf_unref），队列为空返回 NULL
+msg_buf_t *send_queue_pop(client_info_t *client)
+{
+    msg_buf_t *buf = NULL;
+    pthread_mutex_lock(&client->lock);
+    if (client->queue_len)
+    {
+        send_item_t *item = queue_at(client, 0);
+        buf = item->buf;
+        client->queue_bytes -= buf->len;
+        metrics_add(METRIC_QUEUE_REMOVED, 1);
+        metrics_add(METRIC_QUEUE_BYTES_REMOVED, buf->len);
+        client->queue_head = (client->queue_head + 1) % SEND_QUEUE_CAPACITY;
+        client->queue_len--;
+    }
+    pthread_mutex_unlock(&client->lock);
+    return buf;
+}
+
+// 清空队列（连接关闭时调用）
+void send_queue_clear(client_info_t *client)
+{
+    pthread_mutex_lock(&client->lock);
+    while (client->queue_len)
+    {
+        queue_remove_at(client, 0);
+    }
+    client->queue_head = 0;
+    pthread_mutex_unlock(&client->lock);
+}
+
+unsigned int send_queue_depth(client_info_t *client)
+{
+    pthread_mutex_lock(&client->lock);
+    unsigned int depth = client->queue_len;
+    pthread_mutex_unlock(&client->lock);
+    return depth;
+}
+
+send_queue_stats_t send_queue_get_stats(void)
+{
+    send_queue_stats_t stats;
+    stats.conflated = __atomic_load_n(&g_stats.conflated, __ATOMIC_RELAXED);
+    stats.dropped = __atomic_load_n(&g_stats.dropped, __ATOMIC_RELAXED);
+    stats.disconnects = __atomic_load_n(&g_stats.disconnects, __ATOMIC_RELAXED);
+    return stats;
+}
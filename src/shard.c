@@ -0,0 +1,234 @@
+#include "shard.h"
+#include "rooms.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// 投递给某个服务线程的任务
+typedef struct shard_task
+{
+    shard_task_fn fn;
+    void *arg;
+    struct shard_task *next;
+} shard_task_t;
+
+// 单个服务线程的分片
+typedef struct shard
+{
+    room_registry_t *rooms; // 该线程拥有的房间
+    pthread_mutex_t lock;   // 只保护任务队列
+    shard_task_t *head;
+    shard_task_t *tail;
+    int wake_fd;            // 托管在该线程上的 eventfd，写入即只唤醒该线程；-1 时退回唤醒全部线程
+} shard_t;
+
+static struct lws_context *g_context = NULL;
+static shard_t *g_shards = NULL;
+static int g_count = 0;
+static __thread int t_tsi = 0; // 当前线程的服务线程下标
+
+// 给每个服务线程托管一个 eventfd。adopt 不能指定线程，lws 会放到 fd 最少的线程上，
+// 启动时依次托管 count 个基本上每个线程一个，按实际落到的线程登记；没分到的线程投递时退回 lws_cancel_service
+static void shard_attach_wakers(struct lws_vhost *vhost)
+{
+    for (int i = 0; vhost && i < g_count; i++)
+    {
+        lws_sock_file_fd_type desc;
+        desc.filefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (desc.filefd < 0)
+            break;
+        struct lws *wsi = lws_adopt_descriptor_vhost(vhost, LWS_ADOPT_RAW_FILE_DESC, desc, "shard-wake", NULL);
+        if (!wsi)
+        {
+            // 失败时 lws 会关闭该 fd
+            lwsl_err("Failed to adopt shard wake eventfd\n");
+            break;
+        }
+        int tsi = lws_get_tsi(wsi);
+        if (tsi >= 0 && tsi < g_count && g_shards[tsi].wake_fd < 0)
+            g_shards[tsi].wake_fd = desc.filefd;
+    }
+    for (int i = 0; i < g_count; i++)
+    {
+        if (g_shards[i].wake_fd < 0)
+            lwsl_notice("服务线程 %d 没有独立的唤醒 eventfd，跨线程投递时唤醒全部线程\n", i);
+    }
+}
+
+// 初始化分片（count 为 lws 实际启动的服务线程数）
+int shard_init(struct lws_context *context, int count)
+{
+    if (count < 1)
+        count = 1;
+    g_shards = (shard_t *)calloc(count, sizeof(shard_t));
+    if (!g_shards)
+    {
+        lwsl_err("Failed to allocate memory for shards\n");
+        return -1;
+    }
+    g_context = context;
+    g_count = count;
+    for (int i = 0; i < count; i++)
+    {
+        pthread_mutex_init(&g_shards[i].lock, NULL);
+        g_shards[i].wake_fd = -1;
+        g_shards[i].rooms = init_rooms();
+        if (!g_shards[i].rooms)
+        {
+            lwsl_err("Failed to initialize rooms for shard %d\n", i);
+            return -1;
+        }
+    }
+    if (count > 1)
+        shard_attach_wakers(lws_get_vhost_by_name(context, "default"));
+    return 0;
+}
+
+// 停止跨线程投递（需在所有服务线程退出后、销毁 lws 上下文前调用）：
+// 先按顺序执行掉各线程队列里剩余的任务，此后投递的任务都在当前线程直接执行
+void shard_stop(void)
+{
+    g_context = NULL;
+    for (int i = 0; i < g_count; i++)
+    {
+        t_tsi = i;
+        shard_drain();
+    }
+    t_tsi = 0;
+}
+
+// 释放分片与各自的房间注册表
+void shard_destroy(void)
+{
+    for (int i = 0; i < g_count; i++)
+    {
+        unsigned int cursor = 0;
+        rooms_t *room;
+        while ((room = next_room(g_shards[i].rooms, &cursor)))
+        {
+            remove_room_node(g_shards[i].rooms, room);
+            cursor = 0;
+        }
+        free(g_shards[i].rooms->slots);
+        free(g_shards[i].rooms);
+        pthread_mutex_destroy(&g_shards[i].lock);
+    }
+    free(g_shards);
+    g_shards = NULL;
+    g_count = 0;
+}
+
+int shard_count(void)
+{
+    return g_count;
+}
+
+int shard_current(void)
+{
+    return t_tsi;
+}
+
+// 服务线程启动时登记自己的下标
+void shard_set_current(int tsi)
+{
+    t_tsi = tsi;
+}
+
+// 房间所属的服务线程（与工作进程分片使用不同的 salt）
+int shard_of_room(const char *room_id)
+{
+    if (g_count <= 1)
+        return 0;
+    return (int)room_shard_index(room_id, g_count, 1);
+}
+
+room_registry_t *shard_rooms(int tsi)
+{
+    return g_shards[tsi].rooms;
+}
+
+// 在 tsi 线程上执行 fn(arg)：本线程直接执行，其他线程放入其任务队列并唤醒
+int shard_post(int tsi, shard_task_fn fn, void *arg)
+{
+    if (tsi == t_tsi || g_count <= 1)
+    {
+        fn(arg);
+        return 0;
+    }
+    if (!g_context)
+    {
+        // 服务线程已经全部退出，以目标线程的身份直接执行
+        int saved = t_tsi;
+        t_tsi = tsi;
+        fn(arg);
+        t_tsi = saved;
+        return 0;
+    }
+    shard_task_t *task = (shard_task_t *)malloc(sizeof(shard_task_t));
+    if (!task)
+    {
+        lwsl_err("Failed to allocate memory for shard_task_t\n");
+        return -1;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    task->next = NULL;
+
+    shard_t *shard = &g_shards[tsi];
+    pthread_mutex_lock(&shard->lock);
+    int was_empty = shard->head == NULL;
+    if (shard->tail)
+        shard->tail->next = task;
+    else
+        shard->head = task;
+    shard->tail = task;
+    pthread_mutex_unlock(&shard->lock);
+
+    // 队列原本非空时对方已经被唤醒过，还没处理完，不必重复唤醒
+    if (was_empty)
+    {
+        if (shard->wake_fd < 0 || eventfd_write(shard->wake_fd, 1) < 0)
+            lws_cancel_service(g_context);
+    }
+    return 0;
+}
+
+// 执行本线程队列中的任务（在唤醒 eventfd 可读或 LWS_CALLBACK_EVENT_WAIT_CANCELLED 中调用）
+void shard_drain(void)
+{
+    if (!g_shards)
+        return;
+    shard_t *shard = &g_shards[t_tsi];
+    pthread_mutex_lock(&shard->lock);
+    shard_task_t *task = shard->head;
+    shard->head = shard->tail = NULL;
+    pthread_mutex_unlock(&shard->lock);
+
+    while (task)
+    {
+        shard_task_t *next = task->next;
+        task->fn(task->arg);
+        free(task);
+        task = next;
+    }
+}
+
+// 唤醒 eventfd 的回调，运行在 eventfd 所在的服务线程上
+int callback_shard(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len)
+{
+    switch (reason)
+    {
+    case LWS_CALLBACK_RAW_RX_FILE:
+    {
+        eventfd_t value;
+        eventfd_read(lws_get_socket_fd(wsi), &value);
+        shard_drain();
+        break;
+    }
+    default:
+        break;
+    }
+    return 0;
+}
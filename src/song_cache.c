@@ -0,0 +1,345 @@
+#include "song_cache.h"
+#include "shard.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 歌曲 url / 歌词 url 缓存：按 (种类, song_hash) 索引，每个条目带 TTL，
+// 总内存超过上限时按 LRU 淘汰；同一个 key 的并发查询只会请求一次上游。
+// 缓存由所有服务线程共享，等待者的回调投递回发起查询的线程执行。
+// 过期条目重新请求上游失败（包括熔断期间直接失败）时，过期不超过宽限期的旧值继续应答。
+
+#define SONG_CACHE_INIT_BUCKETS 256
+
+// 等待同一个上游请求的查询
+typedef struct song_cache_waiter
+{
+    song_cache_cb cb;
+    void *arg;
+    int tsi;             // 发起查询的服务线程
+    char song_hash[128]; // 以下两项在请求完成时填写
+    char *value;
+    struct song_cache_waiter *next;
+} song_cache_waiter_t;
+
+// 缓存条目
+typedef struct song_cache_entry
+{
+    enum song_cache_kind kind;
+    char song_hash[128];
+    uint32_t hash;
+    char *value;                  // 已缓存的值，请求中且从未成功过时为 NULL
+    size_t bytes;                 // 条目占用的内存
+    lws_usec_t expire_us;         // 过期时间
+    char pending;                 // 上游请求进行中
+    song_cache_waiter_t *waiters; // 等待请求完成的查询
+    struct song_cache_entry *bucket_next;
+    struct song_cache_entry *lru_prev; // LRU 链表，表头为最近使用
+    struct song_cache_entry *lru_next;
+} song_cache_entry_t;
+
+static song_cache_entry_t **g_buckets = NULL;
+static unsigned int g_bucket_count = 0;
+static song_cache_entry_t *g_lru_head = NULL;
+static song_cache_entry_t *g_lru_tail = NULL;
+static size_t g_max_bytes = 0;
+static lws_usec_t g_ttl_us[SONG_CACHE_KIND_MAX];
+static lws_usec_t g_stale_grace_us = 0;
+static song_cache_stats_t g_stats;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t cache_hash(enum song_cache_kind kind, const char *song_hash)
+{
+    uint32_t hash = 2166136261u ^ (uint32_t)kind;
+    for (const unsigned char *p = (const unsigned char *)song_hash; *p; p++)
+    {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void lru_unlink(song_cache_entry_t *entry)
+{
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else if (g_lru_head == entry)
+        g_lru_head = entry->lru_next;
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else if (g_lru_tail == entry)
+        g_lru_tail = entry->lru_prev;
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_push_front(song_cache_entry_t *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = g_lru_head;
+    if (g_lru_head)
+        g_lru_head->lru_prev = entry;
+    g_lru_head = entry;
+    if (!g_lru_tail)
+        g_lru_tail = entry;
+}
+
+static song_cache_entry_t *cache_find(enum song_cache_kind kind, const char *song_hash, uint32_t hash)
+{
+    for (song_cache_entry_t *entry = g_buckets[hash & (g_bucket_count - 1)]; entry; entry = entry->bucket_next)
+    {
+        if (entry->hash == hash && entry->kind == kind && strcmp(entry->song_hash, song_hash) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+// 桶数量翻倍
+static void cache_grow(void)
+{
+    unsigned int new_count = g_bucket_count * 2;
+    song_cache_entry_t **buckets = (song_cache_entry_t **)calloc(new_count, sizeof(song_cache_entry_t *));
+    if (!buckets)
+        return;
+    for (unsigned int i = 0; i < g_bucket_count; i++)
+    {
+        song_cache_entry_t *entry = g_buckets[i];
+        while (entry)
+        {
+            song_cache_entry_t *next = entry->bucket_next;
+            entry->bucket_next = buckets[entry->hash & (new_count - 1)];
+            buckets[entry->hash & (new_count - 1)] = entry;
+            entry = next;
+        }
+    }
+    free(g_buckets);
+    g_buckets = buckets;
+    g_bucket_count = new_count;
+}
+
+// 从哈希表和 LRU 中摘除并释放条目
+static void cache_remove(song_cache_entry_t *entry)
+{
+    song_cache_entry_t **pp = &g_buckets[entry->hash & (g_bucket_count - 1)];
+    while (*pp && *pp != entry)
+        pp = &(*pp)->bucket_next;
+    if (*pp)
+        *pp = entry->bucket_next;
+    lru_unlink(entry);
+    g_stats.entries--;
+    g_stats.bytes -= entry->bytes;
+    free(entry->value);
+    free(entry);
+}
+
+// 超过内存上限时从 LRU 尾部淘汰（进行中的条目不在 LRU 中，不会被淘汰）
+static void cache_evict(void)
+{
+    while (g_stats.bytes > g_max_bytes && g_lru_tail)
+    {
+        cache_remove(g_lru_tail);
+        g_stats.evictions++;
+    }
+}
+
+static int add_waiter(song_cache_entry_t *entry, song_cache_cb cb, void *arg)
+{
+    song_cache_waiter_t *waiter = (song_cache_waiter_t *)malloc(sizeof(song_cache_waiter_t));
+    if (!waiter)
+    {
+        lwsl_err("Failed to allocate memory for song_cache_waiter_t\n");
+        return -1;
+    }
+    memset(waiter, 0, sizeof(song_cache_waiter_t));
+    waiter->cb = cb;
+    waiter->arg = arg;
+    waiter->tsi = shard_current();
+    waiter->next = entry->waiters;
+    entry->waiters = waiter;
+    return 0;
+}
+
+// 在发起查询的线程上执行等待者回调
+static void waiter_run(void *arg)
+{
+    song_cache_waiter_t *waiter = (song_cache_waiter_t *)arg;
+    waiter->cb(waiter->song_hash, waiter->value, waiter->arg);
+    free(waiter->value);
+    free(waiter);
+}
+
+// 把结果交给等待者（调用时不能持有 g_lock，回调里可能再次查询缓存）
+static void dispatch_waiters(song_cache_waiter_t *waiter, const char *song_hash, const char *value)
+{
+    while (waiter)
+    {
+        song_cache_waiter_t *next = waiter->next;
+        strncpy(waiter->song_hash, song_hash, sizeof(waiter->song_hash) - 1);
+        waiter->value = value ? strdup(value) : NULL;
+        shard_post(waiter->tsi, waiter_run, waiter);
+        waiter = next;
+    }
+}
+
+// 初始化缓存
+int song_cache_init(size_t max_bytes, lws_usec_t song_url_ttl_us, lws_usec_t lyrics_url_ttl_us, lws_usec_t stale_grace_us)
+{
+    g_buckets = (song_cache_entry_t **)calloc(SONG_CACHE_INIT_BUCKETS, sizeof(song_cache_entry_t *));
+    if (!g_buckets)
+    {
+        lwsl_err("Failed to allocate memory for song cache\n");
+        return -1;
+    }
+    g_bucket_count = SONG_CACHE_INIT_BUCKETS;
+    g_max_bytes = max_bytes;
+    g_ttl_us[SONG_CACHE_SONG_URL] = song_url_ttl_us;
+    g_ttl_us[SONG_CACHE_LYRICS_URL] = lyrics_url_ttl_us;
+    g_stale_grace_us = stale_grace_us;
+    memset(&g_stats, 0, sizeof(g_stats));
+    return 0;
+}
+
+// 释放缓存，仍在等待的查询以失败回调
+void song_cache_destroy(void)
+{
+    for (unsigned int i = 0; i < g_bucket_count; i++)
+    {
+        while (g_buckets[i])
+        {
+            song_cache_entry_t *entry = g_buckets[i];
+            song_cache_waiter_t *waiter = entry->waiters;
+            entry->waiters = NULL;
+            dispatch_waiters(waiter, entry->song_hash, NULL);
+            cache_remove(entry);
+        }
+    }
+    free(g_buckets);
+    g_buckets = NULL;
+    g_bucket_count = 0;
+}
+
+// 查询缓存：命中时同步回调；未命中时登记等待，返回 MISS 的调用方负责请求上游
+enum song_cache_result song_cache_acquire(enum song_cache_kind kind, const char *song_hash, song_cache_cb cb, void *arg)
+{
+    if (!g_buckets || !song_hash || !cb)
+        return SONG_CACHE_ERROR;
+
+    enum song_cache_result result = SONG_CACHE_MISS;
+    uint32_t hash = cache_hash(kind, song_hash);
+    pthread_mutex_lock(&g_lock);
+    song_cache_entry_t *entry = cache_find(kind, song_hash, hash);
+    if (entry && entry->pending)
+    {
+        result = add_waiter(entry, cb, arg) < 0 ? SONG_CACHE_ERROR : SONG_CACHE_JOINED;
+        if (result == SONG_CACHE_JOINED)
+            g_stats.coalesced++;
+        pthread_mutex_unlock(&g_lock);
+        return result;
+    }
+    if (entry && entry->value && lws_now_usecs() < entry->expire_us)
+    {
+        g_stats.hits++;
+        lru_unlink(entry);
+        lru_push_front(entry);
+        // 解锁后条目可能被淘汰，先拷贝一份再回调
+        char *value = strdup(entry->value);
+        pthread_mutex_unlock(&g_lock);
+        if (!value)
+            return SONG_CACHE_ERROR;
+        cb(song_hash, value, arg);
+        free(value);
+        return SONG_CACHE_HIT;
+    }
+
+    if (entry)
+    {
+        // 已过期：转为请求中状态，从 LRU 摘除避免被淘汰
+        g_stats.expired++;
+        lru_unlink(entry);
+    }
+    else
+    {
+        entry = (song_cache_entry_t *)malloc(sizeof(song_cache_entry_t));
+        if (!entry)
+        {
+            pthread_mutex_unlock(&g_lock);
+            lwsl_err("Failed to allocate memory for song_cache_entry_t\n");
+            return SONG_CACHE_ERROR;
+        }
+        memset(entry, 0, sizeof(song_cache_entry_t));
+        entry->kind = kind;
+        strncpy(entry->song_hash, song_hash, sizeof(entry->song_hash) - 1);
+        entry->hash = hash;
+        entry->bytes = sizeof(song_cache_entry_t);
+        entry->bucket_next = g_buckets[hash & (g_bucket_count - 1)];
+        g_buckets[hash & (g_bucket_count - 1)] = entry;
+        g_stats.entries++;
+        g_stats.bytes += entry->bytes;
+        if (g_stats.entries > g_bucket_count)
+            cache_grow();
+    }
+    g_stats.misses++;
+    entry->pending = 1;
+    if (add_waiter(entry, cb, arg) < 0)
+    {
+        entry->pending = 0;
+        result = SONG_CACHE_ERROR;
+    }
+    pthread_mutex_unlock(&g_lock);
+    return result;
+}
+
+// 上游请求完成：写入缓存（value 为 NULL 表示失败）并回调所有等待者
+void song_cache_complete(enum song_cache_kind kind, const char *song_hash, const char *value)
+{
+    if (!g_buckets || !song_hash)
+        return;
+    pthread_mutex_lock(&g_lock);
+    song_cache_entry_t *entry = cache_find(kind, song_hash, cache_hash(kind, song_hash));
+    if (!entry || !entry->pending)
+    {
+        pthread_mutex_unlock(&g_lock);
+        return;
+    }
+
+    song_cache_waiter_t *waiter = entry->waiters;
+    char *stale = NULL;
+    entry->waiters = NULL;
+    entry->pending = 0;
+
+    if (value)
+    {
+        g_stats.bytes -= entry->bytes;
+        free(entry->value);
+        entry->value = strdup(value);
+        entry->bytes = sizeof(song_cache_entry_t) + (entry->value ? strlen(entry->value) + 1 : 0);
+        entry->expire_us = lws_now_usecs() + g_ttl_us[(int)kind];
+        g_stats.bytes += entry->bytes;
+        lru_push_front(entry);
+        cache_evict();
+    }
+    else if (entry->value && lws_now_usecs() < entry->expire_us + g_stale_grace_us)
+    {
+        // 上游失败但旧值还在宽限期内：以旧值应答，下次查询仍会重新请求；解锁后条目可能被淘汰，先拷贝
+        g_stats.stale++;
+        lru_push_front(entry);
+        stale = strdup(entry->value);
+        value = stale;
+    }
+    else
+    {
+        cache_remove(entry);
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    dispatch_waiters(waiter, song_hash, value);
+    free(stale);
+}
+
+song_cache_stats_t song_cache_get_stats(void)
+{
+    pthread_mutex_lock(&g_lock);
+    song_cache_stats_t stats = g_stats;
+    pthread_mutex_unlock(&g_lock);
+    return stats;
+}
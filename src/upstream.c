@@ -0,0 +1,704 @@
+#include "upstream.h"
+#include "shard.h"
+#include "metrics.h"
+#include "config.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// 基于 curl multi 的非阻塞上游请求：curl 的 socket 交给 lws 事件循环监听，
+// curl 的超时由 lws 定时器驱动，请求完成后在服务线程内回调。
+// 多服务线程时 socket 事件可能落在任意线程，curl multi 由 g_lock 保护；
+// 超时定时器固定在 0 号线程，完成回调投递回发起请求的线程执行。
+// 连接复用：easy 句柄用完放回空闲池（不再每次创建销毁），到上游的 keep-alive 连接留在
+// multi 的连接缓存里供后续请求复用；DNS 缓存和 TLS 会话放在共享句柄里，句柄换了也不丢。
+// 所有 curl 调用都在 g_lock 下进行，共享句柄不需要另设锁。
+// 容错：每个请求按接口设置毫秒级截止时间；每个接口一个熔断器，上游不健康时直接失败，
+// 由歌曲缓存以过期值应答；可选对冲请求，超过该接口近期 p95 耗时仍未完成时再发一个，先成功的为准。
+
+#define UPSTREAM_POOL_MAX 64          // 空闲 easy 句柄上限
+#define UPSTREAM_SAMPLES 256          // 对冲延迟按最近多少次成功请求的耗时估计
+#define UPSTREAM_HEDGE_MIN_SAMPLES 20 // 样本少于该数时不对冲
+
+// 各接口的路径，查询参数值追加在后面
+static const struct
+{
+    const char *name; // 指标标签
+    const char *path;
+} g_endpoints[UPSTREAM_ENDPOINT_MAX] = {
+    [UPSTREAM_SONG_URL] = {"song_url", "/song/url?hash="},
+    [UPSTREAM_SEARCH_LYRIC] = {"search_lyric", "/search/lyric?hash="},
+};
+
+static const char *g_breaker_names[UPSTREAM_BREAKER_STATE_MAX] = {"closed", "open", "half_open"};
+
+// 每个接口的熔断器和近期耗时（由 g_lock 保护）
+typedef struct upstream_endpoint_state
+{
+    int breaker;                            // enum upstream_breaker_state
+    int failures;                           // 连续失败次数
+    char probing;                           // 半开状态下的探测请求进行中
+    lws_usec_t open_until_us;               // 熔断到期时间，之后放行一个探测请求
+    unsigned int samples[UPSTREAM_SAMPLES]; // 最近成功请求的耗时（微秒），环形
+    unsigned long sample_count;
+    upstream_endpoint_stats_t stats;
+} upstream_endpoint_state_t;
+
+// 内存结构体
+struct ResponseData
+{
+    char *data;
+    size_t size;
+};
+
+// 单个上游请求：0 号句柄为原始请求，1 号为对冲请求
+typedef struct upstream_request
+{
+    CURL *curl[2];
+    struct ResponseData response[2]; // 结束后成功的结果在 0 号
+    upstream_cb cb;
+    void *arg;
+    int tsi;                          // 发起请求的服务线程
+    int endpoint;                     // enum upstream_endpoint
+    lws_usec_t start_us;              // 发起请求的时间
+    lws_usec_t hedge_us;              // 发出对冲请求的时间
+    lws_usec_t finish_us;             // 请求结束的时间
+    lws_sorted_usec_list_t hedge_sul; // 对冲定时器，在发起请求的线程上
+    char finished;                    // 已结束，等待回调
+    char probe;                       // 半开状态下的探测请求
+    char ok;                          // 请求是否成功
+    char url[512];
+    struct upstream_request *next;
+    struct upstream_request *prev;
+} upstream_request_t;
+
+// curl socket 与 lws 连接的对应关系（按 fd 索引）
+typedef struct upstream_sock
+{
+    struct lws *wsi; // 托管该 socket 的 lws 连接
+    int what;        // curl 当前关注的事件 CURL_POLL_*
+    char lws_closed; // lws 已经关闭了 fd，curl 关闭时不能再 close
+} upstream_sock_t;
+
+static CURLM *g_multi = NULL;
+static CURLSH *g_share = NULL;
+static CURL *g_pool[UPSTREAM_POOL_MAX]; // 空闲的 easy 句柄
+static int g_pool_len = 0;
+static struct lws_context *g_context = NULL;
+static struct lws_vhost *g_vhost = NULL;
+static lws_sorted_usec_list_t g_timer;
+static upstream_request_t *g_requests = NULL; // 未完成的请求链表
+static upstream_sock_t *g_socks = NULL;
+static int g_socks_size = 0;
+static long g_timeout_ms = -1; // curl 最近一次要求的超时
+static upstream_endpoint_state_t g_state[UPSTREAM_ENDPOINT_MAX];
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static upstream_request_t *check_multi_info(void);
+static size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp);
+static int closesocket_function(void *clientp, curl_socket_t fd);
+
+// 在发起请求的线程上回调并释放请求
+static void request_done(void *arg)
+{
+    upstream_request_t *request = (upstream_request_t *)arg;
+    lws_sul_cancel(&request->hedge_sul);
+    metrics_upstream((enum upstream_endpoint)request->endpoint, request->finish_us - request->start_us, request->ok);
+    if (request->ok)
+        request->cb(request->response[0].data, request->response[0].size, request->arg);
+    else
+    {
+        metrics_add(METRIC_UPSTREAM_ERRORS, 1);
+        request->cb(NULL, 0, request->arg);
+    }
+    free(request->response[0].data);
+    free(request->response[1].data);
+    free(request);
+}
+
+// 从空闲池取一个 easy 句柄，池空时新建并设置所有请求共用的选项（需持有 g_lock）
+static CURL *acquire_handle(void)
+{
+    if (g_pool_len > 0)
+        return g_pool[--g_pool_len];
+    CURL *curl = curl_easy_init();
+    if (!curl)
+        return NULL;
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_CLOSESOCKETFUNCTION, closesocket_function);
+    curl_easy_setopt(curl, CURLOPT_SHARE, g_share);
+
+    // 其他选项
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "MyCurlClient/1.0");
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, ""); // 接受 curl 支持的所有压缩格式
+    if (g_config.upstream_http2)
+    {
+        // http:// 没有 ALPN，只能按已知支持直接说 HTTP/2；等待复用已有连接而不是另开新连接
+        long version = strncmp(g_config.upstream_url, "https://", 8) ? CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE
+                                                                     : CURL_HTTP_VERSION_2TLS;
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, version);
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    }
+    return curl;
+}
+
+// 句柄放回空闲池，池满时释放（需持有 g_lock）
+static void release_handle(CURL *curl)
+{
+    if (g_pool_len < UPSTREAM_POOL_MAX)
+        g_pool[g_pool_len++] = curl;
+    else
+        curl_easy_cleanup(curl);
+}
+
+// 停止请求的一个句柄并归还（需持有 g_lock）
+static void drop_handle(upstream_request_t *request, int slot)
+{
+    if (!request->curl[slot])
+        return;
+    curl_multi_remove_handle(g_multi, request->curl[slot]);
+    release_handle(request->curl[slot]);
+    request->curl[slot] = NULL;
+}
+
+// 结束请求：从链表摘除并归还 curl 句柄（需持有 g_lock），回调由调用方在解锁后投递
+static void finish_request(upstream_request_t *request, char ok)
+{
+    if (request->prev)
+        request->prev->next = request->next;
+    else
+        g_requests = request->next;
+    if (request->next)
+        request->next->prev = request->prev;
+    drop_handle(request, 0);
+    drop_handle(request, 1);
+    request->finish_us = lws_now_usecs();
+    request->finished = 1;
+    request->ok = ok;
+}
+
+static void breaker_set(int endpoint, enum upstream_breaker_state state)
+{
+    upstream_endpoint_state_t *ep = &g_state[endpoint];
+    if (ep->breaker == (int)state)
+        return;
+    ep->breaker = state;
+    ep->stats.transitions[state]++;
+    lwsl_notice("上游接口 %s 熔断器: %s\n", g_endpoints[endpoint].name, g_breaker_names[state]);
+}
+
+// 熔断器放行判断（需持有 g_lock），返回 -1 表示直接失败；半开时放行的唯一请求标记为探测请求
+static int breaker_admit(int endpoint, char *probe)
+{
+    upstream_endpoint_state_t *ep = &g_state[endpoint];
+    *probe = 0;
+    if (!g_config.breaker_failures || ep->breaker == UPSTREAM_BREAKER_CLOSED)
+        return 0;
+    if (ep->breaker == UPSTREAM_BREAKER_OPEN && lws_now_usecs() >= ep->open_until_us)
+    {
+        breaker_set(endpoint, UPSTREAM_BREAKER_HALF_OPEN);
+        ep->probing = 0;
+    }
+    if (ep->breaker == UPSTREAM_BREAKER_HALF_OPEN && !ep->probing)
+    {
+        ep->probing = 1;
+        *probe = 1;
+        return 0;
+    }
+    ep->stats.rejected++;
+    return -1;
+}
+
+// 记录一次请求结果（需持有 g_lock）：成功关闭熔断器，连续失败达到阈值或探测失败时打开
+static void breaker_record(int endpoint, int ok, char probe)
+{
+    upstream_endpoint_state_t *ep = &g_state[endpoint];
+    if (probe)
+        ep->probing = 0;
+    if (!g_config.breaker_failures)
+        return;
+    if (ok)
+    {
+        ep->failures = 0;
+        breaker_set(endpoint, UPSTREAM_BREAKER_CLOSED);
+        return;
+    }
+    ep->failures++;
+    if (ep->breaker == UPSTREAM_BREAKER_HALF_OPEN ||
+        (ep->breaker == UPSTREAM_BREAKER_CLOSED && ep->failures >= g_config.breaker_failures))
+    {
+        ep->open_until_us = lws_now_usecs() + (lws_usec_t)g_config.breaker_cooldown_ms * LWS_US_PER_MS;
+        breaker_set(endpoint, UPSTREAM_BREAKER_OPEN);
+    }
+}
+
+static int cmp_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 记录一次成功请求的耗时，开启对冲时每 16 个样本重新估计一次 p95（需持有 g_lock）
+static void record_sample(int endpoint, lws_usec_t elapsed_us)
+{
+    upstream_endpoint_state_t *ep = &g_state[endpoint];
+    ep->samples[ep->sample_count++ % UPSTREAM_SAMPLES] = elapsed_us > 0 ? (unsigned int)elapsed_us : 0;
+    if (!g_config.upstream_hedge || ep->sample_count < UPSTREAM_HEDGE_MIN_SAMPLES || ep->sample_count % 16)
+        return;
+    unsigned int sorted[UPSTREAM_SAMPLES];
+    size_t n = ep->sample_count < UPSTREAM_SAMPLES ? ep->sample_count : UPSTREAM_SAMPLES;
+    memcpy(sorted, ep->samples, n * sizeof(unsigned int));
+    qsort(sorted, n, sizeof(unsigned int), cmp_uint);
+    ep->stats.hedge_delay_us = sorted[n * 95 / 100] > 0 ? sorted[n * 95 / 100] : 1;
+}
+
+// 一个句柄的截止时间（毫秒）
+static long endpoint_timeout_ms(int endpoint)
+{
+    return endpoint == UPSTREAM_SONG_URL ? g_config.song_url_timeout_ms : g_config.lyrics_url_timeout_ms;
+}
+
+// 给请求的一个槽位装上句柄并加入 multi（需持有 g_lock）
+static int start_handle(upstream_request_t *request, int slot, long timeout_ms)
+{
+    request->response[slot].data = malloc(1);
+    if (!request->response[slot].data)
+        return -1;
+    request->response[slot].data[0] = '\0';
+    request->response[slot].size = 0;
+    CURL *curl = acquire_handle();
+    if (!curl)
+        return -1;
+
+    // 每个请求不同的选项，其余在句柄创建时已设置
+    curl_easy_setopt(curl, CURLOPT_URL, request->url);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&request->response[slot]);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, request);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+    if (curl_multi_add_handle(g_multi, curl) != CURLM_OK)
+    {
+        release_handle(curl);
+        return -1;
+    }
+    request->curl[slot] = curl;
+    return 0;
+}
+
+// 对冲定时器到期（在发起请求的线程上）：原始请求仍未完成时，以剩余的截止时间再发一个相同请求
+static void hedge_fire(lws_sorted_usec_list_t *sul)
+{
+    upstream_request_t *request = lws_container_of(sul, upstream_request_t, hedge_sul);
+    pthread_mutex_lock(&g_lock);
+    lws_usec_t now = lws_now_usecs();
+    long remaining_ms = endpoint_timeout_ms(request->endpoint) - (long)((now - request->start_us) / LWS_US_PER_MS);
+    if (!request->finished && request->curl[0] && !request->curl[1] && remaining_ms > 0 &&
+        g_state[request->endpoint].breaker == UPSTREAM_BREAKER_CLOSED)
+    {
+        if (start_handle(request, 1, remaining_ms) == 0)
+        {
+            request->hedge_us = now;
+            g_state[request->endpoint].stats.hedged++;
+            metrics_add(METRIC_UPSTREAM_REQUESTS, 1);
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+// 把已结束的请求投递回各自的线程
+static void dispatch_done(upstream_request_t *done)
+{
+    while (done)
+    {
+        upstream_request_t *next = done->next;
+        shard_post(done->tsi, request_done, done);
+        done = next;
+    }
+}
+
+// 写入回调函数
+static size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    size_t realsize = size * nmemb;
+    struct ResponseData *mem = (struct ResponseData *)userp;
+
+    char *ptr = realloc(mem->data, mem->size + realsize + 1);
+    if (!ptr)
+        return 0;
+
+    mem->data = ptr;
+    memcpy(&(mem->data[mem->size]), contents, realsize);
+    mem->size += realsize;
+    mem->data[mem->size] = 0;
+
+    return realsize;
+}
+
+// 获取 fd 对应的槽位，必要时扩容
+static upstream_sock_t *get_sock(curl_socket_t fd)
+{
+    if (fd < 0)
+        return NULL;
+    if (fd >= g_socks_size)
+    {
+        int new_size = g_socks_size ? g_socks_size : 64;
+        while (new_size <= fd)
+            new_size *= 2;
+        upstream_sock_t *socks = realloc(g_socks, new_size * sizeof(upstream_sock_t));
+        if (!socks)
+        {
+            lwsl_err("Failed to allocate memory for upstream sockets\n");
+            return NULL;
+        }
+        memset(socks + g_socks_size, 0, (new_size - g_socks_size) * sizeof(upstream_sock_t));
+        g_socks = socks;
+        g_socks_size = new_size;
+    }
+    return &g_socks[fd];
+}
+
+// 通知 curl 某个 socket 上有事件
+static void socket_action(curl_socket_t fd, int ev_bitmask)
+{
+    int running = 0;
+    pthread_mutex_lock(&g_lock);
+    curl_multi_socket_action(g_multi, fd, ev_bitmask, &running);
+    upstream_request_t *done = check_multi_info();
+    pthread_mutex_unlock(&g_lock);
+    dispatch_done(done);
+}
+
+// curl 超时到期
+static void timeout_callback(lws_sorted_usec_list_t *sul)
+{
+    socket_action(CURL_SOCKET_TIMEOUT, 0);
+}
+
+// 在 0 号线程上按 curl 最近一次的要求布置超时定时器
+static void arm_timer(void *arg)
+{
+    pthread_mutex_lock(&g_lock);
+    long timeout_ms = g_timeout_ms;
+    pthread_mutex_unlock(&g_lock);
+    if (timeout_ms < 0)
+    {
+        lws_sul_cancel(&g_timer);
+        return;
+    }
+    lws_sul_schedule(g_context, 0, &g_timer, timeout_callback, timeout_ms * LWS_US_PER_MS);
+}
+
+// curl 要求调整超时（持有 g_lock 时被调用）
+static int timer_function(CURLM *multi, long timeout_ms, void *userp)
+{
+    g_timeout_ms = timeout_ms;
+    if (shard_current() == 0)
+    {
+        if (timeout_ms < 0)
+            lws_sul_cancel(&g_timer);
+        else
+            lws_sul_schedule(g_context, 0, &g_timer, timeout_callback, timeout_ms * LWS_US_PER_MS);
+        return 0;
+    }
+    // 定时器只能在所属线程上操作
+    shard_post(0, arm_timer, NULL);
+    return 0;
+}
+
+// curl 要求调整某个 socket 的监听事件
+static int socket_function(CURL *easy, curl_socket_t fd, int what, void *userp, void *socketp)
+{
+    upstream_sock_t *sock = get_sock(fd);
+    if (!sock)
+        return -1;
+
+    sock->what = what == CURL_POLL_REMOVE ? 0 : what;
+    if (!sock->wsi)
+    {
+        if (what == CURL_POLL_REMOVE)
+            return 0;
+        lws_sock_file_fd_type desc;
+        desc.sockfd = fd;
+        sock->wsi = lws_adopt_descriptor_vhost(g_vhost, LWS_ADOPT_RAW_FILE_DESC, desc, "upstream-curl", NULL);
+        if (!sock->wsi)
+        {
+            lwsl_err("Failed to adopt upstream socket %d\n", fd);
+            return -1;
+        }
+        sock->lws_closed = 0;
+    }
+    // 连接可能留在 curl 的连接缓存里，这里只停止监听，socket 由 curl 关闭
+    lws_rx_flow_control(sock->wsi, (sock->what & CURL_POLL_IN) ? 1 : 0);
+    if (sock->what & CURL_POLL_OUT)
+    {
+        lws_callback_on_writable(sock->wsi);
+    }
+    return 0;
+}
+
+// curl 关闭 socket：由 lws 负责关闭托管的 fd
+static int closesocket_function(void *clientp, curl_socket_t fd)
+{
+    upstream_sock_t *sock = get_sock(fd);
+    if (!sock || !sock->wsi)
+    {
+        if (!sock || !sock->lws_closed)
+            close(fd);
+        if (sock)
+            sock->lws_closed = 0;
+        return 0;
+    }
+    struct lws *wsi = sock->wsi;
+    memset(sock, 0, sizeof(upstream_sock_t));
+    lws_set_opaque_user_data(wsi, NULL);
+    lws_set_timeout(wsi, PENDING_TIMEOUT_USER_OK, LWS_TO_KILL_ASYNC);
+    return 0;
+}
+
+// 取出已完成的请求（需持有 g_lock），返回待回调的请求链表
+static upstream_request_t *check_multi_info(void)
+{
+    upstream_request_t *done = NULL;
+    CURLMsg *msg;
+    int pending;
+    while ((msg = curl_multi_info_read(g_multi, &pending)))
+    {
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+        upstream_request_t *request = NULL;
+        char *url = NULL;
+        long code = 0;
+        long connects = 0;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&request);
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_EFFECTIVE_URL, &url);
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &code);
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_NUM_CONNECTS, &connects);
+        metrics_add(METRIC_UPSTREAM_CONNECTS, (unsigned long)connects);
+        int slot = msg->easy_handle == request->curl[1];
+        upstream_endpoint_state_t *ep = &g_state[request->endpoint];
+        CURLcode res = msg->data.result;
+        // 5xx 视为上游不健康，和传输错误一样计入熔断
+        int ok = res == CURLE_OK && code < 500;
+        if (res != CURLE_OK)
+        {
+            lwsl_err("Failed to perform HTTP request: %s--:%s\n", url ? url : "", curl_easy_strerror(res));
+            if (res == CURLE_OPERATION_TIMEDOUT)
+                ep->stats.timeouts++;
+        }
+        else if (!ok)
+        {
+            lwsl_err("Failed to perform HTTP request: %s--:HTTP %ld\n", url ? url : "", code);
+        }
+        if (ok)
+            record_sample(request->endpoint, lws_now_usecs() - (slot ? request->hedge_us : request->start_us));
+        else if (request->curl[!slot])
+        {
+            // 另一个句柄还在进行，以它的结果为准
+            drop_handle(request, slot);
+            continue;
+        }
+        if (ok && slot)
+        {
+            // 对冲请求先成功：结果换到 0 号
+            struct ResponseData response = request->response[0];
+            request->response[0] = request->response[1];
+            request->response[1] = response;
+            ep->stats.hedge_wins++;
+        }
+        breaker_record(request->endpoint, ok, request->probe);
+        finish_request(request, ok);
+        request->next = done;
+        done = request;
+    }
+    return done;
+}
+
+const char *upstream_endpoint_name(enum upstream_endpoint endpoint)
+{
+    return endpoint >= 0 && endpoint < UPSTREAM_ENDPOINT_MAX ? g_endpoints[endpoint].name : "unknown";
+}
+
+// 向上游接口发起异步 GET 请求（hash 为查询参数值），完成后在发起请求的服务线程内调用 cb；
+// 接口熔断中时直接返回 -1
+int upstream_get(enum upstream_endpoint endpoint, const char *hash, upstream_cb cb, void *arg)
+{
+    if (!g_multi || endpoint < 0 || endpoint >= UPSTREAM_ENDPOINT_MAX || !hash || !cb)
+        return -1;
+
+    upstream_request_t *request = (upstream_request_t *)malloc(sizeof(upstream_request_t));
+    if (!request)
+    {
+        lwsl_err("Failed to allocate memory for upstream request\n");
+        metrics_add(METRIC_UPSTREAM_ERRORS, 1);
+        return -1;
+    }
+    memset(request, 0, sizeof(upstream_request_t));
+    request->cb = cb;
+    request->arg = arg;
+    request->tsi = shard_current();
+    request->endpoint = endpoint;
+    request->start_us = lws_now_usecs();
+
+    pthread_mutex_lock(&g_lock);
+    if (breaker_admit(endpoint, &request->probe) < 0)
+    {
+        pthread_mutex_unlock(&g_lock);
+        free(request);
+        return -1;
+    }
+    metrics_add(METRIC_UPSTREAM_REQUESTS, 1);
+    CURL *curl = acquire_handle();
+    char *escaped = curl ? curl_easy_escape(curl, hash, 0) : NULL;
+    if (curl)
+        release_handle(curl);
+    if (escaped)
+    {
+        snprintf(request->url, sizeof(request->url), "%s%s%s", g_config.upstream_url, g_endpoints[endpoint].path, escaped);
+        curl_free(escaped);
+    }
+    if (!escaped || start_handle(request, 0, endpoint_timeout_ms(endpoint)) < 0)
+    {
+        if (request->probe)
+            g_state[endpoint].probing = 0;
+        pthread_mutex_unlock(&g_lock);
+        lwsl_err("Failed to add upstream request: %s\n", request->url);
+        free(request->response[0].data);
+        free(request);
+        metrics_add(METRIC_UPSTREAM_ERRORS, 1);
+        return -1;
+    }
+    request->next = g_requests;
+    if (g_requests)
+        g_requests->prev = request;
+    g_requests = request;
+    lws_usec_t hedge_delay_us = request->probe ? 0 : g_state[endpoint].stats.hedge_delay_us;
+    pthread_mutex_unlock(&g_lock);
+
+    // 请求结束后由 request_done 在本线程取消定时器，所以这里不会和释放竞争
+    if (g_config.upstream_hedge && hedge_delay_us > 0)
+        lws_sul_schedule(g_context, request->tsi, &request->hedge_sul, hedge_fire, hedge_delay_us);
+    return 0;
+}
+
+const char *upstream_breaker_state_name(enum upstream_breaker_state state)
+{
+    return state >= 0 && state < UPSTREAM_BREAKER_STATE_MAX ? g_breaker_names[state] : "unknown";
+}
+
+void upstream_get_stats(upstream_endpoint_stats_t stats[UPSTREAM_ENDPOINT_MAX])
+{
+    pthread_mutex_lock(&g_lock);
+    for (int i = 0; i < UPSTREAM_ENDPOINT_MAX; i++)
+    {
+        stats[i] = g_state[i].stats;
+        stats[i].breaker_state = g_state[i].breaker;
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+// lws 侧的 socket 事件回调
+int callback_upstream(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len)
+{
+    curl_socket_t fd;
+    upstream_sock_t *sock;
+    switch (reason)
+    {
+    case LWS_CALLBACK_RAW_RX_FILE:
+        socket_action(lws_get_socket_fd(wsi), CURL_CSELECT_IN);
+        break;
+    case LWS_CALLBACK_RAW_WRITEABLE_FILE:
+        fd = lws_get_socket_fd(wsi);
+        socket_action(fd, CURL_CSELECT_OUT);
+        // curl 仍然需要可写事件时继续申请
+        pthread_mutex_lock(&g_lock);
+        sock = get_sock(fd);
+        if (sock && sock->wsi == wsi && (sock->what & CURL_POLL_OUT))
+        {
+            lws_callback_on_writable(wsi);
+        }
+        pthread_mutex_unlock(&g_lock);
+        break;
+    case LWS_CALLBACK_RAW_CLOSE_FILE:
+        // lws 主动关闭（如对端挂断）时，fd 已经无效，通知 curl 后不能重复关闭
+        fd = lws_get_socket_fd(wsi);
+        pthread_mutex_lock(&g_lock);
+        sock = get_sock(fd);
+        if (sock && sock->wsi == wsi)
+        {
+            sock->wsi = NULL;
+            sock->lws_closed = 1;
+            pthread_mutex_unlock(&g_lock);
+            socket_action(fd, CURL_CSELECT_ERR);
+            break;
+        }
+        pthread_mutex_unlock(&g_lock);
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+// 初始化上游请求引擎（需在 lws 上下文创建后调用）
+int upstream_init(struct lws_context *context)
+{
+    g_context = context;
+    g_vhost = lws_get_vhost_by_name(context, "default");
+    if (!g_vhost)
+    {
+        lwsl_err("Failed to find default vhost for upstream\n");
+        return -1;
+    }
+    g_share = curl_share_init();
+    if (!g_share)
+    {
+        lwsl_err("Failed to init curl share\n");
+        return -1;
+    }
+    curl_share_setopt(g_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(g_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    g_multi = curl_multi_init();
+    if (!g_multi)
+    {
+        lwsl_err("Failed to init curl multi\n");
+        curl_share_cleanup(g_share);
+        g_share = NULL;
+        return -1;
+    }
+    curl_multi_setopt(g_multi, CURLMOPT_SOCKETFUNCTION, socket_function);
+    curl_multi_setopt(g_multi, CURLMOPT_TIMERFUNCTION, timer_function);
+    curl_multi_setopt(g_multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+    if (g_config.upstream_max_connections > 0)
+    {
+        curl_multi_setopt(g_multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)g_config.upstream_max_connections);
+        curl_multi_setopt(g_multi, CURLMOPT_MAXCONNECTS, (long)g_config.upstream_max_connections);
+    }
+    return 0;
+}
+
+// 释放上游请求引擎，未完成的请求以失败回调（需在服务线程全部退出后调用）
+void upstream_destroy(void)
+{
+    if (!g_multi)
+        return;
+    while (g_requests)
+    {
+        upstream_request_t *request = g_requests;
+        finish_request(request, 0);
+        request->next = NULL;
+        dispatch_done(request);
+    }
+    lws_sul_cancel(&g_timer);
+    while (g_pool_len > 0)
+        curl_easy_cleanup(g_pool[--g_pool_len]);
+    curl_multi_cleanup(g_multi);
+    g_multi = NULL;
+    curl_share_cleanup(g_share);
+    g_share = NULL;
+    free(g_socks);
+    g_socks = NULL;
+    g_socks_size = 0;
+}
@@ -4,18 +4,34 @@
 #include <string.h>
 #include <signal.h>
 #include <pthread.h>
+#include <unistd.h>
 #include "types.h"
 #include <stdbool.h>
 #include "playlist.h"
+#include "upstream.h"
+#include "msg_buf.h"
+#include "msg_template.h"
+#include "ctrl_parser.h"
+#include "wire_cbor.h"
+#include "presence.h"
+#include "send_queue.h"
+#include "song_cache.h"
+#include "config.h"
+#include "shard.h"
+#include "worker.h"
+#include "metrics.h"
+#include "latency.h"
 
 int callback_echo(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len);
 static void success_response(client_info_t *client, const char *msg);
 static void error_response(client_info_t *client, const char *msg);
 
 struct lws_context *context = NULL;
-static int interrupted = 0;
 
-rooms_t *g_rooms_list = NULL; // 房间链表
+#define WS_TX_CHUNK 4096 // 出站消息每个 WebSocket 分片的最大长度
+// 出站分片的发送缓冲区（前面预留 LWS_PRE 字节给 lws 写帧头），每个服务线程一份
+static __thread unsigned char t_tx_chunk[LWS_PRE + WS_TX_CHUNK];
+static volatile int interrupted = 0;
 
 // 定义协议处理结构
 static struct lws_protocols protocols[] = {
@@ -25,9 +41,87 @@ static struct lws_protocols protocols[] = {
         0,               // 每个连接的用户数据大小
         1024,            // 接收缓冲区大小
     },
+    {
+        "ctrl-protocol.bin", // 与 ctrl-protocol 相同的命令和广播，以 CBOR 编码（见 wire_cbor.h）
+        callback_echo,       // 回调函数
+        0,                   // 每个连接的用户数据大小
+        1024,                // 接收缓冲区大小
+    },
+    {
+        "metrics-http",            // /metrics 挂载点的 HTTP 请求
+        callback_metrics,          // 回调函数
+        sizeof(metrics_session_t), // 每个连接的用户数据大小
+        0,                         // 接收缓冲区大小
+    },
+    {
+        "upstream-curl",   // 上游 HTTP 请求托管的 socket
+        callback_upstream, // 回调函数
+        0,                 // 每个连接的用户数据大小
+        0,                 // 接收缓冲区大小
+    },
+    {
+        "worker-ctrl",   // 多进程模式下接收路由进程转交连接的 socket
+        callback_worker, // 回调函数
+        0,               // 每个连接的用户数据大小
+        0,               // 接收缓冲区大小
+    },
+    {
+        "shard-wake",   // 跨服务线程投递任务时唤醒目标线程的 eventfd
+        callback_shard, // 回调函数
+        0,              // 每个连接的用户数据大小
+        0,              // 接收缓冲区大小
+    },
     {NULL, NULL, 0, 0} // 协议列表结束标记
 };
 
+// Prometheus 指标挂载点，由 metrics-http 协议回调处理
+static const struct lws_http_mount metrics_mount = {
+    .mountpoint = "/metrics",
+    .origin = "metrics-http",
+    .origin_protocol = LWSMPRO_CALLBACK,
+    .mountpoint_len = 8,
+};
+
+// 本线程最近一次成功协商出 permessage-deflate 的连接：lws 在同一次握手处理中先构造扩展、
+// 再回调 LWS_CALLBACK_ESTABLISHED，建立时比较一下就知道这条连接实际协商的结果
+static __thread struct lws *t_deflate_wsi = NULL;
+
+// 包一层 lws 自带的 permessage-deflate 回调，只记录协商结果，行为不变
+static int ext_callback_pm_deflate(struct lws_context *ctx, const struct lws_extension *ext, struct lws *wsi,
+                                   enum lws_extension_callback_reasons reason, void *user, void *in, size_t len)
+{
+    int ret = lws_extension_callback_pm_deflate(ctx, ext, wsi, reason, user, in, len);
+    switch (reason)
+    {
+    case LWS_EXT_CB_CONSTRUCT:
+        if (!ret)
+            t_deflate_wsi = wsi;
+        break;
+    case LWS_EXT_CB_OPTION_CONFIRM:
+        // 客户端参数不被接受
+        if (ret && t_deflate_wsi == wsi)
+            t_deflate_wsi = NULL;
+        break;
+    case LWS_EXT_CB_DESTROY:
+        if (t_deflate_wsi == wsi)
+            t_deflate_wsi = NULL;
+        break;
+    default:
+        break;
+    }
+    return ret;
+}
+
+// WebSocket 扩展：permessage-deflate（--deflate-level 0 时不注册）
+static const struct lws_extension extensions[] = {
+    {
+        "permessage-deflate",
+        ext_callback_pm_deflate,
+        "permessage-deflate; client_no_context_takeover; client_max_window_bits",
+    },
+    {NULL, NULL, NULL} // 扩展列表结束标记
+};
+
 // 头插法插入客户端节点
 bool insert_client_node(client_info_t *head, client_info_t *new_node)
 {
@@ -45,31 +139,171 @@ bool insert_client_node(client_info_t *head, client_info_t *new_node)
     return true;
 }
 
-// 申请节点并填充客户端信息,返回改节点指针
-client_info_t *insert_client_info(struct lws *wsi, const char *ip, rooms_t *room, const char *userId)
+// 申请节点并填充客户端信息,返回改节点指针（此时还未加入房间，连接持有一份引用）
+client_info_t *new_client_info(struct lws *wsi, const char *ip, const char *userId)
 {
     client_info_t *new_node = (client_info_t *)malloc(sizeof(client_info_t));
     if (!new_node)
     {
         lwsl_err("Failed to allocate memory for client_info_t\n");
-        return false;
+        return NULL;
     }
     memset(new_node, 0, sizeof(client_info_t));
     pthread_mutex_init(&new_node->lock, NULL);
     new_node->wsi = wsi;
     strncpy(new_node->ip, ip, INET_ADDRSTRLEN - 1);
-    new_node->room = room;
     strncpy(new_node->userId, userId, 63);
+    new_node->refcount = 1;
+    new_node->tsi = shard_current();
     new_node->next = NULL;
     new_node->prev = NULL;
-    if (!insert_client_node(room->client_info, new_node))
+    return new_node;
+}
+
+static client_info_t *client_ref(client_info_t *client)
+{
+    __atomic_add_fetch(&client->refcount, 1, __ATOMIC_RELAXED);
+    return client;
+}
+
+// 最后一份引用释放时清空出站队列并释放节点
+static void client_unref(client_info_t *client)
+{
+    if (__atomic_sub_fetch(&client->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+    send_queue_clear(client);
+    msg_buf_unref(client->tx_buf);
+    free(client->rx_buf);
+    pthread_mutex_destroy(&client->lock);
+    free(client);
+}
+
+// 以下任务在连接所在线程执行，wsi 只在该线程读写，连接关闭后为 NULL
+static void client_writable_task(void *arg)
+{
+    client_info_t *client = (client_info_t *)arg;
+    __atomic_store_n(&client->wake_pending, 0, __ATOMIC_RELEASE);
+    if (client->wsi)
+        lws_callback_on_writable(client->wsi);
+    client_unref(client);
+}
+
+static void client_kill_task(void *arg)
+{
+    client_info_t *client = (client_info_t *)arg;
+    if (client->wsi)
+        lws_set_timeout(client->wsi, PENDING_TIMEOUT_USER_OK, LWS_TO_KILL_ASYNC);
+    client_unref(client);
+}
+
+// 消息放入客户端出站队列并唤醒发送，超出预算的连接会被断开
+static void enqueue_to_client(client_info_t *client, msg_buf_t *buf, enum send_policy policy, int action)
+{
+    shard_task_fn task = client_writable_task;
+    metrics_message_out(action);
+    latency_attach(buf);
+    if (send_queue_push(client, buf, policy, action) < 0)
     {
-        lwsl_err("Failed to insert client node into room's client list\n");
-        free(new_node);
-        return NULL;
+        lwsl_err("%s 出站队列超出预算(深度 %u)，断开连接\n", client->ip, client->queue_len);
+        task = client_kill_task;
     }
-    room->client_counter++;
-    return new_node;
+    else if (__atomic_exchange_n(&client->wake_pending, 1, __ATOMIC_ACQ_REL))
+    {
+        // 已有唤醒任务在途，它执行时会看到这条新消息
+        return;
+    }
+    // 连接可能在别的服务线程上，wsi 的操作交给该线程执行
+    if (shard_post(client->tsi, task, client_ref(client)) < 0)
+        client_unref(client);
+}
+
+// 某客户端单独发送已生成的消息缓冲区，action 用于按消息种类统计（操作回复为 0）
+static void send_buf_to_client(client_info_t *client, msg_buf_t *buf, int action)
+{
+    if (!client || !buf)
+        return;
+    enqueue_to_client(client, buf, SEND_RELIABLE, action);
+}
+
+// 某客户端单独发送信息
+static void send_message_to_client(client_info_t *client, const char *msg, int action)
+{
+    if (!client || !msg)
+        return;
+    msg_buf_t *buf = msg_buf_new(msg, strlen(msg));
+    send_buf_to_client(client, buf, action);
+    msg_buf_unref(buf);
+}
+
+// 将广播缓冲区放入房间内每个客户端的出站队列（except 客户端除外），并唤醒发送
+static void fanout_room(rooms_t *room, msg_buf_t *buf, client_info_t *except, enum send_policy policy, int action)
+{
+    unsigned int recipients = 0;
+    pthread_mutex_lock(&room->lock);
+    for (client_info_t *cur = room->client_info->next; cur != NULL; cur = cur->next)
+    {
+        if (cur == except)
+            continue;
+        enqueue_to_client(cur, buf, policy, action);
+        recipients++;
+    }
+    pthread_mutex_unlock(&room->lock);
+    metrics_fanout(recipients);
+}
+
+// 对应房间广播播放进度（可合并，慢客户端只会收到最新进度）
+static void broadcast_progress_room(rooms_t *room, msg_buf_t *buf)
+{
+    if (!room || !buf)
+        return;
+    // 只发给订阅了周期性进度的客户端，其余客户端按播放锚点自行推算
+    unsigned int recipients = 0;
+    pthread_mutex_lock(&room->lock);
+    for (client_info_t *cur = room->client_info->next; cur != NULL; cur = cur->next)
+    {
+        if (cur->want_progress)
+        {
+            enqueue_to_client(cur, buf, SEND_CONFLATE, BROADCAST_SONG_INFO);
+            recipients++;
+        }
+    }
+    pthread_mutex_unlock(&room->lock);
+    metrics_fanout(recipients);
+}
+
+// 设置客户端是否订阅周期性进度广播
+static void set_progress_subscription(client_info_t *client, int enable)
+{
+    rooms_t *room = client->room;
+    enable = enable ? 1 : 0;
+    if (client->want_progress == enable)
+        return;
+    client->want_progress = enable;
+    enable ? room->progress_subscribers++ : room->progress_subscribers--;
+    update_progress_timer(room);
+}
+
+// 时钟同步（类 NTP）：回传客户端发送时间 t0、服务器接收时间 t1、服务器发送时间 t2，
+// 客户端据此估算往返时延与时钟偏差，再结合播放锚点在本地推算播放进度
+static void time_sync_response(client_info_t *client, double t0, lws_usec_t recv_us)
+{
+    lws_usec_t serialize_us = latency_serialize_begin();
+    cJSON *root = cJSON_CreateObject();
+    if (!root)
+        return;
+    cJSON *data = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "error_code", SUCCESS);
+    cJSON_AddStringToObject(root, "status", "success");
+    cJSON_AddNumberToObject(root, "action", TIME_SYNC);
+    cJSON_AddNumberToObject(data, "t0", t0);
+    cJSON_AddNumberToObject(data, "t1", recv_us / 1000.0);
+    cJSON_AddNumberToObject(data, "t2", lws_now_usecs() / 1000.0);
+    cJSON_AddItemToObject(root, "data", data);
+    char *json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    latency_serialize_end(serialize_us);
+    send_message_to_client(client, json_str, TIME_SYNC);
+    free(json_str);
 }
 
 // 对应房间客户端发送广播消息
@@ -86,61 +320,39 @@ void submit_broadcast_message(struct lws *wsi, const char *msg)
         lwsl_err("Client info is NULL\n");
         return;
     }
-    pthread_mutex_lock(&client->room->lock);
-    strncpy(client->room->latest_msg, msg, sizeof(client->room->latest_msg) - 1);
-    client->room->latest_msg[sizeof(client->room->latest_msg) - 1] = '\0';
-    pthread_mutex_unlock(&client->room->lock);
+    broadcast_response_room(client->room, msg, 0);
+}
 
-    // 遍历该房间客户端链表，唤醒对应客户端发送信息
-    for (client_info_t *cur = client->room->client_info->next; cur != NULL; cur = cur->next)
-    {
-        if (cur->wsi)
-        {
-            lws_callback_on_writable(cur->wsi);
-        }
-    }
-    lws_cancel_service(context);
+// 对应房间发送已生成的广播缓冲区
+void broadcast_buf_room(rooms_t *room, msg_buf_t *buf, int action)
+{
+    if (!room || !buf)
+        return;
+    // 遍历所有用户
+    fanout_room(room, buf, NULL, SEND_RELIABLE, action);
 }
 
 // 对应房间发送广播信息
-static void broadcast_response_room(rooms_t *room, const char *msg)
+void broadcast_response_room(rooms_t *room, const char *msg, int action)
 {
-    pthread_mutex_lock(&room->lock);
-    strncpy(room->latest_msg, msg, sizeof(room->latest_msg));
-    room->latest_msg[sizeof(room->latest_msg) - 1] = '\0';
-    pthread_mutex_unlock(&room->lock);
-
-    // 遍历所有用户
-    for (client_info_t *cur = room->client_info->next; cur; cur = cur->next)
-    {
-        if (cur->wsi)
-        {
-            lws_callback_on_writable(cur->wsi);
-        }
-    }
+    if (!room || !msg)
+        return;
+    msg_buf_t *buf = msg_buf_new(msg, strlen(msg));
+    broadcast_buf_room(room, buf, action);
+    msg_buf_unref(buf);
 }
 
 // 操作回复广播（操作者回复成功与否，其他客户端回复最新数据）
-static void operation_response(client_info_t *client, const char *msg)
+static void operation_response(client_info_t *client, msg_buf_t *buf, int action)
 {
-    if (!msg || !client)
+    if (!buf || !client)
         return;
 
     // 操作客户端回复
     success_response(client, "操作成功");
 
-    pthread_mutex_lock(&client->room->lock);
-    strncpy(client->room->latest_msg, msg, sizeof(client->room->latest_msg) - 1);
-    pthread_mutex_unlock(&client->room->lock);
-
-    // 遍历该房间客户端链表，唤醒对应客户端发送信息（除创建者）
-    for (client_info_t *cur = client->room->client_info->next; cur != NULL; cur = cur->next)
-    {
-        if (cur->wsi && client != cur)
-        {
-            lws_callback_on_writable(cur->wsi);
-        }
-    }
+    // 唤醒对应客户端发送信息（除操作者）
+    fanout_room(client->room, buf, client, SEND_RELIABLE, action);
 }
 
 // 信号处理函数，用于优雅退出
@@ -163,61 +375,124 @@ static void print_room_info(rooms_t *room)
     lwsl_notice("客户端列表:\n");
     for (client_info_t *client = room->client_info->next; client != NULL; client = client->next)
     {
-        lwsl_notice("  客户端IP: %s, 用户ID: %s\n", client->ip, client->userId);
+        lwsl_notice("  客户端IP: %s, 用户ID: %s, 队列深度: %u, 丢弃: %u\n", client->ip, client->userId, client->queue_len, client->queue_drops);
     }
 }
 
-// 定时更新进度
-void timer_callback(lws_sorted_usec_list_t *sul)
+// 打印所有房间信息（管理用）
+static void print_all_rooms(void)
 {
-    float duration = 0;
-    playing_info_t *playing_info = lws_container_of(sul, playing_info_t, timer);
-    int callback_time = playing_info->is_playing ? 5000 : 15000;
-    if (playing_info->is_playing)
+    rooms_t *room;
+    unsigned int room_count = 0;
+    send_queue_stats_t stats = send_queue_get_stats();
+    for (int tsi = 0; tsi < shard_count(); tsi++)
+        room_count += shard_rooms(tsi)->count;
+    lwsl_notice("当前房间数量: %u (服务线程 %d)\n", room_count, shard_count());
+    song_cache_stats_t cache_stats = song_cache_get_stats();
+    lwsl_notice("出站队列: 合并 %lu, 丢弃 %lu, 超预算断开 %lu\n", stats.conflated, stats.dropped, stats.disconnects);
+    lwsl_notice("歌曲缓存: 命中 %lu, 未命中 %lu, 合并请求 %lu, 过期 %lu, 淘汰 %lu, 条目 %lu, 内存 %zu\n",
+                cache_stats.hits, cache_stats.misses, cache_stats.coalesced, cache_stats.expired,
+                cache_stats.evictions, cache_stats.entries, cache_stats.bytes);
+    for (int tsi = 0; tsi < shard_count(); tsi++)
     {
-        pthread_mutex_lock(&playing_info->lock);
-        duration = atof(playing_info->duration);
-        time_t now = time(NULL);
-        // 更新进度偏移
-        double offset = (now - playing_info->last_update_time) / duration;
-        playing_info->played_percent += offset;
-        playing_info->last_update_time = now;
-        // 要是接近播放完成的话，加快广播频率
-        if (playing_info->played_percent >= 0.95)
+        unsigned int cursor = 0;
+        while ((room = next_room(shard_rooms(tsi), &cursor)))
         {
-            callback_time = 500;
+            print_room_info(room);
         }
-        pthread_mutex_unlock(&playing_info->lock);
-    }
-    if (playing_info->played_percent >= 1)
-    {
-        play_next_song_bysystem(playing_info->room);
     }
-    // 广播播放信息(有歌曲的时候)
-    if (playing_info->room->current_song)
+}
+
+// 定时广播播放进度（旧客户端兼容，只在播放中且有订阅者时运行，歌曲结束由播放定时器精确触发）
+void progress_timer_callback(lws_sorted_usec_list_t *sul)
+{
+    playing_info_t *playing_info = lws_container_of(sul, playing_info_t, progress_timer);
+    if (!playing_info->is_playing || !playing_info->room->current_song || !playing_info->room->progress_subscribers)
+        return;
+    msg_buf_t *buf = get_cur_played_percent(playing_info->room);
+    broadcast_progress_room(playing_info->room, buf);
+    msg_buf_unref(buf);
+    lws_sul_schedule(context, playing_info->room->tsi, sul, progress_timer_callback, g_config.progress_interval_ms * LWS_US_PER_MS);
+}
+
+// 延迟统计文件（多进程模式下每个工作进程各写一份）与周期性写出的定时器，在 0 号服务线程上运行
+static char latency_dump_file[512];
+static lws_sorted_usec_list_t latency_dump_timer;
+
+static void latency_dump_callback(lws_sorted_usec_list_t *sul)
+{
+    latency_dump(latency_dump_file);
+    lws_sul_schedule(context, 0, sul, latency_dump_callback, (lws_usec_t)g_config.latency_dump_interval_s * LWS_US_PER_SEC);
+}
+
+// 加入房间的任务，在房间所属的服务线程上执行
+typedef struct client_join
+{
+    client_info_t *client;
+    char roomid[64];
+    int want_progress;
+} client_join_t;
+
+static void client_join_task(void *arg)
+{
+    client_join_t *join = (client_join_t *)arg;
+    client_info_t *client = join->client;
+    room_registry_t *rooms = shard_rooms(shard_current());
+    rooms_t *room = find_room(rooms, join->roomid);
+    int new_room = room == NULL;
+    if (new_room)
     {
-        const char *cur_song_info_json = get_cur_played_percent(playing_info->room);
-        broadcast_response_room(playing_info->room, cur_song_info_json);
+        // 创建新房间
+        lwsl_notice("创建新房间: %s\n", join->roomid);
+        if (!(room = insert_room_info(join->roomid, client->userId, rooms)))
+        {
+            lwsl_err("Failed to create new room\n");
+            // 断开连接，加入任务持有的引用交给断开任务
+            shard_post(client->tsi, client_kill_task, client);
+            free(join);
+            return;
+        }
+        room->tsi = shard_current();
     }
+    // 成员列表接管加入任务持有的引用
+    pthread_mutex_lock(&room->lock);
+    insert_client_node(room->client_info, client);
+    client->room = room;
+    room->client_counter++;
+    pthread_mutex_unlock(&room->lock);
+    set_progress_subscription(client, join->want_progress);
+    lwsl_notice("客户端加入房间: %s\n", join->roomid);
+    // 打印房间信息以及客户端信息
+    print_room_info(room);
+    // 加入事件在合并窗口内累积，之后与其他成员变化一起广播
+    presence_join(room, client);
+    free(join);
+}
 
-    lws_sul_schedule(context, 0, sul, timer_callback, callback_time * LWS_US_PER_MS);
+// lws 在握手中实际接受了 permessage-deflate：之后出站消息由我们按每条消息独立压缩编码成完整帧，
+// 不经过 lws 的逐连接压缩；要求更小压缩窗口（server_max_window_bits）的客户端仍交给 lws 处理。
+// 只看请求头不够：lws 可能拒绝或改写请求（参数格式错误、只提供了其他压缩扩展等）
+static int client_negotiated_deflate(struct lws *wsi)
+{
+    char offer[256] = {0};
+    int negotiated = t_deflate_wsi == wsi;
+    t_deflate_wsi = NULL;
+    if (!negotiated || !g_config.deflate_level || lws_hdr_copy(wsi, offer, sizeof(offer), WSI_TOKEN_EXTENSIONS) <= 0)
+        return 0;
+    return !strstr(offer, "server_max_window_bits");
 }
 
 static int client_callback_established(struct lws *wsi)
 {
     lwsl_notice("新的客户端连接建立\n");
-    char roomid[64] = {0};
-    char userId[64] = {0};
+    // 先取协商结果（同时清掉线程上的记录），后面的检查失败提前返回时不会留下指向已关闭连接的记录
+    int deflate = client_negotiated_deflate(wsi);
     char client_ip[64] = {0};
-    rooms_t *new_room = NULL;
+    char progress[8] = {0};
+    char userId[64] = {0};
+    client_join_t *join = NULL;
     client_info_t *new_client = NULL;
 
-    if (g_rooms_list == NULL)
-    {
-        lwsl_err("房间链表未初始化\n");
-        return -1;
-    }
-
     lws_get_peer_simple(wsi, client_ip, sizeof(client_ip));
     if (!strlen(client_ip))
     {
@@ -225,74 +500,56 @@ static int client_callback_established(struct lws *wsi)
         return -1;
     }
 
-    lws_get_urlarg_by_name(wsi, "roomid", roomid, sizeof(roomid));
-    lws_get_urlarg_by_name(wsi, "userid", userId, sizeof(userId));
-
-    if (!strlen(roomid) || !strlen(userId))
+    if (!(join = (client_join_t *)malloc(sizeof(client_join_t))))
     {
-        lwsl_err("缺少必要的查询参数，断开连接\n");
+        lwsl_err("Failed to allocate memory for client_join_t\n");
         return -1;
     }
+    memset(join, 0, sizeof(client_join_t));
+    lws_get_urlarg_by_name(wsi, "roomid", join->roomid, sizeof(join->roomid));
+    lws_get_urlarg_by_name(wsi, "userid", userId, sizeof(userId));
+    lws_get_urlarg_by_name(wsi, "progress", progress, sizeof(progress));
+    join->want_progress = strlen(progress) ? atoi(progress) : g_config.progress_default;
 
-    for (rooms_t *room = g_rooms_list->next; room != NULL; room = room->next)
-    {
-        if (strcmp(room->room_id, roomid) == 0)
-        {
-            if (!(new_client = insert_client_info(wsi, client_ip, room, userId)))
-            {
-                lwsl_err("Failed to insert client info\n");
-                return -1;
-            }
-            lws_set_opaque_user_data(wsi, new_client);
-            lwsl_notice("客户端加入房间: %s\n", roomid);
-            // 打印房间信息以及客户端信息
-            for (rooms_t *room = g_rooms_list->next; room != NULL; room = room->next)
-            {
-                print_room_info(room);
-            }
-            // 广播新的客户端信息
-            broadcast_response_room(room, get_client_list_json(room, BROADCAST_CLIENT_LIST));
-            return 0;
-        }
-    }
-    // 创建新房间
-    lwsl_notice("创建新房间: %s\n", roomid);
-    if (!(new_room = insert_room_info(roomid, userId, g_rooms_list)))
+    if (!strlen(join->roomid) || !strlen(userId))
     {
-        lwsl_err("Failed to create new room\n");
+        lwsl_err("缺少必要的查询参数，断开连接\n");
+        free(join);
         return -1;
     }
-    lwsl_notice("创建房间成功，启动定时器\n");
-    lws_sul_schedule(context, 0, &new_room->playing_info.timer, timer_callback, LWS_US_PER_SEC * 5);
-    if (!(new_client = insert_client_info(wsi, client_ip, new_room, userId)))
+
+    if (!(new_client = new_client_info(wsi, client_ip, userId)))
     {
         lwsl_err("Failed to insert client info\n");
+        free(join);
         return -1;
     }
     lws_set_opaque_user_data(wsi, new_client);
-    lwsl_notice("客户端加入房间: %s\n", roomid);
-    // 打印房间信息以及客户端信息
-    for (rooms_t *room = g_rooms_list->next; room != NULL; room = room->next)
+    metrics_add(METRIC_CONNECTIONS_OPENED, 1);
+    new_client->deflate = deflate;
+    // vhost 可能持有协议表的副本，按名称区分子协议
+    new_client->binary = !strcmp(lws_get_protocol(wsi)->name, protocols[1].name);
+
+    // 连接由 lws 分配到任意服务线程，房间固定在 room_id 哈希对应的线程上，加入操作投递过去执行
+    new_client->room_tsi = shard_of_room(join->roomid);
+    join->client = client_ref(new_client);
+    if (shard_post(new_client->room_tsi, client_join_task, join) < 0)
     {
-        print_room_info(room);
+        client_unref(new_client);
+        free(join);
+        return -1;
     }
     return 0;
 }
 
-static int client_callback_closed(struct lws *wsi)
+// 离开房间的任务，在房间所属的服务线程上执行
+static void client_leave_task(void *arg)
 {
-    lwsl_notice("客户端连接关闭\n");
-    // 清理客户端节点
-    client_info_t *client = (client_info_t *)lws_get_opaque_user_data(wsi);
+    client_info_t *client = (client_info_t *)arg;
     rooms_t *room = client->room;
-    if (!client)
+    if (room)
     {
-        lwsl_err("Client info is NULL\n");
-        return -1;
-    }
-    if (client->room)
-    {
-        pthread_mutex_lock(&client->room->lock);
+        pthread_mutex_lock(&room->lock);
         client_info_t *prev = client->prev;
         client_info_t *next = client->next;
         if (prev)
@@ -303,95 +560,124 @@ static int client_callback_closed(struct lws *wsi)
         {
             next->prev = prev;
         }
-        if (client->room->client_info == client)
+        if (room->client_info == client)
         {
-            client->room->client_info = next; // 如果是头节点，更新头节点
+            room->client_info = next; // 如果是头节点，更新头节点
         }
-        client->room->client_counter--;
-        pthread_mutex_unlock(&client->room->lock);
-        free(client);
+        room->client_counter--;
+        if (client->want_progress)
+            room->progress_subscribers--;
+        pthread_mutex_unlock(&room->lock);
+        client->room = NULL;
+        client_unref(client); // 成员列表持有的引用
         lwsl_notice("客户端信息已清理\n");
-    }
-    lws_set_opaque_user_data(wsi, NULL);
 
-    // 如果房间已经没有客户端，则删除房间信息
-    if (room->client_counter == 0)
-    {
-        remove_room_node(g_rooms_list, room);
-        lwsl_notice("房间信息已清理\n");
+        // 如果房间已经没有客户端，则删除房间信息
+        if (room->client_counter == 0)
+        {
+            remove_room_node(shard_rooms(room->tsi), room);
+            lwsl_notice("房间信息已清理\n");
+        }
+        else
+        {
+            presence_leave(room, client);
+            // 打印房间信息以及客户端信息
+            print_room_info(room);
+        }
     }
+    client_unref(client); // 连接持有的引用
+}
 
-    // 打印房间信息以及客户端信息
-    for (rooms_t *room = g_rooms_list->next; room != NULL; room = room->next)
+static int client_callback_closed(struct lws *wsi)
+{
+    lwsl_notice("客户端连接关闭\n");
+    client_info_t *client = (client_info_t *)lws_get_opaque_user_data(wsi);
+    if (!client)
     {
-        print_room_info(room);
+        lwsl_err("Client info is NULL\n");
+        return -1;
     }
-    lws_cancel_service(context); // 触发服务循环处理
+    lws_set_opaque_user_data(wsi, NULL);
+    client->wsi = NULL;
+    metrics_add(METRIC_CONNECTIONS_CLOSED, 1);
+    // 连接持有的引用交给离开任务，队列中先于它投递的任务仍可安全访问该客户端
+    shard_post(client->room_tsi, client_leave_task, client);
     return 0;
 }
 
+// 失败回复，按预渲染模板生成
 static void error_response(client_info_t *client, const char *msg)
 {
-    // 1. 创建根对象 {}
-    cJSON *root = cJSON_CreateObject();
-    if (!root)
-        return;
-
-    // 2. 添加字段
-    cJSON_AddNumberToObject(root, "error_code", -FAIL);
-    cJSON_AddStringToObject(root, "status", "error");
-    cJSON_AddStringToObject(root, "message", msg);
-
-    // 3. 转为字符串（注意：返回的字符串需要 free()）
-    char *json_str = cJSON_PrintUnformatted(root);
-
-    // 4. 释放 cJSON 对象（但保留字符串）
-    cJSON_Delete(root);
-
-    pthread_mutex_lock(&client->lock);
-    strncpy(client->latest_msg, json_str, sizeof(client->latest_msg) - 1);
-    client->is_data_to_send = 1;
-    pthread_mutex_unlock(&client->lock);
-    lws_callback_on_writable(client->wsi);
-    lws_cancel_service(context);
+    msg_buf_t *buf = msg_error(msg);
+    send_buf_to_client(client, buf, 0);
+    msg_buf_unref(buf);
 }
 
+// 成功回复，按预渲染模板生成
 static void success_response(client_info_t *client, const char *msg)
 {
-    // 1. 创建根对象 {}
-    cJSON *root = cJSON_CreateObject();
-    if (!root)
-        return;
-
-    // 2. 添加字段
-    cJSON_AddNumberToObject(root, "error_code", SUCCESS);
-    cJSON_AddStringToObject(root, "status", "success");
-    cJSON_AddStringToObject(root, "message", msg);
+    msg_buf_t *buf = msg_success(msg);
+    send_buf_to_client(client, buf, 0);
+    msg_buf_unref(buf);
+}
 
-    // 3. 转为字符串（注意：返回的字符串需要 free()）
-    char *json_str = cJSON_PrintUnformatted(root);
+// 投递到房间所属线程的客户端操作
+typedef struct client_command
+{
+    client_info_t *client;
+    latency_trace_t *trace; // 从收到消息开始的计时
+    ctrl_msg_t msg; // 须为最后一个成员，只按实际使用的长度拷贝
+} client_command_t;
 
-    // 4. 释放 cJSON 对象（但保留字符串）
-    cJSON_Delete(root);
+static void client_command_task(void *arg);
+static int client_handle_message(client_info_t *client, void *in, size_t len, lws_usec_t recv_us);
 
-    pthread_mutex_lock(&client->lock);
-    strncpy(client->latest_msg, json_str, sizeof(client->latest_msg) - 1);
-    client->is_data_to_send = 1;
-    pthread_mutex_unlock(&client->lock);
-    lws_callback_on_writable(client->wsi);
-    lws_cancel_service(context);
-}
-// 某客户端单独发送信息
-static void send_message_to_client(client_info_t *client, const char *msg)
+// 拼接跨多次接收回调的消息：返回 1 表示消息完整（rx_buf 以 '\0' 结尾），0 表示还需等待后续分片
+static int client_reassemble(client_info_t *client, struct lws *wsi, const void *in, size_t len)
 {
-    if (!client)
-        return;
-    pthread_mutex_lock(&client->lock);
-    strncpy(client->latest_msg, msg, sizeof(client->latest_msg) - 1);
-    client->is_data_to_send = 1;
-    pthread_mutex_unlock(&client->lock);
-    lws_callback_on_writable(client->wsi);
-    lws_cancel_service(context);
+    int final = lws_is_final_fragment(wsi);
+    if (!client->rx_discard)
+    {
+        if (client->rx_len + len > g_config.max_message_bytes)
+        {
+            lwsl_err("%s 消息超过长度上限 %zu，丢弃\n", client->ip, g_config.max_message_bytes);
+            error_response(client, "消息过长！");
+            free(client->rx_buf);
+            client->rx_buf = NULL;
+            client->rx_len = 0;
+            client->rx_cap = 0;
+            client->rx_discard = 1;
+        }
+        else
+        {
+            if (client->rx_len + len + 1 > client->rx_cap)
+            {
+                // 按本帧剩余长度预留空间，减少扩容次数
+                size_t cap = client->rx_len + len + (final ? 0 : lws_remaining_packet_payload(wsi)) + 1;
+                if (cap > g_config.max_message_bytes + 1)
+                    cap = g_config.max_message_bytes + 1;
+                char *rx_buf = (char *)realloc(client->rx_buf, cap);
+                if (!rx_buf)
+                {
+                    lwsl_err("Failed to allocate memory for rx_buf\n");
+                    return -1;
+                }
+                client->rx_buf = rx_buf;
+                client->rx_cap = cap;
+            }
+            memcpy(client->rx_buf + client->rx_len, in, len);
+            client->rx_len += len;
+            client->rx_buf[client->rx_len] = '\0';
+        }
+    }
+    if (!final)
+        return 0;
+    if (client->rx_discard)
+    {
+        client->rx_discard = 0;
+        return 0;
+    }
+    return 1;
 }
 
 static int client_callback_receive(struct lws *wsi, void *in, size_t len)
@@ -402,55 +688,166 @@ static int client_callback_receive(struct lws *wsi, void *in, size_t len)
         lwsl_err("Client info is NULL\n");
         return -1;
     }
-    ((char *)in)[len] = '\0'; // 确保消息以null结尾
-    lwsl_notice("收到%s消息: %s (长度: %zu)\n", client->ip, (char *)in, len);
+    lws_usec_t recv_us = lws_now_usecs();
+    metrics_add(METRIC_BYTES_RECEIVED, len);
+    // 一条消息可能跨多个分片或超过接收缓冲区，分多次回调；完整的单次消息直接在接收缓冲区上解析
+    if (!lws_is_first_fragment(wsi) || !lws_is_final_fragment(wsi) || client->rx_len)
+    {
+        int complete = client_reassemble(client, wsi, in, len);
+        if (complete <= 0)
+            return complete;
+        in = client->rx_buf;
+        len = client->rx_len;
+    }
+    else
+    {
+        ((char *)in)[len] = '\0'; // 确保消息以null结尾
+    }
+    int ret = client_handle_message(client, in, len, recv_us);
+    if (in == client->rx_buf)
+    {
+        // 拼接缓冲区只在大消息期间存在，不为每个连接常驻最大长度的缓冲区
+        free(client->rx_buf);
+        client->rx_buf = NULL;
+        client->rx_len = 0;
+        client->rx_cap = 0;
+    }
+    return ret;
+}
+
+// 解析 JSON 消息（ctrl-protocol），失败时已回复错误并返回 -1
+static int client_parse_json(client_info_t *client, char *in, size_t len, ctrl_msg_t *msg)
+{
+    lwsl_notice("收到%s消息: %.*s (长度: %zu)\n", client->ip, (int)(len < 256 ? len : 256), in, len);
 
-    cJSON *root = cJSON_Parse((char *)in);
+    // 固定格式的命令直接扫描到栈上的 ctrl_msg_t，其余形状再交给 cJSON
+    if (ctrl_parse(in, len, msg) == 0)
+        return 0;
+    cJSON *root = cJSON_Parse(in);
     if (!root)
     {
         const char *error_ptr = cJSON_GetErrorPtr();
         if (error_ptr != NULL)
         {
-            char msg[128] = {0};
-            sprintf(msg, "JSON 解析错误:%s", error_ptr);
+            char err[128] = {0};
+            snprintf(err, sizeof(err), "JSON 解析错误:%s", error_ptr);
             lwsl_err("JSON 解析错误: %s\n", error_ptr);
-            error_response(client, msg);
+            error_response(client, err);
         }
+        return -1;
+    }
+    int ret = ctrl_msg_from_json(root, msg);
+    cJSON_Delete(root);
+    if (ret < 0)
+    {
+        error_response(client, "消息过长！");
+        return -1;
+    }
+    return 0;
+}
+
+// 解析 CBOR 消息（ctrl-protocol.bin），失败时已回复错误并返回 -1
+static int client_parse_cbor(client_info_t *client, const unsigned char *in, size_t len, ctrl_msg_t *msg)
+{
+    lwsl_notice("收到%s二进制消息 (长度: %zu)\n", client->ip, len);
+    if (wire_cbor_decode(in, len, msg) == 0)
+        return 0;
+    lwsl_err("%s CBOR 解析错误\n", client->ip);
+    error_response(client, "CBOR 解析错误");
+    return -1;
+}
+
+// 解析并处理一条完整的消息
+static int client_handle_message(client_info_t *client, void *in, size_t len, lws_usec_t recv_us)
+{
+    // 两种子协议解码到同一个 ctrl_msg_t，之后的处理完全相同
+    ctrl_msg_t msg;
+    int ret = client->binary ? client_parse_cbor(client, (const unsigned char *)in, len, &msg)
+                             : client_parse_json(client, (char *)in, len, &msg);
+    if (ret < 0)
+        return 0;
+    // 心跳和时钟同步不涉及房间状态，直接在连接所在线程回复
+    const char *type = ctrl_msg_str(&msg, CTRL_FIELD_TYPE);
+    if (type && !strncmp(type, "heartbeat", 9))
+    {
+        metrics_message_in(METRIC_ACTION_HEARTBEAT);
+        send_buf_to_client(client, msg_heartbeat_ack(), 0);
         return 0;
     }
-    cJSON *userid = cJSON_GetObjectItem(root, "userid");
-    cJSON *action = cJSON_GetObjectItem(root, "action");
-    cJSON *params = cJSON_GetObjectItem(root, "params");
-    cJSON *type = cJSON_GetObjectItem(root, "type");
-    if (cJSON_IsString(type) && !strncmp(type->valuestring, "heartbeat", 9))
+    if (type && !strcmp(type, "time_sync"))
     {
-        success_response(client, "heartbeat");
+        metrics_message_in(TIME_SYNC);
+        latency_trace_t *trace = latency_trace_new(TIME_SYNC, recv_us);
+        latency_trace_t *prev = latency_enter(trace);
+        time_sync_response(client, (msg.flags & CTRL_HAS_T0) ? msg.t0 : 0, recv_us);
+        latency_leave(prev);
+        latency_trace_unref(trace);
         return 0;
     }
 
-    if (!cJSON_IsNumber(action))
+    // 其余操作涉及房间状态，投递到房间所属的服务线程执行
+    metrics_message_in((msg.flags & CTRL_HAS_ACTION) ? msg.action : 0);
+    client_command_t *command = (client_command_t *)malloc(offsetof(client_command_t, msg) + CTRL_MSG_SIZE(&msg));
+    if (!command)
+    {
+        lwsl_err("Failed to allocate memory for client_command_t\n");
+        return 0;
+    }
+    command->client = client_ref(client);
+    command->trace = latency_trace_new((msg.flags & CTRL_HAS_ACTION) ? msg.action : 0, recv_us);
+    memcpy(&command->msg, &msg, CTRL_MSG_SIZE(&msg));
+    if (shard_post(client->room_tsi, client_command_task, command) < 0)
+    {
+        latency_trace_unref(command->trace);
+        client_unref(client);
+        free(command);
+    }
+    return 0;
+}
+
+// params 中的字符串字段，缺省为空串
+static const char *param_or_empty(const ctrl_msg_t *msg, enum ctrl_field field)
+{
+    const char *value = ctrl_msg_str(msg, field);
+    return value ? value : "";
+}
+
+// 执行客户端操作（在房间所属的服务线程上）
+static void client_handle_command(client_info_t *client, const ctrl_msg_t *msg)
+{
+    const char *userid = ctrl_msg_str(msg, CTRL_FIELD_USERID);
+    int has_params = msg->flags & CTRL_HAS_PARAMS;
+    if (!client->room)
+    {
+        // 加入房间失败，连接正在断开
+        return;
+    }
+
+    if (!(msg->flags & CTRL_HAS_ACTION))
     {
         lwsl_err("action类型错误！");
         error_response(client, "action类型错误！");
-        return 0;
+        return;
     }
-    if (!cJSON_IsString(userid) || strncmp(userid->valuestring, client->userId, strlen(userid->valuestring)))
+    if (!userid || strncmp(userid, client->userId, strlen(userid)))
     {
         lwsl_err("userid错误！");
         error_response(client, "userid错误！");
-        return 0;
+        return;
     }
-    switch (action->valueint)
+    switch (msg->action)
     {
     case GET_CUR_SONG_INFO:
-        const char *cur_song_info_json = get_cur_song_info(client->room, GET_CUR_SONG_INFO);
-        cur_song_info_json ? send_message_to_client(client, cur_song_info_json) : error_response(client, "fail!");
+        msg_buf_t *cur_song_info = get_cur_song_info(client->room, GET_CUR_SONG_INFO);
+        cur_song_info ? send_buf_to_client(client, cur_song_info, GET_CUR_SONG_INFO) : error_response(client, "fail!");
+        msg_buf_unref(cur_song_info);
         break;
     case PLAY_NEXT_SONG:
         if (play_next_song(client) >= 0)
         {
-            const char *cur_song_info_json = get_cur_song_info(client->room, BROADCAST_SONG_INFO);
-            operation_response(client, cur_song_info_json);
+            msg_buf_t *cur_song_info = get_cur_song_info(client->room, BROADCAST_SONG_INFO);
+            operation_response(client, cur_song_info, BROADCAST_SONG_INFO);
+            msg_buf_unref(cur_song_info);
         }
         else
         {
@@ -458,23 +855,24 @@ static int client_callback_receive(struct lws *wsi, void *in, size_t len)
         }
         break;
     case PLAY_BY_SONG_HASH:
-        if (cJSON_IsObject(params))
+        if (has_params)
         {
-            cJSON *songhash = cJSON_GetObjectItem(params, "songhash");
-            if (cJSON_IsString(songhash))
+            const char *songhash = ctrl_msg_str(msg, CTRL_FIELD_SONGHASH);
+            if (songhash)
             {
-                if (playbysonghash(client, songhash->valuestring) >= 0)
+                if (playbysonghash(client, songhash) >= 0)
                 {
-                    const char *cur_song_info_json = get_cur_song_info(client->room, BROADCAST_SONG_INFO);
-                    operation_response(client, cur_song_info_json);
-                    return 0;
+                    msg_buf_t *cur_song_info = get_cur_song_info(client->room, BROADCAST_SONG_INFO);
+                    operation_response(client, cur_song_info, BROADCAST_SONG_INFO);
+                    msg_buf_unref(cur_song_info);
+                    return;
                 }
             }
             else
             {
                 lwsl_err("参数错误！");
                 error_response(client, "参数错误！");
-                return 0;
+                return;
             }
         }
         error_response(client, "fail!");
@@ -482,8 +880,9 @@ static int client_callback_receive(struct lws *wsi, void *in, size_t len)
     case PAUSE_SONG:
         if (pause_song(client) >= 0)
         {
-            const char *cur_song_info_json = get_cur_song_info(client->room, BROADCAST_SONG_INFO);
-            operation_response(client, cur_song_info_json);
+            msg_buf_t *cur_song_info = get_cur_song_info(client->room, BROADCAST_SONG_INFO);
+            operation_response(client, cur_song_info, BROADCAST_SONG_INFO);
+            msg_buf_unref(cur_song_info);
         }
         else
         {
@@ -493,8 +892,9 @@ static int client_callback_receive(struct lws *wsi, void *in, size_t len)
     case RESUME_SONG:
         if (resume_song(client) >= 0)
         {
-            const char *cur_song_info_json = get_cur_song_info(client->room, BROADCAST_SONG_INFO);
-            operation_response(client, cur_song_info_json);
+            msg_buf_t *cur_song_info = get_cur_song_info(client->room, BROADCAST_SONG_INFO);
+            operation_response(client, cur_song_info, BROADCAST_SONG_INFO);
+            msg_buf_unref(cur_song_info);
         }
         else
         {
@@ -502,18 +902,18 @@ static int client_callback_receive(struct lws *wsi, void *in, size_t len)
         }
         break;
     case ADD_SONG_TO_PLAYLIST:
-        if (cJSON_IsObject(params))
-        {
-            char *songname = cJSON_GetObjectItem(params, "songname") ? cJSON_GetObjectItem(params, "songname")->valuestring : "";
-            char *songhash = cJSON_GetObjectItem(params, "songhash") ? cJSON_GetObjectItem(params, "songhash")->valuestring : "";
-            char *singername = cJSON_GetObjectItem(params, "singername") ? cJSON_GetObjectItem(params, "singername")->valuestring : "";
-            char *albumname = cJSON_GetObjectItem(params, "albumname") ? cJSON_GetObjectItem(params, "albumname")->valuestring : "";
-            char *duration = cJSON_GetObjectItem(params, "duration") ? cJSON_GetObjectItem(params, "duration")->valuestring : "";
-            char *coverurl = cJSON_GetObjectItem(params, "coverurl") ? cJSON_GetObjectItem(params, "coverurl")->valuestring : "";
+        if (has_params)
+        {
+            const char *songname = param_or_empty(msg, CTRL_FIELD_SONGNAME);
+            const char *songhash = param_or_empty(msg, CTRL_FIELD_SONGHASH);
+            const char *singername = param_or_empty(msg, CTRL_FIELD_SINGERNAME);
+            const char *albumname = param_or_empty(msg, CTRL_FIELD_ALBUMNAME);
+            const char *duration = param_or_empty(msg, CTRL_FIELD_DURATION);
+            const char *coverurl = param_or_empty(msg, CTRL_FIELD_COVERURL);
             if (insert_song_to_playlist(client, songname, songhash, singername, albumname, duration, coverurl) >= 0)
             {
-                const char *cur_playlist_json = get_playlist_json(client->room, BROADCAST_SONG_LIST);
-                operation_response(client, cur_playlist_json);
+                // 播放列表的变化已经以增量消息广播给房间内所有客户端
+                success_response(client, "操作成功");
             }
             else
             {
@@ -526,12 +926,12 @@ static int client_callback_receive(struct lws *wsi, void *in, size_t len)
         }
         break;
     case REMOVE_SONG_FROM_PLAYLIST:
-        if (cJSON_IsObject(params))
+        if (has_params)
         {
-            if (remove_song_from_playlist(client, cJSON_GetObjectItem(params, "songhash")->valuestring) >= 0)
+            if (remove_song_from_playlist(client, ctrl_msg_str(msg, CTRL_FIELD_SONGHASH)) >= 0)
             {
-                const char *cur_playlist_json = get_playlist_json(client->room, BROADCAST_SONG_LIST);
-                operation_response(client, cur_playlist_json);
+                // 播放列表的变化已经以增量消息广播给房间内所有客户端
+                success_response(client, "操作成功");
             }
             else
             {
@@ -544,12 +944,31 @@ static int client_callback_receive(struct lws *wsi, void *in, size_t len)
         }
         break;
     case UP_SONGBYHASH:
-        if (cJSON_IsObject(params))
+        if (has_params)
+        {
+            if (upsongbyhash(client, ctrl_msg_str(msg, CTRL_FIELD_SONGHASH)) >= 0)
+            {
+                // 播放列表的变化已经以增量消息广播给房间内所有客户端
+                success_response(client, "操作成功");
+            }
+            else
+            {
+                error_response(client, "fail!");
+            }
+        }
+        else
+        {
+            error_response(client, "参数错误！");
+        }
+        break;
+    case MOVE_SONG:
+        if (has_params && ctrl_msg_str(msg, CTRL_FIELD_SONGHASH))
         {
-            if (upsongbyhash(client, cJSON_GetObjectItem(params, "songhash")->valuestring) >= 0)
+            if (movesongbyhash(client, ctrl_msg_str(msg, CTRL_FIELD_SONGHASH),
+                               ctrl_msg_str(msg, CTRL_FIELD_BEFOREHASH)) >= 0)
             {
-                const char *cur_playlist_json = get_playlist_json(client->room, BROADCAST_SONG_LIST);
-                operation_response(client, cur_playlist_json);
+                // 播放列表的变化已经以增量消息广播给房间内所有客户端
+                success_response(client, "操作成功");
             }
             else
             {
@@ -563,58 +982,150 @@ static int client_callback_receive(struct lws *wsi, void *in, size_t len)
         break;
     case GET_PLAYLIST:
         const char *playlist_json = get_playlist_json(client->room, GET_PLAYLIST);
-        playlist_json ? send_message_to_client(client, playlist_json) : error_response(client, "fail!");
+        playlist_json ? send_message_to_client(client, playlist_json, GET_PLAYLIST) : error_response(client, "fail!");
+        free((char *)playlist_json);
+        break;
+    case SUBSCRIBE_PROGRESS:
+        if (has_params)
+        {
+            set_progress_subscription(client, (msg->flags & CTRL_HAS_ENABLE) && msg->enable);
+            success_response(client, "操作成功");
+        }
+        else
+        {
+            error_response(client, "参数错误！");
+        }
+        break;
+    case GET_ROOM_ACTIONS:
+    {
+        // 默认返回最近 20 条，params.offset 跳过更新的记录用于翻页
+        unsigned int offset = 0, limit = 20;
+        if ((msg->flags & CTRL_HAS_OFFSET) && msg->offset > 0)
+            offset = msg->offset;
+        if ((msg->flags & CTRL_HAS_LIMIT) && msg->limit > 0)
+            limit = msg->limit;
+        const char *actions_json = get_room_actions_json(client->room, offset, limit, GET_ROOM_ACTIONS);
+        actions_json ? send_message_to_client(client, actions_json, GET_ROOM_ACTIONS) : error_response(client, "fail!");
+        free((char *)actions_json);
         break;
+    }
     case GET_CLEIENT_LIST:
-        const char *client_list_json = get_client_list_json(client->room, GET_CLEIENT_LIST);
-        client_list_json ? send_message_to_client(client, client_list_json) : error_response(client, "fail!");
+    {
+        // 分页返回成员列表，默认前 100 个
+        unsigned int offset = 0, limit = 100;
+        if ((msg->flags & CTRL_HAS_OFFSET) && msg->offset > 0)
+            offset = msg->offset;
+        if ((msg->flags & CTRL_HAS_LIMIT) && msg->limit > 0)
+            limit = msg->limit;
+        const char *client_list_json = get_client_list_json(client->room, offset, limit, GET_CLEIENT_LIST);
+        client_list_json ? send_message_to_client(client, client_list_json, GET_CLEIENT_LIST) : error_response(client, "fail!");
+        free((char *)client_list_json);
+        break;
+    }
+    case GET_LATENCY_STATS:
+    {
+        // 本进程所有命令的分阶段延迟（微秒），与 --latency-dump 写出的内容相同
+        const char *stats_json = get_latency_stats_json(GET_LATENCY_STATS);
+        stats_json ? send_message_to_client(client, stats_json, GET_LATENCY_STATS) : error_response(client, "fail!");
+        free((char *)stats_json);
+        break;
+    }
     default:
         lwsl_err("未识别的操作！");
         error_response(client, "未识别的操作！");
         break;
     }
-    return 0;
+}
+
+static void client_command_task(void *arg)
+{
+    client_command_t *command = (client_command_t *)arg;
+    // 处理期间生成并入队的消息都归到这条命令的计时下
+    latency_trace_t *prev = latency_enter(command->trace);
+    client_handle_command(command->client, &command->msg);
+    latency_leave(prev);
+    latency_trace_unref(command->trace);
+    client_unref(command->client);
+    free(command);
 }
 
 static int client_callback_wirtable(struct lws *wsi)
 {
-    char local_msg[1024] = {0};
     client_info_t *client = (client_info_t *)lws_get_opaque_user_data(wsi);
     if (!client)
     {
         lwsl_err("Client info is NULL\n");
         return -1;
     }
-    pthread_mutex_lock(&client->lock);
-    if (client->is_data_to_send)
+    // 每次可写发送队首一条；超过一个分片的消息拆成多个 WebSocket 分片，管道阻塞时留到下次可写继续
+    if (!client->tx_buf)
     {
-        strcpy(local_msg, client->latest_msg);
-        client->is_data_to_send = 0;
+        client->tx_buf = send_queue_pop(client);
+        client->tx_offset = 0;
+        if (!client->tx_buf)
+            return 0;
+        lwsl_notice("向%s发送消息: %.*s\n", client->ip, (int)(client->tx_buf->len < 256 ? client->tx_buf->len : 256),
+                    (const char *)msg_buf_payload(client->tx_buf));
     }
-    pthread_mutex_unlock(&client->lock);
 
-    if (strlen(local_msg))
+    msg_buf_t *buf = client->tx_buf;
+    // 二进制连接发送消息的 CBOR 编码，同一条广播只转码一次，所有二进制连接共用
+    msg_buf_t *wire = client->binary ? msg_buf_cbor(buf) : buf;
+    size_t total = wire ? wire->len : 0; // 当前消息要写出的字节数，tx_offset 到达该值即发送完
+    if (!wire)
     {
-        unsigned char client_msg[LWS_PRE + sizeof(local_msg)];
-        unsigned char *clnent_p = &client_msg[LWS_PRE];
-        size_t client_n = strlen(local_msg);
-        memcpy(clnent_p, local_msg, client_n);
-        lws_write(wsi, clnent_p, client_n, LWS_WRITE_TEXT);
-        lwsl_notice("向%s发送消息: %s\n", client->ip, local_msg);
-        return 0;
+        lwsl_err("向%s发送的消息编码失败，丢弃\n", client->ip);
+    }
+    else if (client->deflate)
+    {
+        // 已编码好的完整帧（房间广播的压缩结果由所有成员共用）按分片原样写出，管道阻塞时停下，
+        // 下次可写从 tx_offset 续写；lws 最多缓存一个分片，不会把整帧剩余部分拷贝到连接自己的缓冲区。
+        // RAW 写不加帧头，直接写共享帧里的字节；帧没写完之前不会插入其他消息的帧
+        msg_buf_t *frame = msg_buf_ws_frame(wire, g_config.deflate_level, client->binary);
+        if (!frame || !frame->len)
+            return -1;
+        total = frame->len;
+        do
+        {
+            size_t chunk = total - client->tx_offset;
+            if (chunk > WS_TX_CHUNK)
+                chunk = WS_TX_CHUNK;
+            if (lws_write(wsi, msg_buf_payload(frame) + client->tx_offset, chunk, LWS_WRITE_RAW) < 0)
+                return -1;
+            metrics_add(METRIC_BYTES_SENT, chunk);
+            client->tx_offset += chunk;
+        } while (client->tx_offset < total && !lws_send_pipe_choked(wsi));
+    }
+    else
+    {
+        enum lws_write_protocol type = client->binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT;
+        do
+        {
+            size_t chunk = wire->len - client->tx_offset;
+            int is_start = client->tx_offset == 0;
+            if (chunk > WS_TX_CHUNK)
+                chunk = WS_TX_CHUNK;
+            int is_end = client->tx_offset + chunk == wire->len;
+            // lws_write 会把帧头写进分片前面的 LWS_PRE 空间，共享缓冲区可能同时被其他服务线程发送，
+            // 首个分片也不能原地写，一律拷贝到线程本地的分片缓冲区
+            memcpy(t_tx_chunk + LWS_PRE, msg_buf_payload(wire) + client->tx_offset, chunk);
+            if (lws_write(wsi, t_tx_chunk + LWS_PRE, chunk, lws_write_ws_flags(type, is_start, is_end)) < 0)
+                return -1;
+            metrics_add(METRIC_BYTES_SENT, chunk);
+            client->tx_offset += chunk;
+        } while (client->tx_offset < wire->len && !lws_send_pipe_choked(wsi));
     }
 
-    pthread_mutex_lock(&client->room->lock);
-    strcpy(local_msg, client->room->latest_msg);
-    pthread_mutex_unlock(&client->room->lock);
-
-    unsigned char buffer[LWS_PRE + sizeof(local_msg)];
-    unsigned char *p = &buffer[LWS_PRE];
-    size_t n = strlen(local_msg);
-
-    memcpy(p, local_msg, n);
-    lws_write(wsi, p, n, LWS_WRITE_TEXT);
-    lwsl_notice("向%s发送广播消息: %s\n", client->ip, local_msg);
+    if (!wire || client->tx_offset == total)
+    {
+        msg_buf_unref(buf);
+        client->tx_buf = NULL;
+    }
+    // 当前消息没发完或者队列里还有消息，等下一次可写再发
+    if (client->tx_buf || send_queue_depth(client))
+    {
+        lws_callback_on_writable(wsi);
+    }
     return 0;
 }
 
@@ -644,6 +1155,14 @@ int callback_echo(struct lws *wsi, enum lws_callback_reasons reason, void *user,
     case LWS_CALLBACK_CLOSED:
         ret = client_callback_closed(wsi);
         break;
+    // 其他服务线程投递了任务（目标线程没有唤醒 eventfd 时的退路）
+    case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+        shard_drain();
+        break;
+    // lws 据此判断是否从其他线程修改了连接的监听事件
+    case LWS_CALLBACK_GET_THREAD_ID:
+        ret = shard_current() + 1;
+        break;
 
     default:
         break;
@@ -652,25 +1171,49 @@ int callback_echo(struct lws *wsi, enum lws_callback_reasons reason, void *user,
     return ret;
 }
 
+// 额外的服务线程，0 号服务线程由主线程运行
+static void *service_thread(void *arg)
+{
+    int tsi = (int)(intptr_t)arg;
+    shard_set_current(tsi);
+    while (!interrupted)
+    {
+        lws_service_tsi(context, 10, tsi);
+    }
+    return NULL;
+}
+
 // 服务器主函数
 int main(int argc, const char **argv)
 {
     struct lws_context_creation_info info;
     const char *iface = NULL;
-    int port = 3375;
     int opts = 0;
 
+    // 解析命令行参数
+    if (parse_config(argc, (char **)argv) < 0)
+    {
+        return 1;
+    }
+    int port = g_config.port;
+
     // 初始化日志系统
     lws_set_log_level(LLL_NOTICE | LLL_ERR, NULL);
-    // 初始化 http—get
-    curl_global_init(CURL_GLOBAL_ALL);
 
-    g_rooms_list = init_rooms();
-    if (!g_rooms_list)
+    // 多进程模式：当前进程成为路由进程，只有工作进程会从这里继续往下执行
+    int ctrl_fd = -1;
+    if (g_config.workers > 1)
     {
-        lwsl_err("Failed to initialize rooms\n");
-        return -1;
+        int ret = workers_start(g_config.workers, port, &ctrl_fd);
+        if (ret != 0)
+        {
+            return ret < 0 ? 1 : 0;
+        }
+        // 工作进程不监听端口，连接由路由进程按房间转交
+        port = CONTEXT_PORT_NO_LISTEN;
     }
+    // 初始化 http—get
+    curl_global_init(CURL_GLOBAL_ALL);
 
     // 设置信号处理
     signal(SIGINT, sigint_handler);
@@ -681,6 +1224,10 @@ int main(int argc, const char **argv)
     info.iface = iface;
     info.protocols = protocols;
     info.options = opts;
+    info.count_threads = g_config.threads;
+    info.mounts = &metrics_mount;
+    if (g_config.deflate_level)
+        info.extensions = extensions;
 
     // 创建上下文
     context = lws_create_context(&info);
@@ -690,19 +1237,76 @@ int main(int argc, const char **argv)
         return 1;
     }
 
-    lwsl_notice("WebSocket 服务器已启动，监听端口 %d\n", port);
+    if (ctrl_fd >= 0 && worker_attach(lws_get_vhost_by_name(context, "default"), ctrl_fd) < 0)
+    {
+        lws_context_destroy(context);
+        return 1;
+    }
+
+    // lws 编译时的 LWS_MAX_SMP 可能限制线程数，以实际启动的为准
+    int threads = lws_get_count_threads(context);
+    if (shard_init(context, threads) < 0)
+    {
+        lwsl_err("初始化房间分片失败\n");
+        lws_context_destroy(context);
+        return 1;
+    }
+
+    // 初始化上游异步请求与缓存
+    if (upstream_init(context) < 0 || song_cache_init(g_config.song_cache_max_bytes, g_config.song_url_ttl_us, g_config.lyrics_url_ttl_us, g_config.stale_grace_us) < 0)
+    {
+        lwsl_err("初始化上游请求失败\n");
+        lws_context_destroy(context);
+        return 1;
+    }
+
+    pthread_t tids[threads];
+    int started = 1;
+    for (; started < threads; started++)
+    {
+        if (pthread_create(&tids[started], NULL, service_thread, (void *)(intptr_t)started))
+        {
+            lwsl_err("创建服务线程 %d 失败\n", started);
+            interrupted = 1;
+            break;
+        }
+    }
+
+    lwsl_notice("WebSocket 服务器已启动，端口 %d，服务线程 %d%s\n", g_config.port, threads, ctrl_fd >= 0 ? "（工作进程）" : "");
     lwsl_notice("按 Ctrl+C 退出...\n");
 
     // 事件循环
+    shard_set_current(0);
+    if (g_config.latency_dump_path)
+    {
+        snprintf(latency_dump_file, sizeof(latency_dump_file), ctrl_fd >= 0 ? "%s.%d" : "%s", g_config.latency_dump_path, (int)getpid());
+        if (g_config.latency_dump_interval_s)
+            lws_sul_schedule(context, 0, &latency_dump_timer, latency_dump_callback, (lws_usec_t)g_config.latency_dump_interval_s * LWS_US_PER_SEC);
+    }
     while (!interrupted)
     {
         // 处理网络事件，超时设置为 10 毫秒
-        lws_service(context, 10);
+        lws_service_tsi(context, 10, 0);
+    }
+    for (int i = 1; i < started; i++)
+    {
+        pthread_join(tids[i], NULL);
     }
 
     // 清理资源
     lwsl_notice("服务器正在关闭...\n");
+    shard_stop();
+    print_all_rooms();
+    if (g_config.latency_dump_path)
+    {
+        lws_sul_cancel(&latency_dump_timer);
+        latency_dump(latency_dump_file);
+    }
+    upstream_destroy();
+    song_cache_destroy();
     lws_context_destroy(context);
+    shard_destroy();
+    curl_global_cleanup();
 
     return 0;
 }
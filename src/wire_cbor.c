@@ -0,0 +1,467 @@
+#include "wire_cbor.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+// ctrl-protocol.bin 的编解码：出站消息从 JSON 消息转码（同一条广播只转码一次，见 msg_buf_cbor），
+// 入站命令直接解码到与 JSON 路径相同的 ctrl_msg_t，之后的处理两种编码完全一致。
+
+#define WIRE_MAX_DEPTH 32  // 跳过未知值时允许的最大嵌套深度
+#define WIRE_KEY_SLOTS 128 // 字段名查找表的槽数（须为 2 的幂且大于 WIRE_KEY_MAX）
+
+static const char *g_key_names[WIRE_KEY_MAX] = {
+    "error_code", "status", "message", "action", "data", "type", "userid", "params", "t0", "t1", "t2",
+    "enable", "offset", "limit", "songname", "songhash", "singername", "albumname", "duration", "coverurl",
+    "beforehash", "album_name", "cover_url", "song_url", "lyrics_url", "played_percent", "position_ms",
+    "server_time_ms", "is_playing", "duration_ms", "rate", "version", "current", "playlist", "op", "index",
+    "song", "client_list", "client_counter", "total", "userId", "ip", "joined", "left", "actions",
+    "available", "time", "queue_depth", "queue_drops", "after",
+};
+
+// 字段名 -> 编号的开放寻址表，首次使用时构建
+static signed char g_key_slots[WIRE_KEY_SLOTS];
+static pthread_once_t g_key_once = PTHREAD_ONCE_INIT;
+
+static unsigned int key_hash(const char *name, size_t len)
+{
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void key_table_init(void)
+{
+    memset(g_key_slots, -1, sizeof(g_key_slots));
+    for (int key = 0; key < WIRE_KEY_MAX; key++)
+    {
+        unsigned int slot = key_hash(g_key_names[key], strlen(g_key_names[key])) & (WIRE_KEY_SLOTS - 1);
+        while (g_key_slots[slot] >= 0)
+            slot = (slot + 1) & (WIRE_KEY_SLOTS - 1);
+        g_key_slots[slot] = (signed char)key;
+    }
+}
+
+// 按字段名查编号，表外的字段返回 -1
+static int key_lookup(const char *name, size_t len)
+{
+    pthread_once(&g_key_once, key_table_init);
+    unsigned int slot = key_hash(name, len) & (WIRE_KEY_SLOTS - 1);
+    while (g_key_slots[slot] >= 0)
+    {
+        const char *candidate = g_key_names[(int)g_key_slots[slot]];
+        if (strlen(candidate) == len && memcmp(candidate, name, len) == 0)
+            return g_key_slots[slot];
+        slot = (slot + 1) & (WIRE_KEY_SLOTS - 1);
+    }
+    return -1;
+}
+
+// ---------------------------------------------------------------- 编码
+
+// 输出缓冲区为 NULL 或容量不足时只统计长度
+typedef struct cbor_writer
+{
+    unsigned char *out;
+    size_t cap;
+    size_t len;
+} cbor_writer_t;
+
+static void put_bytes(cbor_writer_t *w, const void *data, size_t n)
+{
+    if (w->out && w->len + n <= w->cap)
+        memcpy(w->out + w->len, data, n);
+    w->len += n;
+}
+
+static void put_byte(cbor_writer_t *w, unsigned char byte)
+{
+    put_bytes(w, &byte, 1);
+}
+
+// 大端写入 n 字节
+static void put_be(cbor_writer_t *w, uint64_t value, int n)
+{
+    unsigned char buf[8];
+    for (int i = 0; i < n; i++)
+        buf[i] = (unsigned char)(value >> (8 * (n - 1 - i)));
+    put_bytes(w, buf, n);
+}
+
+// 数据项头部：主类型 + 参数，参数按最短形式编码
+static void put_head(cbor_writer_t *w, int major, uint64_t arg)
+{
+    if (arg < 24)
+        put_byte(w, (unsigned char)(major << 5 | arg));
+    else if (arg <= 0xFF)
+    {
+        put_byte(w, (unsigned char)(major << 5 | 24));
+        put_be(w, arg, 1);
+    }
+    else if (arg <= 0xFFFF)
+    {
+        put_byte(w, (unsigned char)(major << 5 | 25));
+        put_be(w, arg, 2);
+    }
+    else if (arg <= 0xFFFFFFFFu)
+    {
+        put_byte(w, (unsigned char)(major << 5 | 26));
+        put_be(w, arg, 4);
+    }
+    else
+    {
+        put_byte(w, (unsigned char)(major << 5 | 27));
+        put_be(w, arg, 8);
+    }
+}
+
+// 整数值编码为 CBOR 整数，其余按不损失精度的最短浮点数编码；与 cJSON 输出一致，NaN/Inf 编码为 null
+static void put_number(cbor_writer_t *w, double value)
+{
+    if (isnan(value) || isinf(value))
+    {
+        put_byte(w, 0xf6);
+        return;
+    }
+    if (value == floor(value) && fabs(value) < 9.2e18)
+    {
+        long long integer = (long long)value;
+        if (integer >= 0)
+            put_head(w, 0, (uint64_t)integer);
+        else
+            put_head(w, 1, (uint64_t)(-1 - integer));
+        return;
+    }
+    float single = (float)value;
+    if ((double)single == value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        put_byte(w, 0xfa);
+        put_be(w, bits, 4);
+        return;
+    }
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_byte(w, 0xfb);
+    put_be(w, bits, 8);
+}
+
+static void put_item(cbor_writer_t *w, const cJSON *item)
+{
+    switch (item->type & 0xFF)
+    {
+    case cJSON_False:
+        put_byte(w, 0xf4);
+        break;
+    case cJSON_True:
+        put_byte(w, 0xf5);
+        break;
+    case cJSON_Number:
+        put_number(w, item->valuedouble);
+        break;
+    case cJSON_String:
+    {
+        size_t len = strlen(item->valuestring);
+        put_head(w, 3, len);
+        put_bytes(w, item->valuestring, len);
+        break;
+    }
+    case cJSON_Array:
+    case cJSON_Object:
+    {
+        int is_object = cJSON_IsObject(item);
+        put_head(w, is_object ? 5 : 4, (uint64_t)cJSON_GetArraySize(item));
+        for (const cJSON *child = item->child; child; child = child->next)
+        {
+            if (is_object)
+            {
+                size_t len = strlen(child->string);
+                int key = key_lookup(child->string, len);
+                if (key >= 0)
+                    put_head(w, 0, (uint64_t)key);
+                else
+                {
+                    put_head(w, 3, len);
+                    put_bytes(w, child->string, len);
+                }
+            }
+            put_item(w, child);
+        }
+        break;
+    }
+    default: // cJSON_NULL，解析得到的树中不会出现 cJSON_Raw
+        put_byte(w, 0xf6);
+        break;
+    }
+}
+
+// 把 JSON 消息编码为 CBOR，返回编码长度；out 为 NULL 或长度超过 cap 时只计算长度
+size_t wire_cbor_encode(const cJSON *item, unsigned char *out, size_t cap)
+{
+    cbor_writer_t w = {out, cap, 0};
+    put_item(&w, item);
+    return w.len;
+}
+
+// ---------------------------------------------------------------- 解码
+
+typedef struct cbor_reader
+{
+    const unsigned char *p;
+    const unsigned char *end;
+} cbor_reader_t;
+
+// 读取数据项头部：major 为主类型，info 为附加信息，arg 为参数（整数值、长度、元素个数或浮点数的位）
+// 不支持不定长编码
+static int read_head(cbor_reader_t *r, int *major, int *info, uint64_t *arg)
+{
+    if (r->p >= r->end)
+        return -1;
+    unsigned char byte = *r->p++;
+    *major = byte >> 5;
+    *info = byte & 0x1F;
+    if (*info < 24)
+    {
+        *arg = (uint64_t)*info;
+        return 0;
+    }
+    if (*info > 27)
+        return -1;
+    int n = 1 << (*info - 24);
+    if (r->end - r->p < n)
+        return -1;
+    uint64_t value = 0;
+    for (int i = 0; i < n; i++)
+        value = (value << 8) | r->p[i];
+    r->p += n;
+    *arg = value;
+    return 0;
+}
+
+static size_t remaining(const cbor_reader_t *r)
+{
+    return (size_t)(r->end - r->p);
+}
+
+static double half_to_double(unsigned int half)
+{
+    int exp = (half >> 10) & 0x1F;
+    int mant = half & 0x3FF;
+    double value;
+    if (exp == 0)
+        value = ldexp(mant, -24);
+    else if (exp != 31)
+        value = ldexp(mant + 1024, exp - 25);
+    else
+        value = mant == 0 ? INFINITY : NAN;
+    return (half & 0x8000) ? -value : value;
+}
+
+// 数据项是数字时取其值，否则返回 -1；NaN 和无穷大（JSON 里表示不了）也按类型不符处理
+static int as_number(int major, int info, uint64_t arg, double *out)
+{
+    double value;
+    if (major == 0)
+        value = (double)arg;
+    else if (major == 1)
+        value = -1.0 - (double)arg;
+    else if (major == 7 && info == 25)
+        value = half_to_double((unsigned int)arg);
+    else if (major == 7 && info == 26)
+    {
+        uint32_t bits = (uint32_t)arg;
+        float single;
+        memcpy(&single, &bits, sizeof(single));
+        value = single;
+    }
+    else if (major == 7 && info == 27)
+        memcpy(&value, &arg, sizeof(value));
+    else
+        return -1;
+    if (!isfinite(value))
+        return -1;
+    *out = value;
+    return 0;
+}
+
+static int skip_item(cbor_reader_t *r, int depth)
+{
+    int major, info;
+    uint64_t arg;
+    if (depth > WIRE_MAX_DEPTH || read_head(r, &major, &info, &arg) < 0)
+        return -1;
+    switch (major)
+    {
+    case 2:
+    case 3:
+        if (arg > remaining(r))
+            return -1;
+        r->p += arg;
+        return 0;
+    case 4:
+    case 5:
+        // 每个元素至少 1 字节，先排除声明的个数超过剩余长度的输入
+        if (arg > remaining(r))
+            return -1;
+        for (uint64_t i = 0; i < (major == 5 ? arg * 2 : arg); i++)
+        {
+            if (skip_item(r, depth + 1) < 0)
+                return -1;
+        }
+        return 0;
+    case 6:
+        return skip_item(r, depth + 1);
+    default:
+        return 0;
+    }
+}
+
+// 读取对象的键：返回编号，表外的键返回 -1，格式错误返回 -2。
+// 文本键按字段名查表（与 cJSON_GetObjectItem 一样不区分大小写）
+static int read_key(cbor_reader_t *r)
+{
+    const unsigned char *start = r->p;
+    int major, info;
+    uint64_t arg;
+    if (read_head(r, &major, &info, &arg) < 0)
+        return -2;
+    if (major == 0)
+        return arg < WIRE_KEY_MAX ? (int)arg : -1;
+    if (major != 3)
+    {
+        r->p = start;
+        return skip_item(r, 1) < 0 ? -2 : -1;
+    }
+    if (arg > remaining(r))
+        return -2;
+    char name[32];
+    size_t len = (size_t)arg;
+    const char *text = (const char *)r->p;
+    r->p += len;
+    if (len >= sizeof(name))
+        return -1;
+    for (size_t i = 0; i < len; i++)
+        name[i] = (text[i] >= 'A' && text[i] <= 'Z') ? (char)(text[i] + 'a' - 'A') : text[i];
+    return key_lookup(name, len);
+}
+
+// 与 cJSON 相同：超出 int 范围时取边界值
+static int number_to_int(double value)
+{
+    if (value >= INT32_MAX)
+        return INT32_MAX;
+    if (value <= (double)INT32_MIN)
+        return INT32_MIN;
+    return (int)value;
+}
+
+// 键对应的字符串字段，不是字符串字段时返回 -1
+static int key_to_field(int key, int is_params)
+{
+    if (!is_params && key == WIRE_KEY_USERID)
+        return CTRL_FIELD_USERID;
+    if (!is_params && key == WIRE_KEY_TYPE)
+        return CTRL_FIELD_TYPE;
+    if (is_params && key >= WIRE_KEY_SONGNAME && key <= WIRE_KEY_BEFOREHASH)
+        return CTRL_FIELD_SONGNAME + (key - WIRE_KEY_SONGNAME);
+    return -1;
+}
+
+// 解码命令对象，is_params 区分顶层和 params；重复的键与 cJSON 一样以第一个为准
+static int decode_map(cbor_reader_t *r, ctrl_msg_t *msg, int is_params)
+{
+    int major, info;
+    uint64_t count;
+    if (read_head(r, &major, &info, &count) < 0 || major != 5 || count > remaining(r))
+        return -1;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        int key = read_key(r);
+        if (key == -2)
+            return -1;
+
+        const unsigned char *value = r->p;
+        uint64_t arg;
+        double number;
+        if (read_head(r, &major, &info, &arg) < 0)
+            return -1;
+        int field = key_to_field(key, is_params);
+        if (field >= 0 && major == 3 && msg->str_off[field] < 0)
+        {
+            if (arg > remaining(r) || ctrl_msg_put_string(msg, field, (const char *)r->p, (size_t)arg) < 0)
+                return -1;
+            r->p += arg;
+            continue;
+        }
+        if (!is_params && key == WIRE_KEY_PARAMS && major == 5 && !(msg->flags & CTRL_HAS_PARAMS))
+        {
+            r->p = value;
+            msg->flags |= CTRL_HAS_PARAMS;
+            if (decode_map(r, msg, 1) < 0)
+                return -1;
+            continue;
+        }
+        if (!is_params && key == WIRE_KEY_ACTION && !(msg->flags & CTRL_HAS_ACTION) &&
+            as_number(major, info, arg, &number) == 0)
+        {
+            msg->flags |= CTRL_HAS_ACTION;
+            msg->action = number_to_int(number);
+            continue;
+        }
+        if (!is_params && key == WIRE_KEY_T0 && !(msg->flags & CTRL_HAS_T0) &&
+            as_number(major, info, arg, &msg->t0) == 0)
+        {
+            msg->flags |= CTRL_HAS_T0;
+            continue;
+        }
+        if (is_params && key == WIRE_KEY_ENABLE && !(msg->flags & CTRL_HAS_ENABLE))
+        {
+            if (major == 7 && (info == 20 || info == 21))
+            {
+                msg->flags |= CTRL_HAS_ENABLE;
+                msg->enable = info == 21;
+                continue;
+            }
+            if (as_number(major, info, arg, &number) == 0)
+            {
+                msg->flags |= CTRL_HAS_ENABLE;
+                msg->enable = number_to_int(number);
+                continue;
+            }
+        }
+        if (is_params && key == WIRE_KEY_OFFSET && !(msg->flags & CTRL_HAS_OFFSET) &&
+            as_number(major, info, arg, &number) == 0)
+        {
+            msg->flags |= CTRL_HAS_OFFSET;
+            msg->offset = number_to_int(number);
+            continue;
+        }
+        if (is_params && key == WIRE_KEY_LIMIT && !(msg->flags & CTRL_HAS_LIMIT) &&
+            as_number(major, info, arg, &number) == 0)
+        {
+            msg->flags |= CTRL_HAS_LIMIT;
+            msg->limit = number_to_int(number);
+            continue;
+        }
+        // 不关心的字段或类型不符的值
+        r->p = value;
+        if (skip_item(r, 1) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+// 把 CBOR 编码的命令解码到 ctrl_msg_t，格式错误或字符串超出容量返回 -1
+int wire_cbor_decode(const unsigned char *in, size_t len, ctrl_msg_t *msg)
+{
+    cbor_reader_t r = {in, in + len};
+    ctrl_msg_reset(msg);
+    if (decode_map(&r, msg, 0) < 0)
+        return -1;
+    return r.p == r.end ? 0 : -1;
+}
@@ -0,0 +1,619 @@
+#define _GNU_SOURCE
+#include "worker.h"
+#include "rooms.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ROUTER_PEEK_SIZE 2048        // 握手请求行最多窥探的字节数
+#define ROUTER_HANDSHAKE_TIMEOUT_MS 10000
+#define ROUTER_RESPAWN_DELAY_MS 1000 // 工作进程启动后很快退出时，延迟重启避免空转
+
+// 已接受、等待读出请求行的连接
+typedef struct pending_conn
+{
+    int fd;
+    long accepted_ms;
+    char partial; // 请求行还没收全，改为定时重试，避免水平触发空转
+} pending_conn_t;
+
+// 工作进程
+typedef struct worker_proc
+{
+    pid_t pid;              // 0 表示等待重启
+    int ctrl_fd;            // 与工作进程之间传递 fd 的 unix socket
+    long spawned_ms;        // 启动时间
+    pending_conn_t *outbox; // ctrl_fd 暂时写不进去、等待转交的连接，按到达顺序发送
+    int outbox_len;
+    int outbox_cap;
+} worker_proc_t;
+
+static worker_proc_t *g_workers = NULL;
+static int g_count = 0;
+static int g_listen_fd = -1;
+static pending_conn_t *g_pending = NULL;
+static int g_pending_len = 0;
+static int g_pending_cap = 0;
+static volatile sig_atomic_t g_stop = 0;
+static int g_self_index = -1; // 工作进程里自己的编号，路由进程/单进程模式为 -1
+static int g_self_count = 0;  // 工作进程总数
+
+static long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void router_signal_handler(int sig)
+{
+    g_stop = 1;
+}
+
+static int set_nonblock(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// 创建路由进程唯一的监听 socket，优先 IPv6 双栈。工作进程不监听端口，连接全部由这里按房间转交，
+// 所以不需要 SO_REUSEPORT（各工作进程抢同一个端口只会按四元组分配，做不到同房间同进程）
+static int router_listen(int port)
+{
+    int one = 1, zero = 0;
+    int fd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0)
+    {
+        struct sockaddr_in6 addr6;
+        memset(&addr6, 0, sizeof(addr6));
+        addr6.sin6_family = AF_INET6;
+        addr6.sin6_addr = in6addr_any;
+        addr6.sin6_port = htons(port);
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+        if (bind(fd, (struct sockaddr *)&addr6, sizeof(addr6)) == 0)
+            goto bound;
+        close(fd);
+    }
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        lwsl_err("创建监听 socket 失败: %s\n", strerror(errno));
+        return -1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        lwsl_err("绑定端口 %d 失败: %s\n", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+bound:
+    if (listen(fd, SOMAXCONN) < 0 || set_nonblock(fd) < 0)
+    {
+        lwsl_err("监听端口 %d 失败: %s\n", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 子进程里关闭路由进程持有的 fd
+static void router_close_inherited(void)
+{
+    close(g_listen_fd);
+    for (int i = 0; i < g_count; i++)
+    {
+        if (g_workers[i].ctrl_fd >= 0)
+            close(g_workers[i].ctrl_fd);
+        for (int j = 0; j < g_workers[i].outbox_len; j++)
+            close(g_workers[i].outbox[j].fd);
+        free(g_workers[i].outbox);
+    }
+    for (int i = 0; i < g_pending_len; i++)
+    {
+        close(g_pending[i].fd);
+    }
+    free(g_workers);
+    free(g_pending);
+    g_workers = NULL;
+    g_pending = NULL;
+    g_count = g_pending_len = g_pending_cap = 0;
+}
+
+// 启动第 index 个工作进程：父进程返回 1，子进程返回 0 并通过 ctrl_fd 带回 unix socket
+static int spawn_worker(int index, int *ctrl_fd)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0)
+    {
+        lwsl_err("创建工作进程 socket 失败: %s\n", strerror(errno));
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        lwsl_err("创建工作进程失败: %s\n", strerror(errno));
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        close(sv[0]);
+        g_self_index = index;
+        g_self_count = g_count;
+        router_close_inherited();
+        // 路由进程退出时工作进程随之退出
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        *ctrl_fd = sv[1];
+        return 0;
+    }
+    close(sv[1]);
+    set_nonblock(sv[0]);
+    g_workers[index].pid = pid;
+    g_workers[index].ctrl_fd = sv[0];
+    g_workers[index].spawned_ms = now_ms();
+    lwsl_notice("工作进程 %d 已启动 (pid %d)\n", index, (int)pid);
+    return 1;
+}
+
+// 通过 unix socket 把 fd 发给工作进程，返回 sendmsg 的结果
+static ssize_t send_fd(int ctrl_fd, int fd)
+{
+    char byte = 0;
+    struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+    union
+    {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    return sendmsg(ctrl_fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+// 发送缓冲区满等暂时性错误，等 ctrl_fd 可写后重试
+static int send_fd_retryable(int err)
+{
+    return err == EAGAIN || err == EWOULDBLOCK || err == ENOBUFS || err == EINTR;
+}
+
+// 关闭工作进程待转交的全部连接（工作进程已退出或 ctrl_fd 出错）
+static void worker_drop_outbox(worker_proc_t *worker)
+{
+    for (int i = 0; i < worker->outbox_len; i++)
+    {
+        close(worker->outbox[i].fd);
+    }
+    worker->outbox_len = 0;
+}
+
+// 按顺序发送待转交的连接，直到写不进去为止；发送成功后路由进程这边关闭自己的副本
+static void worker_flush_outbox(worker_proc_t *worker, int index)
+{
+    int sent = 0;
+    for (; sent < worker->outbox_len; sent++)
+    {
+        if (send_fd(worker->ctrl_fd, worker->outbox[sent].fd) < 0)
+        {
+            if (send_fd_retryable(errno))
+                break;
+            lwsl_err("向工作进程 %d 传递连接失败: %s\n", index, strerror(errno));
+            worker_drop_outbox(worker);
+            return;
+        }
+        close(worker->outbox[sent].fd);
+    }
+    worker->outbox_len -= sent;
+    memmove(worker->outbox, worker->outbox + sent, worker->outbox_len * sizeof(pending_conn_t));
+}
+
+// 把连接交给工作进程：ctrl_fd 暂时写不进去时放进该进程的待转交队列，只在出错或进程不可用时关闭
+static void route_to_worker(pending_conn_t *conn, int index)
+{
+    worker_proc_t *worker = &g_workers[index];
+    if (!worker->pid || worker->ctrl_fd < 0)
+    {
+        lwsl_err("工作进程 %d 不可用，丢弃连接\n", index);
+        close(conn->fd);
+        return;
+    }
+    if (worker->outbox_len == worker->outbox_cap)
+    {
+        int cap = worker->outbox_cap ? worker->outbox_cap * 2 : 16;
+        pending_conn_t *outbox = realloc(worker->outbox, cap * sizeof(pending_conn_t));
+        if (!outbox)
+        {
+            lwsl_err("Failed to allocate memory for worker outbox\n");
+            close(conn->fd);
+            return;
+        }
+        worker->outbox = outbox;
+        worker->outbox_cap = cap;
+    }
+    // 排在已有的待转交连接后面，保持转交顺序
+    worker->outbox[worker->outbox_len++] = *conn;
+    worker_flush_outbox(worker, index);
+}
+
+// 解码 url 参数值（%XX 与 +），和 lws 取到的 roomid 保持一致
+static void url_decode(const char *src, size_t len, char *out, size_t size)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < len && n + 1 < size; i++)
+    {
+        if (src[i] == '%' && i + 2 < len)
+        {
+            char hex[3] = {src[i + 1], src[i + 2], 0};
+            out[n++] = (char)strtol(hex, NULL, 16);
+            i += 2;
+        }
+        else
+        {
+            out[n++] = src[i] == '+' ? ' ' : src[i];
+        }
+    }
+    out[n] = '\0';
+}
+
+// 从请求行 "GET /path?roomid=xxx&userid=yyy HTTP/1.1" 中取出参数 name 的值
+static int parse_query_arg(const char *line, size_t len, const char *name, char *value, size_t size)
+{
+    size_t name_len = strlen(name);
+    const char *end = line + len;
+    const char *query = memchr(line, '?', len);
+    if (!query)
+        return -1;
+    const char *space = memchr(query, ' ', end - query);
+    if (space)
+        end = space;
+    for (const char *arg = query + 1; arg < end;)
+    {
+        const char *amp = memchr(arg, '&', end - arg);
+        const char *arg_end = amp ? amp : end;
+        if ((size_t)(arg_end - arg) > name_len + 1 && !strncmp(arg, name, name_len) && arg[name_len] == '=')
+        {
+            url_decode(arg + name_len + 1, arg_end - arg - name_len - 1, value, size);
+            return value[0] ? 0 : -1;
+        }
+        arg = arg_end + 1;
+    }
+    return -1;
+}
+
+// 窥探请求行决定去向：返回 1 已处理（转交或关闭），0 需要继续等待
+static int route_pending(pending_conn_t *conn)
+{
+    char buf[ROUTER_PEEK_SIZE];
+    ssize_t n = recv(conn->fd, buf, sizeof(buf), MSG_PEEK);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return 0;
+    if (n <= 0)
+    {
+        close(conn->fd);
+        return 1;
+    }
+    const char *eol = memchr(buf, '\n', n);
+    if (!eol && n < (ssize_t)sizeof(buf))
+    {
+        conn->partial = 1;
+        return 0;
+    }
+    // 数据仍留在 socket 里，工作进程的 lws 会完整读取握手
+    char roomid[64] = {0};
+    char worker[16] = {0};
+    int index = 0;
+    size_t line_len = eol ? (size_t)(eol - buf) : (size_t)n;
+    if (parse_query_arg(buf, line_len, "roomid", roomid, sizeof(roomid)) == 0)
+    {
+        index = (int)room_shard_index(roomid, g_count, 0);
+    }
+    else if (parse_query_arg(buf, line_len, "worker", worker, sizeof(worker)) == 0)
+    {
+        // 各工作进程的指标只能分别抓取：/metrics?worker=N 交给 N 号进程
+        index = atoi(worker);
+        if (index < 0 || index >= g_count)
+            index = 0;
+    }
+    // 其余没有 roomid 的请求交给 0 号进程，由它按原逻辑拒绝
+    route_to_worker(conn, index);
+    return 1;
+}
+
+static void accept_pending(void)
+{
+    for (;;)
+    {
+        int fd = accept4(g_listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0)
+            return;
+        if (g_pending_len == g_pending_cap)
+        {
+            int cap = g_pending_cap ? g_pending_cap * 2 : 64;
+            pending_conn_t *pending = realloc(g_pending, cap * sizeof(pending_conn_t));
+            if (!pending)
+            {
+                lwsl_err("Failed to allocate memory for pending connections\n");
+                close(fd);
+                continue;
+            }
+            g_pending = pending;
+            g_pending_cap = cap;
+        }
+        g_pending[g_pending_len].fd = fd;
+        g_pending[g_pending_len].accepted_ms = now_ms();
+        g_pending[g_pending_len].partial = 0;
+        g_pending_len++;
+    }
+}
+
+// 回收退出的工作进程，到时间的重新启动；子进程中返回 0
+static int reap_workers(int *ctrl_fd)
+{
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        for (int i = 0; i < g_count; i++)
+        {
+            if (g_workers[i].pid != pid)
+                continue;
+            lwsl_err("工作进程 %d (pid %d) 已退出，状态 %d\n", i, (int)pid, status);
+            worker_drop_outbox(&g_workers[i]);
+            close(g_workers[i].ctrl_fd);
+            g_workers[i].ctrl_fd = -1;
+            g_workers[i].pid = 0;
+        }
+    }
+    long now = now_ms();
+    for (int i = 0; i < g_count && !g_stop; i++)
+    {
+        if (g_workers[i].pid || now - g_workers[i].spawned_ms < ROUTER_RESPAWN_DELAY_MS)
+            continue;
+        if (spawn_worker(i, ctrl_fd) == 0)
+            return 0;
+    }
+    return 1;
+}
+
+static void stop_workers(void)
+{
+    for (int i = 0; i < g_count; i++)
+    {
+        if (g_workers[i].pid)
+            kill(g_workers[i].pid, SIGINT);
+    }
+    for (int i = 0; i < g_count; i++)
+    {
+        if (g_workers[i].pid)
+            waitpid(g_workers[i].pid, NULL, 0);
+        if (g_workers[i].ctrl_fd >= 0)
+            close(g_workers[i].ctrl_fd);
+        worker_drop_outbox(&g_workers[i]);
+        free(g_workers[i].outbox);
+    }
+    for (int i = 0; i < g_pending_len; i++)
+    {
+        close(g_pending[i].fd);
+    }
+    close(g_listen_fd);
+    free(g_workers);
+    free(g_pending);
+}
+
+// 启动路由进程和 count 个工作进程。
+// 返回 0 表示当前是工作进程（ctrl_fd 为接收连接的 socket），1 表示路由进程正常退出，-1 出错
+int workers_start(int count, int port, int *ctrl_fd)
+{
+    g_count = count;
+    g_workers = (worker_proc_t *)calloc(count, sizeof(worker_proc_t));
+    if (!g_workers)
+    {
+        lwsl_err("Failed to allocate memory for workers\n");
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        g_workers[i].ctrl_fd = -1;
+    }
+    if ((g_listen_fd = router_listen(port)) < 0)
+    {
+        free(g_workers);
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        int ret = spawn_worker(i, ctrl_fd);
+        if (ret <= 0)
+        {
+            if (ret < 0)
+                stop_workers();
+            return ret;
+        }
+    }
+    signal(SIGINT, router_signal_handler);
+    signal(SIGTERM, router_signal_handler);
+    signal(SIGPIPE, SIG_IGN);
+    lwsl_notice("路由进程已启动，监听端口 %d，工作进程 %d\n", port, count);
+
+    struct pollfd *fds = NULL;
+    int fds_cap = 0;
+    while (!g_stop)
+    {
+        // fds 依次是监听 socket、等待请求行的连接、各工作进程的 ctrl_fd（有待转交连接时等待可写）
+        if (fds_cap < g_pending_len + 1 + g_count)
+        {
+            fds_cap = g_pending_cap + 1 + g_count;
+            struct pollfd *new_fds = realloc(fds, fds_cap * sizeof(struct pollfd));
+            if (!new_fds)
+                break;
+            fds = new_fds;
+        }
+        fds[0].fd = g_listen_fd;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < g_pending_len; i++)
+        {
+            fds[i + 1].fd = g_pending[i].fd;
+            fds[i + 1].events = g_pending[i].partial ? 0 : POLLIN;
+        }
+        struct pollfd *worker_fds = fds + g_pending_len + 1;
+        for (int i = 0; i < g_count; i++)
+        {
+            worker_fds[i].fd = g_workers[i].outbox_len ? g_workers[i].ctrl_fd : -1;
+            worker_fds[i].events = POLLOUT;
+            worker_fds[i].revents = 0;
+        }
+        poll(fds, g_pending_len + 1 + g_count, 10);
+
+        // 先处理已有连接再接受新连接，fds 与 g_pending 下标一一对应
+        long now = now_ms();
+        int kept = 0;
+        for (int i = 0; i < g_pending_len; i++)
+        {
+            pending_conn_t conn = g_pending[i];
+            if ((fds[i + 1].revents || conn.partial) && route_pending(&conn))
+                continue;
+            if (now - conn.accepted_ms > ROUTER_HANDSHAKE_TIMEOUT_MS)
+            {
+                close(conn.fd);
+                continue;
+            }
+            g_pending[kept++] = conn;
+        }
+        g_pending_len = kept;
+        if (fds[0].revents & POLLIN)
+            accept_pending();
+        for (int i = 0; i < g_count; i++)
+        {
+            worker_proc_t *worker = &g_workers[i];
+            if (worker_fds[i].revents & (POLLERR | POLLHUP))
+            {
+                lwsl_err("工作进程 %d 的 ctrl_fd 已断开，丢弃 %d 个待转交连接\n", i, worker->outbox_len);
+                worker_drop_outbox(worker);
+            }
+            else if (worker_fds[i].revents & POLLOUT)
+            {
+                worker_flush_outbox(worker, i);
+            }
+            // 等待太久的待转交连接按握手超时关闭
+            int kept_out = 0;
+            for (int j = 0; j < worker->outbox_len; j++)
+            {
+                if (now - worker->outbox[j].accepted_ms > ROUTER_HANDSHAKE_TIMEOUT_MS)
+                    close(worker->outbox[j].fd);
+                else
+                    worker->outbox[kept_out++] = worker->outbox[j];
+            }
+            worker->outbox_len = kept_out;
+        }
+
+        if (reap_workers(ctrl_fd) == 0)
+        {
+            // 重启出来的工作进程
+            free(fds);
+            return 0;
+        }
+    }
+    free(fds);
+    lwsl_notice("路由进程正在关闭...\n");
+    stop_workers();
+    return 1;
+}
+
+// 当前工作进程的编号，*count 为工作进程总数；不是工作进程时返回 -1
+int worker_self(int *count)
+{
+    *count = g_self_count;
+    return g_self_index;
+}
+
+// 工作进程：把接收连接的 socket 托管给 lws 事件循环
+int worker_attach(struct lws_vhost *vhost, int ctrl_fd)
+{
+    lws_sock_file_fd_type desc;
+    set_nonblock(ctrl_fd);
+    desc.sockfd = ctrl_fd;
+    if (!lws_adopt_descriptor_vhost(vhost, LWS_ADOPT_RAW_FILE_DESC, desc, "worker-ctrl", NULL))
+    {
+        lwsl_err("Failed to adopt worker control socket\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 从 unix socket 收取路由进程转交的连接 fd，交给 lws 按 http 连接处理
+static void worker_receive_fds(int ctrl_fd, struct lws_vhost *vhost)
+{
+    for (;;)
+    {
+        char byte;
+        struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+        union
+        {
+            struct cmsghdr align;
+            char buf[CMSG_SPACE(sizeof(int))];
+        } control;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        if (recvmsg(ctrl_fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC) <= 0)
+            return;
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        int fd;
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        // 失败时 lws 会关闭该 fd
+        if (!lws_adopt_socket_vhost(vhost, fd))
+            lwsl_err("Failed to adopt routed connection\n");
+    }
+}
+
+int callback_worker(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len)
+{
+    switch (reason)
+    {
+    case LWS_CALLBACK_RAW_RX_FILE:
+        worker_receive_fds(lws_get_socket_fd(wsi), lws_get_vhost(wsi));
+        break;
+    case LWS_CALLBACK_RAW_CLOSE_FILE:
+        // 路由进程已退出，工作进程不会再收到新连接
+        lwsl_err("与路由进程的连接已断开\n");
+        kill(getpid(), SIGINT);
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
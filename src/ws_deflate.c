@@ -0,0 +1,93 @@
+#include "ws_deflate.h"
+#include <string.h>
+#include <zlib.h>
+
+// permessage-deflate（RFC 7692）的帧编码：每条消息独立压缩（等同 no_context_takeover），
+// 不依赖连接上的压缩状态，同一条广播压缩一次后所有成员共用同一个完整帧。
+
+// 每个线程一个压缩流，每条消息前 deflateReset，避免反复分配 zlib 状态
+static __thread z_stream t_stream;
+static __thread int t_stream_level = -1;
+
+static z_stream *thread_stream(int level)
+{
+    if (t_stream_level == level)
+    {
+        deflateReset(&t_stream);
+        return &t_stream;
+    }
+    if (t_stream_level >= 0)
+        deflateEnd(&t_stream);
+    t_stream_level = -1;
+    memset(&t_stream, 0, sizeof(t_stream));
+    // 负的 windowBits 表示不带 zlib 头的原始 deflate 数据
+    if (deflateInit2(&t_stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return NULL;
+    t_stream_level = level;
+    return &t_stream;
+}
+
+// 写帧头，返回帧头长度
+static size_t write_header(unsigned char *out, size_t len, int compressed, int binary)
+{
+    out[0] = 0x80 | (compressed ? 0x40 : 0) | (binary ? 0x2 : 0x1); // FIN + RSV1（已压缩）+ 文本帧/二进制帧
+    if (len < 126)
+    {
+        out[1] = (unsigned char)len;
+        return 2;
+    }
+    if (len <= 0xFFFF)
+    {
+        out[1] = 126;
+        out[2] = (unsigned char)(len >> 8);
+        out[3] = (unsigned char)len;
+        return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; i++)
+        out[2 + i] = (unsigned char)((unsigned long long)len >> (56 - 8 * i));
+    return 10;
+}
+
+// 载荷长度为 len 的帧的帧头长度，与 write_header 一致
+size_t ws_frame_header_len(size_t len)
+{
+    return len < 126 ? 2 : len <= 0xFFFF ? 4 : 10;
+}
+
+// 编码后的帧长度上限，用于预先分配输出缓冲区
+size_t ws_frame_bound(size_t len)
+{
+    return WS_FRAME_HEADER_MAX + len;
+}
+
+// 把 payload 编码成一个完整的文本帧（binary 时为二进制帧）写入 out：level > 0 且消息不太短时尝试压缩，
+// 压缩后不比原文小（短消息、已压缩数据）时按原文发送。返回帧长度，失败返回 0
+size_t ws_frame_encode(unsigned char *out, size_t cap, const unsigned char *payload, size_t len, int level, int binary)
+{
+    if (cap < ws_frame_bound(len))
+        return 0;
+    z_stream *zs = level > 0 && len >= WS_DEFLATE_MIN_LEN ? thread_stream(level) : NULL;
+    if (zs)
+    {
+        // 压缩结果先写到最长帧头之后，确定长度后再移到实际帧头之后
+        zs->next_in = (unsigned char *)payload;
+        zs->avail_in = (unsigned int)len;
+        zs->next_out = out + WS_FRAME_HEADER_MAX;
+        zs->avail_out = (unsigned int)len;
+        int ret = deflate(zs, Z_SYNC_FLUSH);
+        size_t produced = len - zs->avail_out;
+        // 压缩数据以 00 00 ff ff 结尾（同步刷新的空块），按规范去掉
+        if ((ret == Z_OK || ret == Z_BUF_ERROR) && zs->avail_in == 0 && zs->avail_out > 0 && produced >= 4)
+        {
+            size_t clen = produced - 4;
+            size_t hlen = ws_frame_header_len(clen);
+            memmove(out + hlen, out + WS_FRAME_HEADER_MAX, clen);
+            write_header(out, clen, 1, binary);
+            return hlen + clen;
+        }
+    }
+    size_t hlen = write_header(out, len, 0, binary);
+    memcpy(out + hlen, payload, len);
+    return hlen + len;
+}